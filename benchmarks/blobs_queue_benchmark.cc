@@ -0,0 +1,169 @@
+/**
+ * Contention benchmark for RingBlobsQueue.
+ *
+ * Runs 1 to --max_threads producers against as many consumers, doubling the
+ * count each round, over one queue of --capacity slots. Each producer
+ * enqueues --records records, one int64 blob each, --batch at a time with
+ * writeMany() (or blockingWrite() for a batch of 1), and the consumers
+ * dequeue them the same way with readMany() (or blockingRead()) until the
+ * queue is closed and drained. Reports records/sec for each round and
+ * checks that every record came out exactly once.
+ *
+ * With --locked the rounds run over a BlobsQueue instead, the mutex-based
+ * queue of the CreateBlobsQueue op, as the baseline to compare against. It
+ * has no batched calls, so --batch must be 1.
+ *
+ * Build against the installed headers and libCaffe2_CPU.a of the target
+ * platform, e.g.
+ *   c++ -std=c++11 -O2 -Iinstall/include benchmarks/blobs_queue_benchmark.cc \
+ *     -Linstall/lib -lCaffe2_CPU -lprotobuf-lite -lpthread
+ */
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/queue/blobs_queue.h"
+#include "caffe2/queue/ring_blobs_queue.h"
+
+CAFFE2_DEFINE_int(capacity, 64, "Number of slots of the queue.");
+CAFFE2_DEFINE_int(records, 200000, "Records enqueued by each producer.");
+CAFFE2_DEFINE_int(batch, 1, "Records per readMany()/writeMany() call.");
+CAFFE2_DEFINE_int(max_threads, 16, "Largest number of producers/consumers.");
+CAFFE2_DEFINE_bool(locked, false, "Benchmark BlobsQueue instead.");
+
+namespace caffe2 {
+
+// Batched calls, for RingBlobsQueue only.
+size_t WriteMany(
+    RingBlobsQueue* queue,
+    const std::vector<std::vector<Blob*>>& records) {
+  return queue->writeMany(records);
+}
+
+size_t ReadMany(
+    RingBlobsQueue* queue,
+    const std::vector<std::vector<Blob*>>& records) {
+  return queue->readMany(records);
+}
+
+size_t WriteMany(BlobsQueue*, const std::vector<std::vector<Blob*>>&) {
+  CAFFE_THROW("BlobsQueue has no batched writes.");
+}
+
+size_t ReadMany(BlobsQueue*, const std::vector<std::vector<Blob*>>&) {
+  CAFFE_THROW("BlobsQueue has no batched reads.");
+}
+
+template <class Queue>
+void Produce(Queue* queue, int64_t first, int64_t count, int batch) {
+  std::vector<Blob> blobs(batch);
+  std::vector<std::vector<Blob*>> records(batch);
+  for (int i = 0; i < batch; ++i) {
+    records[i] = {&blobs[i]};
+  }
+  for (int64_t i = 0; i < count; i += batch) {
+    const int n = std::min<int64_t>(batch, count - i);
+    for (int j = 0; j < n; ++j) {
+      *blobs[j].GetMutable<int64_t>() = first + i + j;
+    }
+    if (batch == 1) {
+      CAFFE_ENFORCE(queue->blockingWrite(records[0]));
+    } else {
+      records.resize(n);
+      CAFFE_ENFORCE_EQ(WriteMany(queue, records), n);
+    }
+  }
+}
+
+template <class Queue>
+void Consume(Queue* queue, int batch, std::atomic<int64_t>* sum,
+             std::atomic<int64_t>* count) {
+  std::vector<Blob> blobs(batch);
+  std::vector<std::vector<Blob*>> records(batch);
+  for (int i = 0; i < batch; ++i) {
+    records[i] = {&blobs[i]};
+  }
+  int64_t local_sum = 0;
+  int64_t local_count = 0;
+  for (;;) {
+    size_t n;
+    if (batch == 1) {
+      n = queue->blockingRead(records[0]) ? 1 : 0;
+    } else {
+      n = ReadMany(queue, records);
+    }
+    if (n == 0) {
+      break;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      local_sum += blobs[i].Get<int64_t>();
+    }
+    local_count += n;
+  }
+  *sum += local_sum;
+  *count += local_count;
+}
+
+template <class Queue>
+void RunRound(int threads) {
+  Workspace ws;
+  auto queue = std::make_shared<Queue>(
+      &ws, "queue", FLAGS_capacity, 1, true);
+  const int64_t records = FLAGS_records;
+  std::atomic<int64_t> sum(0);
+  std::atomic<int64_t> count(0);
+
+  Timer timer;
+  std::vector<std::thread> consumers;
+  for (int i = 0; i < threads; ++i) {
+    consumers.emplace_back(
+        Consume<Queue>, queue.get(), FLAGS_batch, &sum, &count);
+  }
+  std::vector<std::thread> producers;
+  for (int i = 0; i < threads; ++i) {
+    producers.emplace_back(
+        Produce<Queue>, queue.get(), i * records, records, FLAGS_batch);
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  queue->close();
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+  const double seconds = timer.Seconds();
+
+  const int64_t total = threads * records;
+  CAFFE_ENFORCE_EQ(count.load(), total, "Records were lost or duplicated.");
+  CAFFE_ENFORCE_EQ(sum.load(), total * (total - 1) / 2, "Records corrupted.");
+  LOG(INFO) << threads << " producers x " << threads << " consumers: "
+            << total / seconds << " records/sec (" << seconds << " s)";
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  CAFFE_ENFORCE_GT(caffe2::FLAGS_batch, 0);
+  CAFFE_ENFORCE(
+      !caffe2::FLAGS_locked || caffe2::FLAGS_batch == 1,
+      "BlobsQueue has no batched calls, use --batch=1.");
+  LOG(INFO) << (caffe2::FLAGS_locked ? "BlobsQueue" : "RingBlobsQueue")
+            << ", capacity " << caffe2::FLAGS_capacity << ", batch "
+            << caffe2::FLAGS_batch << ", " << caffe2::FLAGS_records
+            << " records per producer";
+  for (int threads = 1; threads <= caffe2::FLAGS_max_threads; threads *= 2) {
+    if (caffe2::FLAGS_locked) {
+      caffe2::RunRound<caffe2::BlobsQueue>(threads);
+    } else {
+      caffe2::RunRound<caffe2::RingBlobsQueue>(threads);
+    }
+  }
+  return 0;
+}
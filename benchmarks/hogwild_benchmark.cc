@@ -0,0 +1,111 @@
+/**
+ * Replica scaling benchmark for RunPlanHogwild().
+ *
+ * Trains a --rows x --dim embedding table with SparseAdagrad: each iteration
+ * of the training net draws --batch random row indices and a random gradient
+ * for them, and applies the update to the table, which all the replicas
+ * share. For each of --replicas, runs the plan for --iterations iterations
+ * per replica, with the default engine and again after UseSIMDEngine() has
+ * opted it into the SIMD engine SparseAdagrad, and reports the examples/sec
+ * of both.
+ *
+ * Build against the installed headers and libCaffe2_CPU.a of the target
+ * platform, e.g.
+ *   c++ -std=c++11 -O2 -Iinstall/include benchmarks/hogwild_benchmark.cc \
+ *     -Linstall/lib -lCaffe2_CPU -lprotobuf-lite -lpthread
+ * The SIMD engine splits the updates over the ParallelFor() pool only on
+ * mobile builds, see parallel_elementwise_benchmark.cc.
+ */
+
+#include <vector>
+
+#include "caffe2/core/hogwild.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/sgd/adagrad_op.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/string_utils.h"
+
+CAFFE2_DEFINE_string(replicas, "1,2,4", "Comma separated replica counts.");
+CAFFE2_DEFINE_int(rows, 100000, "Rows of the embedding table.");
+CAFFE2_DEFINE_int(dim, 64, "Columns of the embedding table.");
+CAFFE2_DEFINE_int(batch, 256, "Rows updated per iteration.");
+CAFFE2_DEFINE_int(iterations, 200, "Iterations run by each replica.");
+
+namespace caffe2 {
+
+NetDef InitNet() {
+  NetDef net;
+  net.set_name("init");
+  OperatorDef* table = net.add_op();
+  *table = CreateOperatorDef(
+      "GaussianFill", "", vector<string>{}, vector<string>{"table"});
+  AddArgument<vector<int>>("shape", {FLAGS_rows, FLAGS_dim}, table);
+  AddArgument<float>("std", 0.01f, table);
+  OperatorDef* moment = net.add_op();
+  *moment = CreateOperatorDef(
+      "ConstantFill", "", vector<string>{}, vector<string>{"moment"});
+  AddArgument<vector<int>>("shape", {FLAGS_rows, FLAGS_dim}, moment);
+  AddArgument<float>("value", 0.f, moment);
+  OperatorDef* lr = net.add_op();
+  *lr = CreateOperatorDef(
+      "ConstantFill", "", vector<string>{}, vector<string>{"lr"});
+  AddArgument<vector<int>>("shape", {1}, lr);
+  AddArgument<float>("value", -0.01f, lr);
+  return net;
+}
+
+PlanDef TrainPlan() {
+  PlanDef plan;
+  plan.set_name("train");
+  NetDef* net = plan.add_network();
+  net->set_name("train");
+  OperatorDef* indices = net->add_op();
+  *indices = CreateOperatorDef(
+      "UniformIntFill", "", vector<string>{}, vector<string>{"indices"});
+  AddArgument<vector<int>>("shape", {FLAGS_batch}, indices);
+  AddArgument<int>("min", 0, indices);
+  AddArgument<int>("max", FLAGS_rows - 1, indices);
+  OperatorDef* grad = net->add_op();
+  *grad = CreateOperatorDef(
+      "GaussianFill", "", vector<string>{}, vector<string>{"grad"});
+  AddArgument<vector<int>>("shape", {FLAGS_batch, FLAGS_dim}, grad);
+  *net->add_op() = CreateOperatorDef(
+      "SparseAdagrad",
+      "",
+      vector<string>{"table", "moment", "indices", "grad", "lr"},
+      vector<string>{"table", "moment"});
+  ExecutionStep* step = plan.add_execution_step();
+  step->set_name("train");
+  step->add_network("train");
+  step->set_num_iter(FLAGS_iterations);
+  return plan;
+}
+
+double ExamplesPerSec(const PlanDef& plan, int replicas) {
+  Workspace ws;
+  CAFFE_ENFORCE(ws.RunNetOnce(InitNet()));
+  HogwildStats stats;
+  CAFFE_ENFORCE(RunPlanHogwild(
+      &ws, plan, replicas, FLAGS_batch, StopOnSignal{}, &stats));
+  return stats.examples_per_sec;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  const caffe2::PlanDef plan = caffe2::TrainPlan();
+  caffe2::PlanDef simd_plan = plan;
+  CAFFE_ENFORCE_EQ(caffe2::UseSIMDEngine(&simd_plan), 1);
+  for (const auto& count : caffe2::split(',', caffe2::FLAGS_replicas)) {
+    const int replicas = std::stoi(count);
+    const double base = caffe2::ExamplesPerSec(plan, replicas);
+    const double simd = caffe2::ExamplesPerSec(simd_plan, replicas);
+    LOG(INFO) << replicas << " replicas: " << base
+              << " examples/sec default, " << simd << " examples/sec SIMD";
+  }
+  return 0;
+}
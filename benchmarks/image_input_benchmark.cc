@@ -0,0 +1,130 @@
+/**
+ * Throughput benchmark for PipelinedImageInput.
+ *
+ * Writes a fixture db of --num_images random JPEG images of --image_size
+ * pixels square, as TensorProtos records of an encoded image and an int
+ * label, unless --db already exists. Then, for 1 to --max_threads decode
+ * threads, doubling the count each round, runs a PipelinedImageInput op
+ * reading that db through CreateDB for --iterations batches of --batch_size
+ * images, scaled to --scale and cropped to --crop, and reports images/sec.
+ * Each round uses half as many augment threads as decode threads, one pack
+ * thread and a prefetch depth of --prefetch_depth. A round of ImageInput,
+ * which decodes with --max_threads threads, is run first as the baseline.
+ *
+ * Build against the installed headers, libCaffe2_CPU.a and OpenCV of the
+ * target platform, e.g.
+ *   c++ -std=c++11 -O2 -Iinstall/include benchmarks/image_input_benchmark.cc \
+ *     -Linstall/lib -lCaffe2_CPU -lprotobuf-lite -lopencv_core \
+ *     -lopencv_imgproc -lopencv_imgcodecs -lpthread
+ */
+
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "caffe2/core/db.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/image/pipelined_image_input_op.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_string(db, "/tmp/image_input_benchmark.minidb", "Fixture db.");
+CAFFE2_DEFINE_string(db_type, "minidb", "Type of the fixture db.");
+CAFFE2_DEFINE_int(num_images, 512, "Images in the fixture db.");
+CAFFE2_DEFINE_int(image_size, 256, "Width and height of fixture images.");
+CAFFE2_DEFINE_int(batch_size, 32, "Images per batch.");
+CAFFE2_DEFINE_int(scale, 256, "Size to scale the shorter side of images to.");
+CAFFE2_DEFINE_int(crop, 224, "Size to crop images to.");
+CAFFE2_DEFINE_int(iterations, 20, "Batches read in each round.");
+CAFFE2_DEFINE_int(prefetch_depth, 2, "Batches prefetched ahead.");
+CAFFE2_DEFINE_int(max_threads, 8, "Largest number of decode threads.");
+
+namespace caffe2 {
+
+void WriteFixture() {
+  if (std::ifstream(FLAGS_db).good()) {
+    LOG(INFO) << "Using the existing fixture " << FLAGS_db;
+    return;
+  }
+  LOG(INFO) << "Writing " << FLAGS_num_images << " images to " << FLAGS_db;
+  std::unique_ptr<db::DB> out(db::CreateDB(FLAGS_db_type, FLAGS_db, db::NEW));
+  CAFFE_ENFORCE(out, "Cannot create ", FLAGS_db);
+  std::unique_ptr<db::Transaction> transaction(out->NewTransaction());
+  std::mt19937 randgen(0);
+  cv::Mat img(FLAGS_image_size, FLAGS_image_size, CV_8UC3);
+  for (int i = 0; i < FLAGS_num_images; ++i) {
+    // Smooth noise, so that the JPEGs decode like photos rather than static.
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(img, img, cv::Size(9, 9), 0);
+    std::vector<uchar> encoded;
+    CAFFE_ENFORCE(cv::imencode(".jpg", img, encoded));
+    TensorProtos protos;
+    TensorProto* image = protos.add_protos();
+    image->set_data_type(TensorProto::STRING);
+    image->add_string_data(
+        string(reinterpret_cast<const char*>(encoded.data()), encoded.size()));
+    TensorProto* label = protos.add_protos();
+    label->set_data_type(TensorProto::INT32);
+    label->add_int32_data(randgen() % 1000);
+    char key[16];
+    snprintf(key, sizeof(key), "%08d", i);
+    transaction->Put(key, protos.SerializeAsString());
+  }
+  transaction->Commit();
+}
+
+double RunRound(const string& type, int decode_threads) {
+  Workspace ws;
+  OperatorDef create_db;
+  create_db.set_type("CreateDB");
+  create_db.add_output("reader");
+  AddArgument<string>("db_type", FLAGS_db_type, &create_db);
+  AddArgument<string>("db", FLAGS_db, &create_db);
+  CAFFE_ENFORCE(ws.RunOperatorOnce(create_db));
+
+  OperatorDef def;
+  def.set_type(type);
+  def.add_input("reader");
+  def.add_output("data");
+  def.add_output("label");
+  AddArgument<int>("batch_size", FLAGS_batch_size, &def);
+  AddArgument<int>("scale", FLAGS_scale, &def);
+  AddArgument<int>("crop", FLAGS_crop, &def);
+  AddArgument<int>("mirror", 1, &def);
+  AddArgument<int>("decode_threads", decode_threads, &def);
+  AddArgument<int>("augment_threads", std::max(decode_threads / 2, 1), &def);
+  AddArgument<int>("pack_threads", 1, &def);
+  AddArgument<int>("prefetch_depth", FLAGS_prefetch_depth, &def);
+  unique_ptr<OperatorBase> op = CreateOperator(def, &ws);
+  CAFFE_ENFORCE(op, "Cannot create ", type);
+
+  // The first batch includes starting the threads.
+  CAFFE_ENFORCE(op->Run());
+  Timer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  const double seconds = timer.Seconds();
+  const double images_per_sec = FLAGS_iterations * FLAGS_batch_size / seconds;
+  LOG(INFO) << type << " with " << decode_threads
+            << " decode threads: " << images_per_sec << " images/sec";
+  return images_per_sec;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  caffe2::WriteFixture();
+  caffe2::RunRound("ImageInput", caffe2::FLAGS_max_threads);
+  for (int threads = 1; threads <= caffe2::FLAGS_max_threads; threads *= 2) {
+    caffe2::RunRound("PipelinedImageInput", threads);
+  }
+  return 0;
+}
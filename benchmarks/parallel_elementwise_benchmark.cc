@@ -0,0 +1,123 @@
+/**
+ * Thread scaling benchmark for the SIMD engine elementwise operators.
+ *
+ * For each of Add, Add with a broadcast B, Mul, Sum of three inputs, Scale,
+ * Relu and Clip, on float tensors of --sizes elements, runs the default
+ * engine operator and the SIMD engine operator --iterations times each, and
+ * reports the milliseconds per run and the speedup of the SIMD engine. The
+ * broadcast B is the last --broadcast_size elements of the shape.
+ *
+ * The SIMD engine operators split their work with ParallelFor(), whose pool
+ * only exists on mobile builds and has CAFFE2_PARALLEL_THREADS threads, so
+ * build the benchmark once per thread count to measure the scaling, e.g.
+ *   for t in 1 2 4 8 16; do
+ *     c++ -std=c++11 -O2 -DCAFFE2_PARALLEL_THREADS=$t -Iinstall/include \
+ *       benchmarks/parallel_elementwise_benchmark.cc -Linstall/lib \
+ *       -lCaffe2_CPU -lprotobuf-lite -lpthread -o elementwise_$t
+ *     ./elementwise_$t
+ *   done
+ * with the flags of the target mobile platform. Other builds run the SIMD
+ * engine operators on the calling thread.
+ */
+
+#include <random>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/operators/clip_op.h"
+#include "caffe2/operators/elementwise_op.h"
+#include "caffe2/operators/relu_op.h"
+#include "caffe2/operators/scale_op.h"
+#include "caffe2/operators/utility_ops.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/string_utils.h"
+
+CAFFE2_DEFINE_string(
+    sizes,
+    "16384,262144,4194304",
+    "Comma separated numbers of elements of the inputs.");
+CAFFE2_DEFINE_int(broadcast_size, 64, "Elements of the broadcast B.");
+CAFFE2_DEFINE_int(iterations, 50, "Runs of each operator.");
+
+namespace caffe2 {
+
+void FillInput(Workspace* ws, const string& name, TIndex size) {
+  static std::mt19937 randgen(0);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(size);
+  float* data = tensor->mutable_data<float>();
+  for (TIndex i = 0; i < size; ++i) {
+    data[i] = dist(randgen);
+  }
+}
+
+OperatorDef MakeDef(const string& type, const vector<string>& inputs) {
+  return CreateOperatorDef(type, "", inputs, vector<string>{"Y"});
+}
+
+// Milliseconds per run of def with the given engine.
+double TimeOperator(Workspace* ws, OperatorDef def, const string& engine) {
+  def.set_engine(engine);
+  unique_ptr<OperatorBase> op = CreateOperator(def, ws);
+  CAFFE_ENFORCE(op, "Cannot create ", def.type(), " with engine ", engine);
+  // Warm up, which also allocates the output.
+  CAFFE_ENFORCE(op->Run());
+  Timer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+void RunSize(TIndex size) {
+  Workspace ws;
+  FillInput(&ws, "A", size);
+  FillInput(&ws, "B", size);
+  FillInput(&ws, "C", size);
+  FillInput(&ws, "bias", FLAGS_broadcast_size);
+  ws.GetBlob("A")->GetMutable<TensorCPU>()->Reshape(
+      vector<TIndex>{size / FLAGS_broadcast_size, FLAGS_broadcast_size});
+  ws.GetBlob("B")->GetMutable<TensorCPU>()->Reshape(
+      vector<TIndex>{size / FLAGS_broadcast_size, FLAGS_broadcast_size});
+
+  vector<std::pair<string, OperatorDef>> cases;
+  cases.emplace_back("Add", MakeDef("Add", {"A", "B"}));
+  OperatorDef broadcast = MakeDef("Add", {"A", "bias"});
+  AddArgument<int>("broadcast", 1, &broadcast);
+  cases.emplace_back("Add broadcast", broadcast);
+  cases.emplace_back("Mul", MakeDef("Mul", {"A", "B"}));
+  cases.emplace_back("Sum", MakeDef("Sum", {"C", "C", "C"}));
+  OperatorDef scale = MakeDef("Scale", {"C"});
+  AddArgument<float>("scale", 0.5f, &scale);
+  cases.emplace_back("Scale", scale);
+  cases.emplace_back("Relu", MakeDef("Relu", {"C"}));
+  OperatorDef clip = MakeDef("Clip", {"C"});
+  AddArgument<float>("min", -0.5f, &clip);
+  AddArgument<float>("max", 0.5f, &clip);
+  cases.emplace_back("Clip", clip);
+
+  for (const auto& c : cases) {
+    const double base_ms = TimeOperator(&ws, c.second, "");
+    const double simd_ms = TimeOperator(&ws, c.second, CAFFE2_SIMD_ENGINE);
+    LOG(INFO) << c.first << " of " << size << " floats on "
+              << ParallelThreads() << " threads: " << base_ms
+              << " ms default, " << simd_ms << " ms SIMD, "
+              << base_ms / simd_ms << "x";
+  }
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  for (const auto& size : caffe2::split(',', caffe2::FLAGS_sizes)) {
+    caffe2::RunSize(std::stoll(size));
+  }
+  return 0;
+}
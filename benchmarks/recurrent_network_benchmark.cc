@@ -0,0 +1,108 @@
+/**
+ * Per-timestep benchmark for CompiledRecurrentNetwork.
+ *
+ * Runs a vanilla RNN, hidden_t = tanh(input_t + hidden_t-1), over
+ * --seq_len timesteps of --batch_size x --hidden_size floats, with
+ * RecurrentNetwork and with CompiledRecurrentNetwork, and reports the
+ * microseconds per timestep of the first run, which creates the step
+ * workspaces and nets, and the average of --iterations further runs. The
+ * step net is tiny on purpose, so that the time is dominated by what the ops
+ * do around it at each timestep.
+ *
+ * Build against the installed headers and libCaffe2_CPU.a, e.g.
+ *   c++ -std=c++11 -O2 -Iinstall/include \
+ *     benchmarks/recurrent_network_benchmark.cc -Linstall/lib \
+ *     -lCaffe2_CPU -lprotobuf -lpthread
+ */
+
+#include <random>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/operators/compiled_recurrent_network_op.h"
+#include "caffe2/utils/proto_utils.h"
+#include "google/protobuf/text_format.h"
+
+CAFFE2_DEFINE_int(seq_len, 64, "Timesteps of the sequence.");
+CAFFE2_DEFINE_int(batch_size, 8, "Sequences in a batch.");
+CAFFE2_DEFINE_int(hidden_size, 32, "Size of the hidden state.");
+CAFFE2_DEFINE_int(iterations, 100, "Runs timed after the first one.");
+
+namespace caffe2 {
+
+void FillInput(Workspace* ws, const string& name, vector<TIndex> dims) {
+  static std::mt19937 randgen(0);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  float* data = tensor->mutable_data<float>();
+  for (TIndex i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(randgen);
+  }
+}
+
+OperatorDef RNNDef(const string& type) {
+  NetDef step;
+  step.set_name("rnn_step");
+  *step.add_op() = CreateOperatorDef(
+      "Add",
+      "",
+      vector<string>{"input_t", "hidden_t_prev"},
+      vector<string>{"sum_t"});
+  *step.add_op() = CreateOperatorDef(
+      "Tanh", "", vector<string>{"sum_t"}, vector<string>{"hidden_t"});
+  string step_net;
+  CAFFE_ENFORCE(google::protobuf::TextFormat::PrintToString(step, &step_net));
+
+  OperatorDef def = CreateOperatorDef(
+      type,
+      "",
+      vector<string>{"input", "h0"},
+      vector<string>{"hidden_all", "step_workspaces"});
+  AddArgument<string>("step_net", step_net, &def);
+  AddArgument<vector<string>>("recurrent_states", {"hidden"}, &def);
+  AddArgument<vector<int>>("initial_recurrent_state_ids", {1}, &def);
+  AddArgument<vector<string>>(
+      "link_internal", {"hidden_t_prev", "hidden_t", "input_t"}, &def);
+  AddArgument<vector<string>>(
+      "link_external", {"hidden", "hidden", "input"}, &def);
+  AddArgument<vector<int>>("link_offset", {0, 1, 0}, &def);
+  AddArgument<vector<int>>("link_window", {1, 1, 1}, &def);
+  AddArgument<vector<string>>("alias_src", {"hidden"}, &def);
+  AddArgument<vector<string>>("alias_dst", {"hidden_all"}, &def);
+  AddArgument<vector<int>>("alias_offset", {1}, &def);
+  return def;
+}
+
+void RunRound(const string& type) {
+  Workspace ws;
+  FillInput(
+      &ws, "input", {FLAGS_seq_len, FLAGS_batch_size, FLAGS_hidden_size});
+  FillInput(&ws, "h0", {FLAGS_batch_size, FLAGS_hidden_size});
+  unique_ptr<OperatorBase> op = CreateOperator(RNNDef(type), &ws);
+  CAFFE_ENFORCE(op, "Cannot create ", type);
+
+  Timer timer;
+  CAFFE_ENFORCE(op->Run());
+  const double first_us = timer.MicroSeconds() / FLAGS_seq_len;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  const double us = timer.MicroSeconds() / (FLAGS_iterations * FLAGS_seq_len);
+  LOG(INFO) << type << ": " << first_us << " us per timestep on the first "
+            << "run, " << us << " us per timestep after";
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  caffe2::RunRound("RecurrentNetwork");
+  caffe2::RunRound("CompiledRecurrentNetwork");
+  return 0;
+}
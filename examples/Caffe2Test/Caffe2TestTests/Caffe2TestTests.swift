@@ -7,6 +7,7 @@
 //
 
 import XCTest
+import Caffe2Kit
 @testable import Caffe2Test
 
 class Caffe2TestTests: XCTestCase {
@@ -26,6 +27,26 @@ class Caffe2TestTests: XCTestCase {
         // Use XCTAssert and related functions to verify your tests produce the correct results.
     }
     
+    func testTopKMatchesSqueezeNetPrediction() {
+        // SqueezeNet's output is [1, 1000, 1, 1]: one row of 1000 classes.
+        let caffe = try! Caffe2(initNetNamed: "squeeze_init_net", predictNetNamed: "squeeze_predict_net")
+        let image = UIImage(named: "lion.png")!
+        let scores = caffe.prediction(regarding: image)!.map { $0.floatValue }
+        XCTAssertEqual(scores.count, 1000)
+        let expected = scores.enumerated()
+            .sorted(by: { $0.element > $1.element || ($0.element == $1.element && $0.offset < $1.offset) })
+            .prefix(5)
+
+        var top = [Caffe2Prediction](repeating: Caffe2Prediction(), count: 5)
+        let count = caffe.prediction(regarding: image, top: 5, into: &top)
+        XCTAssertEqual(count, 5)
+        XCTAssertEqual(top[0].index, 291) // lion, king of beasts, Panthera leo
+        for (prediction, best) in zip(top, expected) {
+            XCTAssertEqual(prediction.index, best.offset)
+            XCTAssertEqual(prediction.score, best.element, accuracy: 1e-6)
+        }
+    }
+    
     func testPerformanceExample() {
         // This is an example of a performance test case.
         self.measure {
@@ -55,6 +55,29 @@ class Cursor {
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
 
+/**
+ * A cursor that can also hand out the current value in place, without
+ * copying it out of the db. The returned memory stays valid for as long as
+ * the db is open.
+ *
+ * This is a separate interface rather than more virtuals of Cursor, as the
+ * cursors of the dbs compiled into the prebuilt libraries have no vtable
+ * slots for them. Use ZeroCopyCursorOf() to find out whether a cursor
+ * implements it.
+ */
+class ZeroCopyCursor {
+ public:
+  virtual ~ZeroCopyCursor() {}
+  virtual const char* value_data() = 0;
+  virtual size_t value_size() = 0;
+};
+
+// Returns cursor as a ZeroCopyCursor, or nullptr if its db does not support
+// zero-copy value access.
+inline ZeroCopyCursor* ZeroCopyCursorOf(Cursor* cursor) {
+  return dynamic_cast<ZeroCopyCursor*>(cursor);
+}
+
 /**
  * An abstract class for the current database transaction while writing.
  */
@@ -0,0 +1,164 @@
+#ifndef CAFFE2_CORE_HOGWILD_H_
+#define CAFFE2_CORE_HOGWILD_H_
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+
+namespace caffe2 {
+
+/**
+ * Throughput of a RunPlanHogwild() call.
+ */
+struct HogwildStats {
+  // Iterations run by each replica, as counted by RunPlanHogwild().
+  std::vector<int64_t> iterations;
+  double seconds = 0;
+  // All the replicas' iterations times examples_per_iteration, per second.
+  double examples_per_sec = 0;
+  // Threads of the ParallelFor() pool the replicas shared.
+  size_t pool_threads = 1;
+};
+
+/**
+ * Runs num_replicas copies of plan at once, Hogwild style, each on its own
+ * thread and in its own child Workspace of ws.
+ *
+ * A child workspace resolves and creates blobs through ws first (see
+ * Workspace::CreateBlob()), so the blobs that exist in ws when this is
+ * called - the parameters and optimizer state an init net has filled in -
+ * are shared by all the replicas, and their optimizer ops update them in
+ * place with no locking. Everything else the plan creates, nets,
+ * activations and gradients included, is private to a replica. ws should
+ * therefore hold only what is meant to be shared: run the init net in it,
+ * not the training net.
+ *
+ * Updates of the same rows by different replicas race, as Hogwild intends:
+ * one may overwrite another, or read a row another is halfway through.
+ * ForEachSparseRow() orders only the duplicate indices within one sparse
+ * update, not updates made by other ops or replicas.
+ *
+ * plan runs as given. Its sparse optimizer ops only split their updates
+ * over the ParallelFor() pool with ForEachSparseRow() when they have the
+ * SIMD engine, which UseSIMDEngine(&plan) of simd_engine.h selects before
+ * the call; with the default engine, each update stays a serial loop on its
+ * replica's thread.
+ *
+ * The replicas share the one ParallelFor() pool of the process, of
+ * ParallelThreads() threads, and while one replica's op has it the others
+ * run their kernels on their own threads. So num_replicas replicas use at
+ * most num_replicas + ParallelThreads() threads; with a replica per core,
+ * build with CAFFE2_PARALLEL_THREADS=1 to leave the pool out. Library
+ * operators that call Workspace::GetThreadPool() still create a pool per
+ * replica workspace, on first use.
+ *
+ * Each call of should_continue a replica makes and gets true from counts
+ * as an iteration of examples_per_iteration examples. The plan executor
+ * makes one such call per iteration of a step, plus the one that finds the
+ * step done, so for the usual plan of one step running the training net
+ * for many iterations, examples_per_iteration is its batch size. The
+ * combined examples/sec is logged and, with the per replica iteration
+ * counts, stored in stats if given. Comparing it across num_replicas gives
+ * the scaling over cores.
+ *
+ * should_continue is shared by the replicas and called under a lock. Once it
+ * returns false, or a replica fails or throws, the other replicas stop at
+ * their next iteration. Returns whether all the replicas succeeded, and
+ * rethrows the first exception any of them threw.
+ */
+inline bool RunPlanHogwild(
+    Workspace* ws,
+    const PlanDef& plan,
+    int num_replicas,
+    int64_t examples_per_iteration = 1,
+    Workspace::ShouldContinue should_continue = StopOnSignal{},
+    HogwildStats* stats = nullptr) {
+  CAFFE_ENFORCE(ws);
+  CAFFE_ENFORCE_GT(num_replicas, 0);
+  std::vector<std::unique_ptr<Workspace>> replicas;
+  for (int i = 0; i < num_replicas; ++i) {
+    replicas.emplace_back(new Workspace(ws->RootFolder(), ws));
+  }
+  std::vector<int64_t> iterations(num_replicas, 0);
+  std::atomic<bool> stop(false);
+  bool success = true;
+  std::exception_ptr error;
+  // Guards should_continue, success and error.
+  std::mutex mutex;
+
+  Timer timer;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_replicas; ++i) {
+    threads.emplace_back([&, i]() {
+      auto replica_should_continue = [&, i](int iter) {
+        if (stop) {
+          return false;
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!should_continue(iter)) {
+            stop = true;
+            return false;
+          }
+        }
+        ++iterations[i];
+        return true;
+      };
+      try {
+        if (!replicas[i]->RunPlan(plan, replica_should_continue)) {
+          LOG(ERROR) << "Hogwild replica " << i << " failed.";
+          std::lock_guard<std::mutex> lock(mutex);
+          success = false;
+          stop = true;
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        stop = true;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double seconds = timer.Seconds();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  int64_t total = 0;
+  for (auto count : iterations) {
+    total += count;
+  }
+  const double examples_per_sec =
+      seconds > 0 ? total * examples_per_iteration / seconds : 0;
+  const size_t pool_threads = ParallelThreads();
+  LOG(INFO) << "Hogwild: " << num_replicas << " replicas ran " << total
+            << " iterations in " << seconds << " s, " << examples_per_sec
+            << " examples/sec (" << examples_per_sec / num_replicas
+            << " per replica); " << ws->LocalBlobs().size()
+            << " shared blobs, " << replicas[0]->LocalBlobs().size()
+            << " private to each replica; a shared pool of " << pool_threads
+            << " threads.";
+  if (stats) {
+    stats->iterations = iterations;
+    stats->seconds = seconds;
+    stats->examples_per_sec = examples_per_sec;
+    stats->pool_threads = pool_threads;
+  }
+  return success;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_HOGWILD_H_
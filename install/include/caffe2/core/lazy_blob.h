@@ -0,0 +1,229 @@
+#ifndef CAFFE2_CORE_LAZY_BLOB_H_
+#define CAFFE2_CORE_LAZY_BLOB_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+#include "caffe2/core/blob.h"
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/typeid.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// The number of stubs that exist and have not been materialized yet, so that
+// MaterializeLazyBlobs() costs nothing once there are none.
+inline std::atomic<int>& PendingLazyBlobCount() {
+  static std::atomic<int> count(0);
+  return count;
+}
+
+/**
+ * The content of a blob whose real content has not been loaded yet, e.g. one
+ * registered by a LazyLoad op. The stub only holds a loader, which fills a
+ * blob with the real content when MaterializeLazyBlob() is called on it.
+ *
+ * The stub is ordinary blob content, so Blob itself, which is compiled into
+ * the prebuilt libraries, is unchanged: Get<T>() on a stub fails with a type
+ * mismatch naming LazyBlob rather than loading it, and code that reads the
+ * blobs has to materialize them first. Predictor::runTopK() and the iOS
+ * wrapper call MaterializeLazyBlobs() before each run; other callers of
+ * Predictor::run() or Workspace::RunNet() have to as well. Writing another
+ * type to the blob simply drops the stub, and serializing a stub materializes
+ * it first.
+ */
+class LazyBlob {
+ public:
+  using Loader = std::function<void(Blob*)>;
+
+  // Shared by the stub and the threads materializing it, so that it outlives
+  // the stub being swapped out.
+  struct State {
+    explicit State(Loader loader) : loader(std::move(loader)) {
+      PendingLazyBlobCount()++;
+    }
+    ~State() {
+      if (!loaded) {
+        PendingLazyBlobCount()--;
+      }
+    }
+
+    // Held while loading, so that the stub is loaded once.
+    std::mutex mutex;
+    Loader loader;
+    bool loaded{false};
+  };
+
+  LazyBlob() {}
+  explicit LazyBlob(Loader loader)
+      : state_(std::make_shared<State>(std::move(loader))) {}
+
+  const std::shared_ptr<State>& state() const {
+    return state_;
+  }
+
+ private:
+  std::shared_ptr<State> state_;
+};
+
+// CAFFE_KNOWN_TYPE defines TypeMeta::Id<T>() out of line, so it cannot be
+// used in a header included by several translation units. The id is the
+// address of a static of an inline function, which is the same in all of
+// them.
+template <>
+inline CaffeTypeId TypeMeta::Id<LazyBlob>() {
+  static bool type_id_bit[1];
+  static TypeNameRegisterer<LazyBlob> registerer(
+      reinterpret_cast<CaffeTypeId>(type_id_bit));
+  return reinterpret_cast<CaffeTypeId>(type_id_bit);
+}
+
+// Serializes a stub by materializing it in place and serializing its real
+// content, so that saving a lazily loaded workspace saves what was loaded.
+class LazyBlobSerializer : public BlobSerializerBase {
+ public:
+  void Serialize(
+      const Blob& blob,
+      const string& name,
+      SerializationAcceptor acceptor) override;
+
+  void SerializeWithChunkSize(
+      const Blob& blob,
+      const string& name,
+      SerializationAcceptor acceptor,
+      int chunk_size) override;
+};
+
+// Guards setting, inspecting and replacing the stubs. It is only held for
+// that, never while a stub loads.
+inline std::mutex& LazyBlobMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+/**
+ * Registers LazyBlobSerializer, once per process however many translation
+ * units include this header. REGISTER_BLOB_SERIALIZER cannot be used in a
+ * header, as a second registration of a key exits the process.
+ */
+inline bool RegisterLazyBlobSerializer() {
+  static const bool registered = []() {
+    const CaffeTypeId id = TypeMeta::Id<LazyBlob>();
+    if (!BlobSerializerRegistry()->Has(id)) {
+      BlobSerializerRegistry()->Register(
+          id, RegistererBlobSerializerRegistry::DefaultCreator<
+                  LazyBlobSerializer>);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_lazy_blob_serializer_registered = RegisterLazyBlobSerializer();
+} // namespace
+
+// Turns blob into a stub that loader fills on MaterializeLazyBlob().
+inline void SetLazyBlob(Blob* blob, LazyBlob::Loader loader) {
+  CAFFE_ENFORCE(loader, "A lazy blob needs a loader.");
+  std::lock_guard<std::mutex> lock(LazyBlobMutex());
+  blob->Reset(new LazyBlob(std::move(loader)));
+}
+
+inline bool IsLazyBlob(const Blob& blob) {
+  std::lock_guard<std::mutex> lock(LazyBlobMutex());
+  return blob.IsType<LazyBlob>();
+}
+
+/**
+ * Replaces the stub in blob, if it holds one, with its real content. Returns
+ * whether it did. The loader runs with only this stub locked: other threads
+ * materializing it wait for it, others go ahead. Other threads must not read
+ * blob without materializing it first. If the loader throws, blob keeps its
+ * stub.
+ */
+inline bool MaterializeLazyBlob(Blob* blob) {
+  std::shared_ptr<LazyBlob::State> state;
+  {
+    std::lock_guard<std::mutex> lock(LazyBlobMutex());
+    if (!blob->IsType<LazyBlob>()) {
+      return false;
+    }
+    state = blob->Get<LazyBlob>().state();
+  }
+  std::lock_guard<std::mutex> load_lock(state->mutex);
+  if (state->loaded) {
+    // Another thread materialized it while we waited.
+    return false;
+  }
+  Blob loaded;
+  state->loader(&loaded);
+  {
+    std::lock_guard<std::mutex> lock(LazyBlobMutex());
+    // Unless the stub was overwritten in the meantime.
+    if (blob->IsType<LazyBlob>() && blob->Get<LazyBlob>().state() == state) {
+      blob->swap(loaded);
+    }
+  }
+  state->loaded = true;
+  PendingLazyBlobCount()--;
+  return true;
+}
+
+/**
+ * Materializes the stubs among the blobs net reads, in the order of their
+ * first use, and returns how many there were. Call it before running a net
+ * on blobs that may have been loaded lazily.
+ */
+inline int MaterializeLazyBlobs(Workspace* ws, const NetDef& net) {
+  if (PendingLazyBlobCount() == 0) {
+    return 0;
+  }
+  int materialized = 0;
+  std::unordered_set<string> seen;
+  auto materialize = [&](const string& name) {
+    if (seen.insert(name).second) {
+      Blob* blob = ws->GetBlob(name);
+      if (blob && MaterializeLazyBlob(blob)) {
+        materialized++;
+      }
+    }
+  };
+  for (const auto& op : net.op()) {
+    for (const auto& input : op.input()) {
+      materialize(input);
+    }
+  }
+  for (const auto& input : net.external_input()) {
+    materialize(input);
+  }
+  return materialized;
+}
+
+inline void LazyBlobSerializer::Serialize(
+    const Blob& blob,
+    const string& name,
+    SerializationAcceptor acceptor) {
+  SerializeWithChunkSize(blob, name, acceptor, kDefaultChunkSize);
+}
+
+inline void LazyBlobSerializer::SerializeWithChunkSize(
+    const Blob& blob,
+    const string& name,
+    SerializationAcceptor acceptor,
+    int chunk_size) {
+  // Materializing does not change what the blob holds as far as its users
+  // can tell, only whether it has been read yet.
+  Blob* mutable_blob = const_cast<Blob*>(&blob);
+  MaterializeLazyBlob(mutable_blob);
+  mutable_blob->Serialize(name, acceptor, chunk_size);
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_LAZY_BLOB_H_
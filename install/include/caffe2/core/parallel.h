@@ -0,0 +1,106 @@
+#ifndef CAFFE2_CORE_PARALLEL_H_
+#define CAFFE2_CORE_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/scope_guard.h"
+#include "caffe2/core/workspace.h"
+
+namespace caffe2 {
+
+// Smallest amount of work, in elements, worth handing to another thread:
+// inputs below twice this size run on the calling thread.
+#ifndef CAFFE2_PARALLEL_GRAIN
+#define CAFFE2_PARALLEL_GRAIN 16384
+#endif
+
+// Chunks start at multiples of this many elements, a cache line of floats,
+// so that threads do not write to the same line.
+constexpr size_t kParallelAlign = 16;
+
+// Threads of the pool ParallelFor() uses (0: one per core).
+#ifndef CAFFE2_PARALLEL_THREADS
+#define CAFFE2_PARALLEL_THREADS 0
+#endif
+
+#if CAFFE2_MOBILE
+/**
+ * The one thread pool ParallelFor() uses in the process, of
+ * CAFFE2_PARALLEL_THREADS threads. It is shared by all workspaces, so that
+ * RNN step workspaces, Hogwild replicas and the like do not each start a pool
+ * of their own.
+ */
+inline ThreadPool* GetParallelThreadPool() {
+  static ThreadPool pool(
+      CAFFE2_PARALLEL_THREADS > 0
+          ? CAFFE2_PARALLEL_THREADS
+          : std::max(std::thread::hardware_concurrency(), 1u));
+  return &pool;
+}
+
+// Set while a ParallelFor() call has the pool.
+inline std::atomic<bool>& ParallelThreadPoolBusy() {
+  static std::atomic<bool> busy(false);
+  return busy;
+}
+#endif // CAFFE2_MOBILE
+
+/**
+ * Calls fn(begin, end) over contiguous chunks that together cover [0, n),
+ * spread over GetParallelThreadPool() on mobile builds once n reaches twice
+ * grain, for CPU operators. Otherwise, for other Contexts, and while another
+ * call has the pool - a concurrent one, or the one fn was called from - it is
+ * a single fn(0, n) call on the calling thread. Chunks may run concurrently,
+ * so fn must only write to its own part of the output.
+ *
+ * The pool runs ranges smaller than its getMinWorkSize() inline, so n is cut
+ * into at least that many chunks (and a few per thread, for work stealing to
+ * even out), of at least align elements each.
+ */
+template <class Context = CPUContext, typename Fn>
+inline void ParallelFor(
+    size_t n,
+    const Fn& fn,
+    size_t grain = CAFFE2_PARALLEL_GRAIN,
+    size_t align = kParallelAlign) {
+#if CAFFE2_MOBILE
+  if (std::is_same<Context, CPUContext>::value && n >= 2 * grain) {
+    ThreadPool* pool = GetParallelThreadPool();
+    const size_t num_threads = pool->getNumThreads();
+    bool idle = false;
+    if (num_threads > 1 &&
+        ParallelThreadPoolBusy().compare_exchange_strong(idle, true)) {
+      auto release = MakeGuard([] { ParallelThreadPoolBusy() = false; });
+      const size_t target =
+          std::max(pool->getMinWorkSize(), 4 * num_threads);
+      const size_t chunk = std::max(align, n / target / align * align);
+      pool->run(
+          [&](int /* thread_id */, size_t i) {
+            fn(i * chunk, std::min(n, (i + 1) * chunk));
+          },
+          (n + chunk - 1) / chunk);
+      return;
+    }
+  }
+#endif // CAFFE2_MOBILE
+  if (n > 0) {
+    fn(0, n);
+  }
+}
+
+// Number of threads ParallelFor() spreads large inputs over.
+inline size_t ParallelThreads() {
+#if CAFFE2_MOBILE
+  return GetParallelThreadPool()->getNumThreads();
+#else
+  return 1;
+#endif // CAFFE2_MOBILE
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_PARALLEL_H_
@@ -0,0 +1,446 @@
+#ifndef CAFFE2_CORE_PLAN_EXECUTOR_H_
+#define CAFFE2_CORE_PLAN_EXECUTOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/bounded_task_runner.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+/**
+ * Time spent in one ExecutionStep of a plan. A step that runs several times,
+ * as the substep of an iterating step, accumulates over its runs.
+ */
+struct StepStats {
+  int64_t runs = 0;
+  int64_t iterations = 0;
+  double seconds = 0;
+};
+
+/**
+ * Runs a PlanDef in a workspace with the ExecutionStep semantics of
+ * Workspace::RunPlan() - num_iter, criteria_network, should_stop_blob,
+ * report_net, run_every_ms and only_once - with concurrent_substeps
+ * executed truly in parallel, so that the reader, preprocessing and
+ * training steps of one plan overlap:
+ *
+ * - A step with concurrent_substeps owns a thread set, one thread per
+ *   recurring substep but the one the step's own thread runs, created when
+ *   the plan is compiled and reused on every iteration of the step.
+ * - A concurrent substep stops early, at its next iteration, once the
+ *   should_stop_blob of an enclosing step is set or a sibling substep has
+ *   failed. The first exception a substep throws is rethrown by Run().
+ * - A should_stop_blob is looked up when its step starts, not when the plan
+ *   is compiled, so an earlier step may create it.
+ * - A run_every_ms substep that fails or throws fails its enclosing step,
+ *   whose other substeps stop at their next iteration.
+ * - The wall time and iteration count of every step are recorded in
+ *   Stats(), keyed by the step's path: the names of the enclosing steps and
+ *   its own, joined by '/', and logged when the plan finishes.
+ *
+ * should_continue is called under a lock, as concurrent substeps share it.
+ */
+class PlanExecutor {
+ public:
+  explicit PlanExecutor(
+      Workspace* ws,
+      Workspace::ShouldContinue should_continue = StopOnSignal{})
+      : ws_(ws), should_continue_(should_continue) {
+    CAFFE_ENFORCE(ws_);
+  }
+
+  bool Run(const PlanDef& plan) {
+    LOG(INFO) << "Started executing plan " << plan.name();
+    if (plan.execution_step_size() == 0) {
+      LOG(WARNING) << "Nothing to run - did you define a correct plan?";
+      return true;
+    }
+    for (const NetDef& net_def : plan.network()) {
+      if (!ws_->CreateNet(net_def, true)) {
+        LOG(ERROR) << "Failed initializing the networks.";
+        return false;
+      }
+    }
+    Timer plan_timer;
+    for (int i = 0; i < plan.execution_step_size(); ++i) {
+      const ExecutionStep& step = plan.execution_step(i);
+      const string path =
+          step.has_name() ? step.name() : "step" + caffe2::to_string(i);
+      std::unique_ptr<CompiledStep> compiled =
+          Compile(step, path, StopCondition{});
+      if (!Execute(*compiled)) {
+        LOG(ERROR) << "Failed executing step " << path;
+        return false;
+      }
+      LOG(INFO) << "Step " << path << " took " << compiled->stats->seconds
+                << " seconds.";
+    }
+    LOG(INFO) << "Total plan took " << plan_timer.Seconds() << " seconds.";
+    for (const auto& entry : Stats()) {
+      LOG(INFO) << "  " << entry.first << ": " << entry.second.runs
+                << " runs, " << entry.second.iterations << " iterations, "
+                << entry.second.seconds << " s";
+    }
+    return true;
+  }
+
+  std::map<string, StepStats> Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct CompiledStep;
+
+  // What, besides its own continuation test, ends the iterations of a
+  // step: the should_stop_blobs of its enclosing concurrent steps, the
+  // failure flags of its concurrent siblings and the failures of the report
+  // substeps of its enclosing steps.
+  struct StopCondition {
+    std::vector<const CompiledStep*> steps;
+    std::vector<const std::atomic<bool>*> failures;
+  };
+
+  struct CompiledStep {
+    const ExecutionStep* step;
+    StepStats* stats;
+    StopCondition stop;
+    // Looked up when the step starts.
+    const Blob* should_stop = nullptr;
+    NetBase* criteria = nullptr;
+    NetBase* report_net = nullptr;
+    int64_t num_iter = 1;
+    std::vector<NetBase*> networks;
+    std::vector<std::unique_ptr<CompiledStep>> substeps;
+    std::vector<std::unique_ptr<CompiledStep>> report_substeps;
+    // For concurrent substeps.
+    std::unique_ptr<TaskThreadPool> threads;
+    std::atomic<bool> failed{false};
+    // Set by a failing report substep.
+    std::atomic<bool> report_failed{false};
+    bool ran = false;
+  };
+
+  // Runs fn every interval_ms on its own thread, and once more on stop.
+  class Reporter {
+   public:
+    template <typename Fn>
+    void Start(int64_t interval_ms, Fn fn) {
+      threads_.emplace_back([this, interval_ms, fn]() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!done_) {
+          cv_.wait_for(lock, std::chrono::milliseconds(interval_ms));
+          lock.unlock();
+          fn();
+          lock.lock();
+        }
+      });
+    }
+
+    ~Reporter() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+      }
+      cv_.notify_all();
+      for (auto& thread : threads_) {
+        thread.join();
+      }
+    }
+
+   private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+  };
+
+  static bool ShouldStop(const Blob* blob) {
+    if (!blob || !blob->IsType<TensorCPU>()) {
+      return false;
+    }
+    const auto& tensor = blob->Get<TensorCPU>();
+    CAFFE_ENFORCE(
+        tensor.IsType<bool>() && tensor.size() == 1,
+        "should_stop_blob must be a boolean scalar");
+    return *tensor.data<bool>();
+  }
+
+  NetBase* GetNet(const string& name) {
+    NetBase* net = ws_->GetNet(name);
+    CAFFE_ENFORCE(net, "Network ", name, " not found.");
+    return net;
+  }
+
+  std::unique_ptr<CompiledStep>
+  Compile(const ExecutionStep& step, const string& path, StopCondition stop) {
+    CAFFE_ENFORCE(
+        step.substep_size() == 0 || step.network_size() == 0,
+        "An ExecutionStep should either have substep or networks but not "
+        "both.");
+    std::unique_ptr<CompiledStep> compiled(new CompiledStep);
+    compiled->step = &step;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      compiled->stats = &stats_[path];
+    }
+    compiled->stop = stop;
+    if (step.has_should_stop_blob()) {
+      CAFFE_ENFORCE(
+          !step.has_num_iter(),
+          "Must not specify num_iter if should_stop_blob is set");
+      compiled->num_iter = std::numeric_limits<int64_t>::max();
+    }
+    if (step.has_criteria_network()) {
+      CAFFE_ENFORCE(
+          !step.has_num_iter(),
+          "Must not specify num_iter if criteria_network is set");
+      compiled->criteria = GetNet(step.criteria_network());
+      CAFFE_ENFORCE(
+          !compiled->criteria->external_output().empty(),
+          "criteria_network ",
+          step.criteria_network(),
+          " has no external output.");
+    }
+    if (step.has_num_iter()) {
+      compiled->num_iter = step.num_iter();
+    }
+    if (step.has_report_net()) {
+      CAFFE_ENFORCE(
+          step.has_report_interval() && step.report_interval() > 0,
+          "A positive report_interval must be provided if report_net is set.");
+      compiled->report_net = GetNet(step.report_net());
+    }
+    for (const string& name : step.network()) {
+      compiled->networks.push_back(GetNet(name));
+    }
+
+    const bool concurrent =
+        step.concurrent_substeps() && step.substep_size() > 1;
+    StopCondition substep_stop = stop;
+    substep_stop.failures.push_back(&compiled->report_failed);
+    if (concurrent) {
+      substep_stop.steps.push_back(compiled.get());
+      substep_stop.failures.push_back(&compiled->failed);
+    }
+    for (int i = 0; i < step.substep_size(); ++i) {
+      const ExecutionStep& substep = step.substep(i);
+      const string name = substep.has_name() ? substep.name()
+                                             : "substep" + caffe2::to_string(i);
+      auto compiled_substep = Compile(substep, path + "/" + name, substep_stop);
+      if (substep.has_run_every_ms()) {
+        CAFFE_ENFORCE_GT(
+            substep.run_every_ms(),
+            0,
+            "run_every_ms of substep ",
+            name,
+            " must be positive.");
+        compiled->report_substeps.push_back(std::move(compiled_substep));
+      } else {
+        compiled->substeps.push_back(std::move(compiled_substep));
+      }
+    }
+    if (concurrent && compiled->substeps.size() > 1) {
+      compiled->threads.reset(
+          new TaskThreadPool(compiled->substeps.size() - 1));
+    }
+    return compiled;
+  }
+
+  bool ShouldContinue(CompiledStep& compiled, int64_t iter) {
+    if (compiled.report_failed) {
+      return false;
+    }
+    for (const CompiledStep* step : compiled.stop.steps) {
+      if (ShouldStop(step->should_stop)) {
+        return false;
+      }
+    }
+    for (const auto* failed : compiled.stop.failures) {
+      if (*failed) {
+        return false;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!should_continue_(iter)) {
+        return false;
+      }
+    }
+    if (!compiled.criteria) {
+      return iter < compiled.num_iter;
+    }
+    CAFFE_ENFORCE(
+        compiled.criteria->Run(),
+        "Failed running criteria_network ",
+        compiled.step->criteria_network());
+    const Blob* result =
+        ws_->GetBlob(compiled.criteria->external_output().front());
+    CAFFE_ENFORCE(result);
+    const auto& tensor = result->Get<TensorCPU>();
+    CAFFE_ENFORCE(tensor.IsType<bool>() && tensor.size() == 1);
+    return *tensor.data<bool>();
+  }
+
+  bool Execute(CompiledStep& compiled) {
+    if (compiled.step->only_once() && compiled.ran) {
+      return true;
+    }
+    compiled.ran = true;
+    Timer timer;
+    int64_t iter = 0;
+    const bool success = ExecuteIterations(compiled, &iter);
+    std::lock_guard<std::mutex> lock(mutex_);
+    compiled.stats->runs += 1;
+    compiled.stats->iterations += iter;
+    compiled.stats->seconds += timer.Seconds();
+    return success;
+  }
+
+  bool ExecuteIterations(CompiledStep& compiled, int64_t* iter) {
+    const ExecutionStep& step = *compiled.step;
+    VLOG(1) << "Running execution step " << step.name();
+    if (step.has_should_stop_blob()) {
+      compiled.should_stop = ws_->GetBlob(step.should_stop_blob());
+      CAFFE_ENFORCE(
+          compiled.should_stop,
+          "blob ",
+          step.should_stop_blob(),
+          " does not exist");
+    }
+    compiled.report_failed = false;
+    std::unique_ptr<Reporter> reporter;
+    if (compiled.report_net || !compiled.report_substeps.empty()) {
+      reporter.reset(new Reporter);
+      if (NetBase* report_net = compiled.report_net) {
+        reporter->Start(step.report_interval() * 1000, [report_net]() {
+          if (!report_net->Run()) {
+            LOG(WARNING) << "Error running report_net.";
+          }
+        });
+      }
+      for (auto& substep : compiled.report_substeps) {
+        CompiledStep* report_step = substep.get();
+        CompiledStep* parent = &compiled;
+        reporter->Start(report_step->step->run_every_ms(), [=]() {
+          // An exception would end the process on the reporter's thread.
+          try {
+            if (Execute(*report_step)) {
+              return;
+            }
+            LOG(ERROR) << "Failed executing report substep "
+                       << report_step->step->name();
+          } catch (const std::exception& e) {
+            LOG(ERROR) << "Report substep " << report_step->step->name()
+                       << " threw: " << e.what();
+          } catch (...) {
+            LOG(ERROR) << "Report substep " << report_step->step->name()
+                       << " threw.";
+          }
+          parent->report_failed = true;
+        });
+      }
+    }
+
+    const bool success = RunIterations(compiled, iter);
+    // Stops the reporters, which run their substeps once more.
+    reporter.reset();
+    if (compiled.report_failed) {
+      LOG(ERROR) << "A report substep of " << step.name() << " failed.";
+      return false;
+    }
+    return success;
+  }
+
+  bool RunIterations(CompiledStep& compiled, int64_t* iter) {
+    for (; ShouldContinue(compiled, *iter); ++*iter) {
+      if (compiled.threads) {
+        if (!ExecuteConcurrently(compiled)) {
+          return false;
+        }
+      } else if (!compiled.substeps.empty()) {
+        for (auto& substep : compiled.substeps) {
+          if (!Execute(*substep)) {
+            return false;
+          }
+          if (ShouldStop(compiled.should_stop)) {
+            ++*iter;
+            return true;
+          }
+        }
+      } else {
+        for (NetBase* network : compiled.networks) {
+          if (!network->Run()) {
+            return false;
+          }
+        }
+      }
+      if (ShouldStop(compiled.should_stop)) {
+        ++*iter;
+        return true;
+      }
+    }
+    return true;
+  }
+
+  // One iteration of a step with concurrent substeps: all but the last
+  // substep on the step's threads, the last on the calling thread.
+  bool ExecuteConcurrently(CompiledStep& compiled) {
+    compiled.failed = false;
+    BoundedTaskRunner runner(
+        compiled.threads.get(), compiled.threads->size());
+    auto run = [this, &compiled](CompiledStep* substep) {
+      try {
+        if (!Execute(*substep)) {
+          compiled.failed = true;
+        }
+      } catch (...) {
+        compiled.failed = true;
+        throw;
+      }
+    };
+    const size_t last = compiled.substeps.size() - 1;
+    for (size_t i = 0; i < last; ++i) {
+      CompiledStep* substep = compiled.substeps[i].get();
+      runner.Run([run, substep]() { run(substep); });
+    }
+    std::exception_ptr error;
+    try {
+      run(compiled.substeps[last].get());
+    } catch (...) {
+      error = std::current_exception();
+    }
+    runner.Wait();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return !compiled.failed;
+  }
+
+  Workspace* ws_;
+  Workspace::ShouldContinue should_continue_;
+  // Guards should_continue_ and stats_.
+  mutable std::mutex mutex_;
+  std::map<string, StepStats> stats_;
+
+  DISABLE_COPY_AND_ASSIGN(PlanExecutor);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_PLAN_EXECUTOR_H_
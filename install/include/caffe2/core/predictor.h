@@ -1,7 +1,9 @@
 #pragma once
 
+#include "caffe2/core/lazy_blob.h"
 #include "caffe2/core/net.h"
 #include "caffe2/core/tensor.h"
+#include "caffe2/utils/top_k.h"
 
 namespace caffe2 {
 
@@ -26,6 +28,44 @@ class Predictor {
   //   outputs->size() == run_net.external_inputs.size()
   void run(const TensorVector& inputs, TensorVector* outputs);
 
+  // Executes `run_net` like `run`, but instead of the outputs returns the
+  // `k` highest scores of the first (float) output and their indices, best
+  // first, for each of its rows. The first dimension of the output is the
+  // batch, one row per item, and all the remaining entries of a row are its
+  // classes, so that a [N, C, 1, 1] output such as SqueezeNet's has N rows
+  // of C classes. Returns the number of entries per row, min(k, classes).
+  // The selection is partial, so no row is copied or sorted as a whole.
+  TIndex runTopK(
+      const TensorVector& inputs,
+      int k,
+      std::vector<TIndex>* indices,
+      std::vector<float>* scores) {
+    CAFFE_ENFORCE_GE(k, 1, "k must be >= 1");
+    TensorVector outputs;
+    // Parameters loaded by a LazyLoad op are stubs until the net reads them.
+    MaterializeLazyBlobs(&ws_, run_net_);
+    run(inputs, &outputs);
+    CAFFE_ENFORCE(!outputs.empty(), "The predict net has no outputs.");
+    const TensorCPU& output = *outputs[0];
+    const TIndex rows = output.ndim() ? output.dim(0) : 1;
+    const TIndex classes = rows ? output.size() / rows : 0;
+    const TIndex kept = std::min<TIndex>(k, classes);
+    indices->resize(rows * kept);
+    scores->resize(rows * kept);
+    const float* data = output.data<float>();
+    std::vector<std::pair<float, TIndex>> scratch;
+    for (TIndex row = 0; row < rows && kept > 0; ++row) {
+      TopKRow(
+          data + row * classes,
+          classes,
+          kept,
+          scores->data() + row * kept,
+          indices->data() + row * kept,
+          &scratch);
+    }
+    return kept;
+  }
+
   const NetDef& def() const {
     return run_net_;
   };
@@ -0,0 +1,306 @@
+#ifndef CAFFE2_CORE_RAW_TENSOR_SERIALIZATION_H_
+#define CAFFE2_CORE_RAW_TENSOR_SERIALIZATION_H_
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/serialization_thread_pool.h"
+
+namespace caffe2 {
+
+constexpr auto kRawTensorBlobType = "RawTensor";
+
+/**
+ * @brief RawTensorSerializer serializes Tensors of fixed-size types as raw
+ * little endian bytes.
+ *
+ * Each chunk is a BlobProto of type "RawTensor" whose TensorProto keeps the
+ * payload in byte_data, written with a single copy instead of element by
+ * element into the repeated typed fields. Chunks of large tensors are
+ * serialized on the serialization thread pool, with at most
+ * SerializationChunksInFlight() of them pending, so a slow acceptor throttles
+ * the writer.
+ *
+ * Only RawTensorDeserializer reads this format, so the serializer is not
+ * registered for any blob type and Blob::Serialize never uses it: callers opt
+ * in by serializing through it, e.g. with SerializeBlobAsRawTensor(). Blobs
+ * that are not Tensor<Context> of a fixed-size type, and all blobs on big
+ * endian hosts, are serialized as usual.
+ */
+template <class Context>
+class RawTensorSerializer : public BlobSerializerBase {
+ public:
+  RawTensorSerializer() : context_() {}
+  ~RawTensorSerializer() {}
+  void Serialize(
+      const Blob& blob,
+      const string& name,
+      SerializationAcceptor acceptor) override;
+  void SerializeWithChunkSize(
+      const Blob& blob,
+      const string& name,
+      SerializationAcceptor acceptor,
+      int chunk_size) override;
+
+  void Serialize(const Tensor<Context>& tensor, const string& name,
+                 TensorProto* proto, size_t chunkBegin, int32_t chunkSize);
+
+  // Whether the blob is stored as raw bytes rather than as usual.
+  static bool CanSerialize(const Blob& blob);
+
+ private:
+  void StoreDeviceDetail(const Tensor<Context>& input, TensorProto* proto);
+  Context context_;
+};
+
+/**
+ * @brief RawTensorDeserializer is the deserializer for "RawTensor" blobs.
+ *
+ * The bytes are copied straight into the (aligned) storage of the tensor, as
+ * they may sit at any offset of the parsed message.
+ */
+template <class Context>
+class RawTensorDeserializer : public BlobDeserializerBase {
+ public:
+  void Deserialize(const BlobProto& proto, Blob* blob) override;
+  void Deserialize(const TensorProto& proto, Tensor<Context>* tensor);
+};
+
+namespace detail {
+// Whether tensors of the given type have a fixed item size.
+inline bool IsRawSerializable(TensorProto::DataType data_type) {
+  switch (data_type) {
+    case TensorProto_DataType_FLOAT:
+    case TensorProto_DataType_INT32:
+    case TensorProto_DataType_BOOL:
+    case TensorProto_DataType_UINT8:
+    case TensorProto_DataType_INT8:
+    case TensorProto_DataType_UINT16:
+    case TensorProto_DataType_INT16:
+    case TensorProto_DataType_INT64:
+    case TensorProto_DataType_FLOAT16:
+    case TensorProto_DataType_DOUBLE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+inline constexpr bool IsBigEndianHost() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return true;
+#else
+  return false;
+#endif
+}
+}  // namespace detail
+
+template <class Context>
+bool RawTensorSerializer<Context>::CanSerialize(const Blob& blob) {
+  return !detail::IsBigEndianHost() && blob.IsType<Tensor<Context>>() &&
+      detail::IsRawSerializable(
+             TypeMetaToDataType(blob.Get<Tensor<Context>>().meta()));
+}
+
+template <class Context>
+void RawTensorSerializer<Context>::Serialize(
+    const Blob& blob,
+    const string& name,
+    BlobSerializerBase::SerializationAcceptor acceptor) {
+  this->SerializeWithChunkSize(blob, name, acceptor, kDefaultChunkSize);
+}
+
+template <class Context>
+void RawTensorSerializer<Context>::SerializeWithChunkSize(
+    const Blob& blob,
+    const string& name,
+    BlobSerializerBase::SerializationAcceptor acceptor,
+    int chunk_size) {
+  if (!CanSerialize(blob)) {
+    blob.Serialize(name, acceptor, chunk_size);
+    return;
+  }
+  const auto& tensor = blob.template Get<Tensor<Context>>();
+  if (chunk_size == kNoChunking) {
+    chunk_size = tensor.size() + 1; // to account for empty tensors
+  } else if (chunk_size == kDefaultChunkSize) {
+    chunk_size = FLAGS_caffe2_tensor_chunk_size;
+  }
+
+  BoundedTaskRunner runner(
+      GetSerializationThreadPool(), SerializationChunksInFlight());
+
+  VLOG(1) << "Serializing blob " << name << " as raw bytes";
+  // Serialize whole vector. If vector is empty, it's shape still needs to be
+  // serialized in empty proto
+  for (size_t chunkBegin = 0;
+       chunkBegin < std::max(tensor.size(), static_cast<TIndex>(1));
+       chunkBegin += chunk_size) {
+    auto task = [this, &tensor, &name, &acceptor, chunk_size](
+        size_t chunkStart) {
+      BlobProto blob_proto;
+      blob_proto.set_name(name);
+      blob_proto.set_type(kRawTensorBlobType);
+      TensorProto& proto = *blob_proto.mutable_tensor();
+      proto.set_name(name);
+      this->Serialize(tensor, name, &proto, chunkStart, chunk_size);
+      acceptor(
+          MakeString(name, kChunkIdSeparator, chunkStart / chunk_size),
+          blob_proto.SerializeAsString());
+    };
+    if (tensor.size() > chunk_size) {
+      runner.Run([task, chunkBegin]() { task(chunkBegin); });
+    } else {
+      // Sync mode for small tensors
+      task(chunkBegin);
+    }
+  }
+  runner.Wait();
+}
+
+template <class Context>
+void RawTensorSerializer<Context>::Serialize(
+    const Tensor<Context>& input, const string& /*name*/,
+    TensorProto* proto_ptr, size_t chunkBegin, int32_t chunkSize) {
+  CAFFE_ENFORCE(
+      chunkBegin <= input.size(),
+      "Chunk begin is out of tensor: ",
+      chunkBegin,
+      ' ',
+      input.size());
+  if (chunkBegin + chunkSize > input.size()) {
+    chunkSize = input.size() - chunkBegin;
+  }
+  CAFFE_ENFORCE(
+      input.raw_data() || chunkSize == 0,
+      "The input does not have data input yet, so it makes no sense to "
+      "serialize the tensor content.");
+
+  TensorProto& proto = *proto_ptr;
+  proto.mutable_segment()->set_begin(chunkBegin);
+  proto.mutable_segment()->set_end(chunkBegin + chunkSize);
+  for (int i = 0; i < input.ndim(); ++i) {
+    proto.add_dims(input.dim(i));
+  }
+  const TensorProto::DataType data_type = TypeMetaToDataType(input.meta());
+  CAFFE_ENFORCE(
+      detail::IsRawSerializable(data_type),
+      "Cannot serialize ",
+      input.meta().name(),
+      " as raw bytes.");
+  proto.set_data_type(data_type);
+  StoreDeviceDetail(input, &proto);
+
+  const size_t nbytes = chunkSize * input.itemsize();
+  string* dst = proto.mutable_byte_data();
+  dst->resize(nbytes);
+  if (nbytes) {
+    context_.template CopyBytes<Context, CPUContext>(
+        nbytes,
+        static_cast<const char*>(input.raw_data()) +
+            chunkBegin * input.itemsize(),
+        &(*dst)[0]);
+    // Make sure that we finish the copy into the protobuf.
+    context_.FinishDeviceComputation();
+  }
+}
+
+template <>
+inline void RawTensorSerializer<CPUContext>::StoreDeviceDetail(
+    const Tensor<CPUContext>& /*input*/,
+    TensorProto* proto) {
+  proto->mutable_device_detail()->set_device_type(CPU);
+}
+
+template <class Context>
+void RawTensorDeserializer<Context>::Deserialize(
+    const BlobProto& blob_proto,
+    Blob* blob) {
+  Deserialize(blob_proto.tensor(), blob->GetMutable<Tensor<Context>>());
+}
+
+template <class Context>
+void RawTensorDeserializer<Context>::Deserialize(
+    const TensorProto& proto,
+    Tensor<Context>* tensor) {
+  CAFFE_ENFORCE(
+      !detail::IsBigEndianHost(),
+      "Raw little endian tensor data is not supported on this host.");
+  CAFFE_ENFORCE(
+      detail::IsRawSerializable(proto.data_type()),
+      "Not a raw tensor data type: ",
+      proto.data_type());
+  Context context(proto.device_detail());
+  context.SwitchToDevice(0);
+  vector<TIndex> dims;
+  for (const TIndex d : proto.dims()) {
+    dims.push_back(d);
+  }
+  tensor->Resize(dims);
+
+  int64_t chunkBegin = 0;
+  auto chunkEnd = tensor->size();
+  if (proto.has_segment()) {
+    chunkBegin = proto.segment().begin();
+    chunkEnd = proto.segment().end();
+  }
+  CAFFE_ENFORCE(
+      0 <= chunkBegin && chunkBegin <= chunkEnd && chunkEnd <= tensor->size(),
+      "Invalid chunk ",
+      chunkBegin,
+      ' ',
+      chunkEnd,
+      " with total tensor size ",
+      tensor->size());
+
+  const TypeMeta& meta = DataTypeToTypeMeta(proto.data_type());
+  const size_t nbytes = (chunkEnd - chunkBegin) * meta.itemsize();
+  CAFFE_ENFORCE_EQ(
+      nbytes, proto.byte_data().size(), "Incorrect raw tensor data size.");
+  // Also allocates empty tensors, so that they carry their type.
+  char* dst = static_cast<char*>(tensor->raw_mutable_data(meta));
+  if (nbytes) {
+    context.template CopyBytes<CPUContext, Context>(
+        nbytes, proto.byte_data().data(), dst + chunkBegin * meta.itemsize());
+  }
+  context.FinishDeviceComputation();
+}
+
+/**
+ * Serializes a blob with RawTensorSerializer: as raw bytes if it is a
+ * TensorCPU of a fixed-size type, as usual otherwise.
+ */
+inline void SerializeBlobAsRawTensor(
+    const Blob& blob,
+    const string& name,
+    BlobSerializerBase::SerializationAcceptor acceptor,
+    int chunk_size = kDefaultChunkSize) {
+  RawTensorSerializer<CPUContext>().SerializeWithChunkSize(
+      blob, name, acceptor, chunk_size);
+}
+
+/**
+ * Registers the "RawTensor" deserializer, once per process however many
+ * translation units include this header. REGISTER_BLOB_DESERIALIZER cannot be
+ * used in a header, as a second registration of a key exits the process.
+ * Blob::Deserialize, and so LoadOp, then read the raw chunks as well.
+ */
+inline bool RegisterRawTensorDeserializer() {
+  static const bool registered = []() {
+    if (!BlobDeserializerRegistry()->Has(kRawTensorBlobType)) {
+      BlobDeserializerRegistry()->Register(
+          kRawTensorBlobType,
+          RegistererBlobDeserializerRegistry::DefaultCreator<
+              RawTensorDeserializer<CPUContext>>);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_raw_tensor_deserializer_registered =
+    RegisterRawTensorDeserializer();
+} // namespace
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_RAW_TENSOR_SERIALIZATION_H_
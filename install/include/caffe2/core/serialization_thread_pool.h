@@ -0,0 +1,52 @@
+#ifndef CAFFE2_CORE_SERIALIZATION_THREAD_POOL_H_
+#define CAFFE2_CORE_SERIALIZATION_THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread> // NOLINT
+
+#include "caffe2/utils/bounded_task_runner.h"
+#include "caffe2/utils/thread_pool.h"
+
+// Chunks are serialized on a process-wide pool of
+// CAFFE2_SERIALIZATION_THREADS threads (0: one per core). Each blob keeps at
+// most SerializationChunksInFlight() chunks queued, being serialized or
+// waiting for the acceptor at a time (0: two per pool thread).
+#ifndef CAFFE2_SERIALIZATION_THREADS
+#define CAFFE2_SERIALIZATION_THREADS 0
+#endif
+#ifndef CAFFE2_SERIALIZATION_CHUNKS_IN_FLIGHT
+#define CAFFE2_SERIALIZATION_CHUNKS_IN_FLIGHT 0
+#endif
+
+namespace caffe2 {
+
+inline TaskThreadPool* GetSerializationThreadPool() {
+  static TaskThreadPool pool(
+      CAFFE2_SERIALIZATION_THREADS > 0
+          ? CAFFE2_SERIALIZATION_THREADS
+          : std::max(std::thread::hardware_concurrency(), 1u));
+  return &pool;
+}
+
+inline std::atomic<size_t>& SerializationChunksInFlightSetting() {
+  static std::atomic<size_t> chunks(CAFFE2_SERIALIZATION_CHUNKS_IN_FLIGHT);
+  return chunks;
+}
+
+inline size_t SerializationChunksInFlight() {
+  const size_t chunks = SerializationChunksInFlightSetting();
+  return chunks > 0 ? chunks : 2 * GetSerializationThreadPool()->size();
+}
+
+/**
+ * Overrides the number of chunks a single (de)serialization call keeps in
+ * flight, bounding the memory it holds; 0 restores the default.
+ */
+inline void SetSerializationChunksInFlight(size_t chunks) {
+  SerializationChunksInFlightSetting() = chunks;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_SERIALIZATION_THREAD_POOL_H_
@@ -0,0 +1,338 @@
+#ifndef CAFFE2_DB_MMAP_DB_H_
+#define CAFFE2_DB_MMAP_DB_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "caffe2/core/db.h"
+
+namespace caffe2 {
+namespace db {
+
+// A read-only, memory-mapped db whose cursors hand out values in place
+// (zero-copy, see ZeroCopyCursor), so that scanning a dataset is
+// bound by the page cache rather than by copying every record out.
+//
+// The file is written once, in NEW mode, and has the following layout (all
+// integers little endian):
+//
+//   records  key bytes followed by value bytes, each value starting at a
+//            multiple of kMmapDBAlignment
+//   index    one MmapDBIndexEntry per record, sorted by key
+//   footer   MmapDBFooter
+//
+// Including this header registers the db as "mmap" (and "MmapDB"), see
+// RegisterMmapDB() below. Use ConvertToMmapDB() to create files from
+// existing dbs.
+
+constexpr size_t kMmapDBAlignment = 16;
+constexpr uint32_t kMmapDBVersion = 1;
+constexpr char kMmapDBMagic[8] = {'C', '2', 'M', 'M', 'A', 'P', 'D', 'B'};
+
+struct MmapDBIndexEntry {
+  uint64_t key_offset;
+  uint64_t value_offset;
+  uint64_t value_size;
+  uint32_t key_size;
+  uint32_t reserved;
+};
+
+struct MmapDBFooter {
+  uint64_t index_offset;
+  uint64_t num_records;
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+class MmapDBCursor : public Cursor, public ZeroCopyCursor {
+ public:
+  MmapDBCursor(
+      const char* base,
+      const MmapDBIndexEntry* index,
+      size_t num_records)
+      : base_(base), index_(index), num_records_(num_records), pos_(0) {}
+  ~MmapDBCursor() {}
+
+  void Seek(const string& key) override {
+    pos_ = std::lower_bound(
+               index_,
+               index_ + num_records_,
+               key,
+               [this](const MmapDBIndexEntry& entry, const string& k) {
+                 const int c = memcmp(
+                     base_ + entry.key_offset,
+                     k.data(),
+                     std::min<size_t>(entry.key_size, k.size()));
+                 return c < 0 || (c == 0 && entry.key_size < k.size());
+               }) -
+        index_;
+  }
+  bool SupportsSeek() override { return true; }
+  void SeekToFirst() override { pos_ = 0; }
+  void Next() override { ++pos_; }
+  string key() override {
+    return KeyOf(index_[pos_]);
+  }
+  string value() override {
+    return string(value_data(), value_size());
+  }
+  const char* value_data() override {
+    return base_ + index_[pos_].value_offset;
+  }
+  size_t value_size() override {
+    return index_[pos_].value_size;
+  }
+  bool Valid() override { return pos_ < num_records_; }
+
+ private:
+  string KeyOf(const MmapDBIndexEntry& entry) const {
+    return string(base_ + entry.key_offset, entry.key_size);
+  }
+
+  const char* base_;
+  const MmapDBIndexEntry* index_;
+  size_t num_records_;
+  size_t pos_;
+};
+
+class MmapDBTransaction : public Transaction {
+ public:
+  // Index entries are collected in memory together with their keys, and
+  // written out sorted by key when the db is closed.
+  using PendingIndex = std::vector<std::pair<string, MmapDBIndexEntry>>;
+
+  MmapDBTransaction(
+      FILE* file,
+      uint64_t* offset,
+      PendingIndex* index,
+      std::mutex* file_access_mutex)
+      : file_(file),
+        offset_(offset),
+        index_(index),
+        file_access_mutex_(file_access_mutex) {}
+  ~MmapDBTransaction() {
+    Commit();
+  }
+
+  void Put(const string& key, const string& value) override {
+    static const char kPadding[kMmapDBAlignment] = {0};
+    std::lock_guard<std::mutex> guard(*file_access_mutex_);
+    MmapDBIndexEntry entry;
+    entry.key_offset = *offset_;
+    entry.key_size = key.size();
+    Write(key.data(), key.size());
+    const size_t pad = (kMmapDBAlignment - *offset_ % kMmapDBAlignment) %
+        kMmapDBAlignment;
+    Write(kPadding, pad);
+    entry.value_offset = *offset_;
+    entry.value_size = value.size();
+    entry.reserved = 0;
+    Write(value.data(), value.size());
+    index_->emplace_back(key, entry);
+  }
+
+  void Commit() override {
+    std::lock_guard<std::mutex> guard(*file_access_mutex_);
+    CAFFE_ENFORCE_EQ(fflush(file_), 0, "Failed to flush mmapdb file.");
+  }
+
+ private:
+  void Write(const char* data, size_t size) {
+    if (size) {
+      CAFFE_ENFORCE_EQ(
+          fwrite(data, 1, size, file_), size, "Failed to write mmapdb file.");
+      *offset_ += size;
+    }
+  }
+
+  FILE* file_;
+  uint64_t* offset_;
+  PendingIndex* index_;
+  std::mutex* file_access_mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(MmapDBTransaction);
+};
+
+class MmapDB : public DB {
+ public:
+  MmapDB(const string& source, Mode mode) : DB(source, mode), source_(source) {
+    switch (mode) {
+      case NEW:
+        file_ = fopen(source.c_str(), "wb");
+        CAFFE_ENFORCE(file_, "Cannot create mmapdb file ", source);
+        break;
+      case WRITE:
+        CAFFE_THROW(
+            "mmapdb files are written once; open them in NEW mode: ", source);
+      case READ:
+        Map();
+        break;
+    }
+    VLOG(1) << "Opened mmapdb " << source;
+  }
+  ~MmapDB() {
+    Close();
+  }
+
+  void Close() override {
+    if (file_) {
+      WriteIndex();
+      fclose(file_);
+      file_ = nullptr;
+    }
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+      data_ = nullptr;
+    }
+  }
+
+  unique_ptr<Cursor> NewCursor() override {
+    CAFFE_ENFORCE_EQ(mode_, READ, "Cursor not supported in write mode.");
+    return make_unique<MmapDBCursor>(data_, index_, num_records_);
+  }
+
+  unique_ptr<Transaction> NewTransaction() override {
+    CAFFE_ENFORCE(file_, "Transaction not supported in read mode.");
+    return make_unique<MmapDBTransaction>(
+        file_, &offset_, &pending_index_, &file_access_mutex_);
+  }
+
+ private:
+  void Map() {
+    int fd = open(source_.c_str(), O_RDONLY);
+    CAFFE_ENFORCE_GE(fd, 0, "Cannot open mmapdb file ", source_);
+    struct stat st;
+    const bool statted = fstat(fd, &st) == 0;
+    if (!statted || st.st_size < static_cast<off_t>(sizeof(MmapDBFooter))) {
+      close(fd);
+      CAFFE_THROW("Not a valid mmapdb file: ", source_);
+    }
+    size_ = st.st_size;
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    CAFFE_ENFORCE(addr != MAP_FAILED, "Cannot mmap ", source_);
+    data_ = static_cast<const char*>(addr);
+    // Records are mostly scanned front to back.
+    madvise(addr, size_, MADV_SEQUENTIAL);
+
+    MmapDBFooter footer;
+    memcpy(&footer, data_ + size_ - sizeof(footer), sizeof(footer));
+    const uint64_t index_bytes = size_ - sizeof(footer);
+    const bool valid =
+        memcmp(footer.magic, kMmapDBMagic, sizeof(kMmapDBMagic)) == 0 &&
+        footer.version == kMmapDBVersion &&
+        footer.index_offset <= index_bytes &&
+        footer.num_records <= (index_bytes - footer.index_offset) /
+                sizeof(MmapDBIndexEntry) &&
+        footer.index_offset % alignof(MmapDBIndexEntry) == 0;
+    if (!valid) {
+      // The destructor does not run for a throwing constructor.
+      Close();
+      CAFFE_THROW("Not a valid or a corrupted mmapdb file: ", source_);
+    }
+    index_ = reinterpret_cast<const MmapDBIndexEntry*>(
+        data_ + footer.index_offset);
+    num_records_ = footer.num_records;
+  }
+
+  void WriteIndex() {
+    std::lock_guard<std::mutex> guard(file_access_mutex_);
+    std::stable_sort(
+        pending_index_.begin(),
+        pending_index_.end(),
+        [](const MmapDBTransaction::PendingIndex::value_type& a,
+           const MmapDBTransaction::PendingIndex::value_type& b) {
+          return a.first < b.first;
+        });
+    static const char kPadding[kMmapDBAlignment] = {0};
+    const size_t pad =
+        (kMmapDBAlignment - offset_ % kMmapDBAlignment) % kMmapDBAlignment;
+    CAFFE_ENFORCE_EQ(fwrite(kPadding, 1, pad, file_), pad);
+    offset_ += pad;
+    MmapDBFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.index_offset = offset_;
+    footer.num_records = pending_index_.size();
+    memcpy(footer.magic, kMmapDBMagic, sizeof(kMmapDBMagic));
+    footer.version = kMmapDBVersion;
+    for (const auto& entry : pending_index_) {
+      CAFFE_ENFORCE_EQ(
+          fwrite(&entry.second, 1, sizeof(entry.second), file_),
+          sizeof(entry.second));
+    }
+    CAFFE_ENFORCE_EQ(
+        fwrite(&footer, 1, sizeof(footer), file_), sizeof(footer));
+    pending_index_.clear();
+  }
+
+  string source_;
+  // Write mode.
+  FILE* file_{nullptr};
+  uint64_t offset_{0};
+  MmapDBTransaction::PendingIndex pending_index_;
+  std::mutex file_access_mutex_;
+  // Read mode.
+  const char* data_{nullptr};
+  size_t size_{0};
+  const MmapDBIndexEntry* index_{nullptr};
+  size_t num_records_{0};
+};
+
+/**
+ * Registers MmapDB with Caffe2DBRegistry, once per process however many
+ * translation units include this header. REGISTER_CAFFE2_DB cannot be used
+ * in a header, as a second registration of a key exits the process.
+ */
+inline bool RegisterMmapDB() {
+  static const bool registered = []() {
+    for (const char* name : {"MmapDB", "mmap"}) {
+      if (!Caffe2DBRegistry()->Has(name)) {
+        Caffe2DBRegistry()->Register(
+            name,
+            RegistererCaffe2DBRegistry::DefaultCreator<MmapDB>,
+            "Read-only, memory-mapped db with zero-copy cursor values.");
+      }
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_mmap_db_registered = RegisterMmapDB();
+} // namespace
+
+/**
+ * Copies every record of an existing db into a new mmapdb file at dst, e.g.
+ * to turn an lmdb or minidb dataset into one that can be scanned in place.
+ */
+inline void ConvertToMmapDB(
+    const string& src_type,
+    const string& src,
+    const string& dst) {
+  auto in = CreateDB(src_type, src, READ);
+  CAFFE_ENFORCE(in, "Cannot open db: ", src, " of type ", src_type);
+  MmapDB out(dst, NEW);
+  auto cursor = in->NewCursor();
+  auto transaction = out.NewTransaction();
+  for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+    transaction->Put(cursor->key(), cursor->value());
+  }
+  transaction->Commit();
+  transaction.reset();
+  out.Close();
+}
+
+} // namespace db
+} // namespace caffe2
+
+#endif // CAFFE2_DB_MMAP_DB_H_
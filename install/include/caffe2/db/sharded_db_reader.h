@@ -0,0 +1,768 @@
+#ifndef CAFFE2_DB_SHARDED_DB_READER_H_
+#define CAFFE2_DB_SHARDED_DB_READER_H_
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/db.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/scope_guard.h"
+#include "caffe2/core/typeid.h"
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+namespace db {
+
+/**
+ * How ShardedDBReader splits a db into num_shards shards: INDEX gives shard s
+ * the records whose index is s modulo num_shards, KEY_RANGE gives it the s-th
+ * of num_shards contiguous key ranges holding (about) the same number of
+ * records.
+ */
+enum class ShardMode { INDEX, KEY_RANGE };
+
+struct ShardedDBReaderOptions {
+  int32_t num_shards{1};
+  int32_t shard_id{0};
+  ShardMode shard_mode{ShardMode::INDEX};
+  // Visit the records of the shard in a new pseudo-random order every epoch.
+  // The order only depends on seed and the epoch number, so it is the same
+  // across runs and platforms.
+  bool shuffle{false};
+  uint64_t seed{0};
+  // Let concurrent Read()s each position a cursor of their own with Seek(),
+  // so that they only serialize on picking the next record. Only used if the
+  // db supports seeking. Idle cursors are kept for reuse, so the reader holds
+  // at most as many cursors as it ever had concurrent Read()s.
+  bool per_thread_cursors{false};
+};
+
+/**
+ * A DBReader that can shard a db by key range as well as by record index,
+ * shuffle each epoch deterministically and serve concurrent Read()s from
+ * cursors of their own. It is a type of its own, created by the
+ * CreateShardedDB op below, because DBReader is compiled into the prebuilt
+ * libraries, whose layout of it the headers must match.
+ *
+ * With the default options the reader walks a single cursor, skipping the
+ * records of other shards, just like DBReader. Options that ask for key range
+ * sharding, shuffling or per-thread cursors instead scan the db on Open()
+ * (twice for KEY_RANGE), keep the keys of the shard and then hand out the
+ * records of the shard by index, one epoch after the other.
+ *
+ * In that indexed mode, for dbs that support seeking, cursor() stands for
+ * the position of the reader: its key() is the key of the record Read()
+ * returns next. That is the key a serialized reader holds, and
+ * ShardedDBReader(proto, options) resumes from it.
+ */
+class ShardedDBReader {
+ public:
+  friend class ShardedDBReaderSerializer;
+  ShardedDBReader() {}
+
+  ShardedDBReader(
+      const string& db_type,
+      const string& source,
+      const ShardedDBReaderOptions& options) {
+    Open(db_type, source, options);
+  }
+
+  /**
+   * Reopens a saved reader with the options it was opened with, resuming at
+   * the first record of its shard with the saved key. As the epoch is not
+   * saved, a shuffled reader resumes at that record's place in the order of
+   * the first epoch.
+   */
+  ShardedDBReader(
+      const DBReaderProto& proto,
+      const ShardedDBReaderOptions& options) {
+    Open(proto.db_type(), proto.source(), options);
+    if (proto.has_key()) {
+      CAFFE_ENFORCE(cursor_->SupportsSeek(),
+          "Encountering a proto that needs seeking but the db type "
+          "does not support it.");
+      cursor_->Seek(proto.key());
+    }
+  }
+
+  explicit ShardedDBReader(std::unique_ptr<DB> db)
+      : db_type_("<memory-type>"),
+        source_("<memory-source>"),
+        db_(std::move(db)) {
+    CAFFE_ENFORCE(db_.get(), "Passed null db");
+    cursor_ = db_->NewCursor();
+    zero_copy_ = ZeroCopyCursorOf(cursor_.get()) != nullptr;
+  }
+
+  void Open(
+      const string& db_type,
+      const string& source,
+      const ShardedDBReaderOptions& options) {
+    const int32_t num_shards = options.num_shards;
+    const int32_t shard_id = options.shard_id;
+    // Note(jiayq): resetting is needed when we re-open e.g. leveldb where no
+    // concurrent access is allowed.
+    idle_cursors_.clear();
+    keys_.clear();
+    key_ranks_.clear();
+    order_.clear();
+    cursor_.reset();
+    db_.reset();
+    db_type_ = db_type;
+    source_ = source;
+    db_ = CreateDB(db_type_, source_, READ);
+    CAFFE_ENFORCE(db_,
+        "Cannot open db: ", source_, " of type ", db_type_);
+    CAFFE_ENFORCE(num_shards >= 1);
+    CAFFE_ENFORCE(shard_id >= 0);
+    CAFFE_ENFORCE(shard_id < num_shards);
+    num_shards_ = num_shards;
+    shard_id_ = shard_id;
+    options_ = options;
+    unique_ptr<Cursor> cursor = db_->NewCursor();
+    seekable_ = cursor->SupportsSeek();
+    zero_copy_ = ZeroCopyCursorOf(cursor.get()) != nullptr;
+    indexed_ = options.shard_mode == ShardMode::KEY_RANGE || options.shuffle ||
+        (options.per_thread_cursors && seekable_);
+    if (indexed_) {
+      BuildIndex(cursor.get());
+    }
+    if (indexed_ && seekable_) {
+      // The cursor that built the index is the first one Read() uses.
+      idle_cursors_.emplace_back();
+      idle_cursors_.back().cursor = std::move(cursor);
+      cursor_.reset(new IndexedCursor(this));
+    } else {
+      cursor_ = std::move(cursor);
+    }
+    SeekToFirst();
+  }
+
+  /**
+   * Read a set of key and value from the db and move to next. Thread safe.
+   *
+   * The string objects key and value must be created by the caller and
+   * explicitly passed in to this function. This saves one additional object
+   * copy.
+   *
+   * If the cursor reaches its end, the reader will go back to the head of
+   * the db. This function can be used to enable multiple input ops to read
+   * the same db.
+   *
+   * Note(jiayq): we loosen the definition of a const function here a little
+   * bit: the state of the cursor is actually changed. However, this allows
+   * us to pass in a reader to an Operator without the need of a duplicated
+   * output blob.
+   */
+  void Read(string* key, string* value) const {
+    ReadRecord([key, value](Cursor* cursor) {
+      *key = cursor->key();
+      *value = cursor->value();
+    });
+  }
+
+  /**
+   * Zero-copy variant of Read(): instead of copying the value, points *value
+   * at it and sets *size to its length. Thread safe. Only available if
+   * SupportsZeroCopy() is true; the value stays valid while the reader is
+   * open.
+   */
+  void Read(string* key, const char** value, size_t* size) const {
+    CAFFE_ENFORCE(zero_copy_, "This db does not support zero-copy reads.");
+    ReadRecord([key, value, size](Cursor* cursor) {
+      ZeroCopyCursor* zero_copy = ZeroCopyCursorOf(cursor);
+      *key = cursor->key();
+      *value = zero_copy->value_data();
+      *size = zero_copy->value_size();
+    });
+  }
+
+  /**
+   * Returns whether the underlying db supports the zero-copy Read().
+   */
+  bool SupportsZeroCopy() const {
+    return cursor_ != nullptr && zero_copy_;
+  }
+
+  /**
+   * @brief Seeks to the first key, or in indexed mode back to the start of
+   * the first epoch. Thread safe.
+   */
+  void SeekToFirst() const {
+    CAFFE_ENFORCE(cursor_ != nullptr, "Reader not initialized.");
+    std::unique_lock<std::mutex> mutex_lock(reader_mutex_);
+    if (indexed_) {
+      next_read_ = 0;
+      ShuffleForEpoch(0);
+    } else {
+      MoveToBeginning();
+    }
+  }
+
+  /**
+   * Returns the number of records in this reader's shard. Only known in
+   * indexed mode, -1 otherwise.
+   */
+  int64_t shard_size() const {
+    return indexed_ ? shard_size_ : -1;
+  }
+
+  /**
+   * Returns the underlying cursor of the db reader.
+   *
+   * Note that if you directly use the cursor, the read will not be thread
+   * safe, because there is no mechanism to stop multiple threads from
+   * accessing the same cursor. You should consider using Read() explicitly.
+   */
+  inline Cursor* cursor() const {
+    LOG(ERROR) << "Usually for a ShardedDBReader you should use Read() to "
+                  "be thread safe. Consider refactoring your code.";
+    return cursor_.get();
+  }
+
+ private:
+  void MoveToBeginning() const {
+    cursor_->SeekToFirst();
+    for (auto s = 0; s < shard_id_; s++) {
+      cursor_->Next();
+      CAFFE_ENFORCE(
+          cursor_->Valid(), "Db has less rows than shard id: ", s, shard_id_);
+    }
+  }
+
+  // A cursor of an indexed reader, and the shard record it points at.
+  struct RecordCursor {
+    unique_ptr<Cursor> cursor;
+    int64_t record{-1};
+  };
+
+  // cursor_ of an indexed reader over a seekable db. Rather than a place in
+  // the db it stands for the position of the reader: key() and value() are
+  // those of the record Read() returns next, Next() skips that record and
+  // Seek() moves to the first record of the shard with the given key.
+  class IndexedCursor : public Cursor {
+   public:
+    explicit IndexedCursor(const ShardedDBReader* reader) : reader_(reader) {}
+
+    void Seek(const string& key) override {
+      reader_->SeekToKey(key);
+    }
+    bool SupportsSeek() override { return true; }
+    void SeekToFirst() override {
+      reader_->SeekToFirst();
+    }
+    void Next() override {
+      std::lock_guard<std::mutex> lock(reader_->reader_mutex_);
+      reader_->NextRecord();
+    }
+    string key() override {
+      std::lock_guard<std::mutex> lock(reader_->reader_mutex_);
+      return reader_->keys_[reader_->PeekRecord()];
+    }
+    string value() override {
+      string value;
+      reader_->ReadRecord(
+          [&value](Cursor* cursor) { value = cursor->value(); }, false);
+      return value;
+    }
+    bool Valid() override { return true; }
+
+   private:
+    const ShardedDBReader* reader_;
+  };
+
+  // Reads the next record with fn, or with advance false peeks at it.
+  template <typename Fn>
+  void ReadRecord(Fn fn, bool advance = true) const {
+    CAFFE_ENFORCE(cursor_ != nullptr, "Reader not initialized.");
+    std::unique_lock<std::mutex> mutex_lock(reader_mutex_);
+    if (!indexed_) {
+      fn(cursor_.get());
+      // In sharded mode, each read skips num_shards_ records
+      for (int s = 0; s < num_shards_; s++) {
+        cursor_->Next();
+        if (!cursor_->Valid()) {
+          MoveToBeginning();
+          break;
+        }
+      }
+      return;
+    }
+    const int64_t record = advance ? NextRecord() : PeekRecord();
+    if (!seekable_) {
+      MoveToRecord(record);
+      fn(cursor_.get());
+      return;
+    }
+    RecordCursor mine = TakeCursor(record);
+    if (options_.per_thread_cursors) {
+      // Only picking the record and the cursor needs the lock.
+      mutex_lock.unlock();
+    }
+    auto give_back = MakeGuard([this, &mine, &mutex_lock]() {
+      if (!mutex_lock.owns_lock()) {
+        mutex_lock.lock();
+      }
+      idle_cursors_.push_back(std::move(mine));
+    });
+    Position(&mine, record);
+    fn(mine.cursor.get());
+  }
+
+  // Returns the shard record Read() returns next, shuffling for its epoch if
+  // needed. Called with reader_mutex_ held.
+  int64_t PeekRecord() const {
+    const int64_t epoch = next_read_ / shard_size_;
+    const int64_t i = next_read_ % shard_size_;
+    if (epoch != order_epoch_) {
+      ShuffleForEpoch(epoch);
+    }
+    return order_.empty() ? i : order_[i];
+  }
+
+  // Like PeekRecord(), but also moves on to the record after it. Called with
+  // reader_mutex_ held.
+  int64_t NextRecord() const {
+    const int64_t record = PeekRecord();
+    ++next_read_;
+    return record;
+  }
+
+  // Fisher-Yates with an explicitly specified generator and reduction, since
+  // std::shuffle and the std distributions differ between standard libraries.
+  void ShuffleForEpoch(int64_t epoch) const {
+    order_epoch_ = epoch;
+    if (!options_.shuffle) {
+      return;
+    }
+    order_.resize(shard_size_);
+    for (int64_t i = 0; i < shard_size_; ++i) {
+      order_[i] = i;
+    }
+    std::mt19937_64 rng(options_.seed ^ (0x9e3779b97f4a7c15ULL * (epoch + 1)));
+    for (int64_t i = shard_size_ - 1; i > 0; --i) {
+      std::swap(order_[i], order_[rng() % (i + 1)]);
+    }
+  }
+
+  // Moves the reader, within the current epoch, to the first record of the
+  // shard whose key is not less than key. Thread safe.
+  void SeekToKey(const string& key) const {
+    std::lock_guard<std::mutex> lock(reader_mutex_);
+    // Seekable dbs iterate in key order, so keys_ is sorted.
+    const int64_t record =
+        std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+    CAFFE_ENFORCE_LT(
+        record, shard_size_, "Key ", key, " is past the end of the shard.");
+    PeekRecord();
+    const int64_t epoch_start = next_read_ - next_read_ % shard_size_;
+    next_read_ = epoch_start +
+        (order_.empty()
+             ? record
+             : std::find(order_.begin(), order_.end(), record) -
+                 order_.begin());
+  }
+
+  // Takes an idle cursor for reading record, preferring the one that points
+  // at the record before it, or opens a new one. Called with reader_mutex_
+  // held.
+  RecordCursor TakeCursor(int64_t record) const {
+    if (idle_cursors_.empty()) {
+      RecordCursor fresh;
+      fresh.cursor = db_->NewCursor();
+      return fresh;
+    }
+    auto it = std::find_if(
+        idle_cursors_.begin(),
+        idle_cursors_.end(),
+        [record](const RecordCursor& rc) { return rc.record == record - 1; });
+    if (it != idle_cursors_.end()) {
+      std::swap(*it, idle_cursors_.back());
+    }
+    RecordCursor taken = std::move(idle_cursors_.back());
+    idle_cursors_.pop_back();
+    return taken;
+  }
+
+  // Points a cursor at a shard record, stepping forward instead of seeking
+  // when the record directly follows the previous one in the db.
+  void Position(RecordCursor* rc, int64_t record) const {
+    const bool adjacent = options_.shard_mode == ShardMode::KEY_RANGE ||
+        num_shards_ == 1;
+    const int64_t previous = rc->record;
+    rc->record = -1;
+    if (adjacent && previous >= 0 && record == previous + 1) {
+      rc->cursor->Next();
+    } else {
+      rc->cursor->Seek(keys_[record]);
+      // Seek() finds the first of the records with a repeated key.
+      const int32_t rank = key_ranks_.empty() ? 0 : key_ranks_[record];
+      for (int32_t i = 0; i < rank; ++i) {
+        rc->cursor->Next();
+      }
+    }
+    CAFFE_ENFORCE(rc->cursor->Valid(), "Db changed while reading it.");
+    rc->record = record;
+  }
+
+  // Walks cursor_ to a shard record of a db that cannot seek, so it is mostly
+  // meant for sequential reads. Called with reader_mutex_ held.
+  void MoveToRecord(int64_t record) const {
+    int64_t target = DbIndexOf(record);
+    if (cursor_record_ < 0 || target < cursor_record_) {
+      cursor_->SeekToFirst();
+      cursor_record_ = 0;
+    }
+    for (; cursor_record_ < target; ++cursor_record_) {
+      cursor_->Next();
+    }
+    CAFFE_ENFORCE(cursor_->Valid(), "Db changed while reading it.");
+  }
+
+  // Position in the whole db of a record of this shard.
+  int64_t DbIndexOf(int64_t record) const {
+    return options_.shard_mode == ShardMode::KEY_RANGE
+        ? shard_begin_ + record
+        : record * num_shards_ + shard_id_;
+  }
+
+  void SetShardBounds(int64_t total) {
+    if (options_.shard_mode == ShardMode::KEY_RANGE) {
+      shard_begin_ = total * shard_id_ / num_shards_;
+      shard_size_ = total * (shard_id_ + 1) / num_shards_ - shard_begin_;
+    } else {
+      shard_begin_ = shard_id_;
+      shard_size_ = total > shard_id_
+          ? (total - shard_id_ + num_shards_ - 1) / num_shards_
+          : 0;
+    }
+    CAFFE_ENFORCE_GT(
+        shard_size_,
+        0,
+        "Db has less rows than shards: ",
+        total,
+        " rows for shard ",
+        shard_id_,
+        " of ",
+        num_shards_);
+  }
+
+  // Counts the records of the db, and for seekable dbs remembers the keys of
+  // this shard so that records can be addressed by index. INDEX sharding of
+  // a seekable db does both in one pass.
+  void BuildIndex(Cursor* cursor) {
+    const bool key_range = options_.shard_mode == ShardMode::KEY_RANGE;
+    if (key_range || !seekable_) {
+      int64_t total = 0;
+      for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next()) {
+        ++total;
+      }
+      SetShardBounds(total);
+    }
+    if (!seekable_) {
+      CAFFE_ENFORCE(
+          !options_.shuffle,
+          "Shuffling needs a db that supports seeking: ",
+          db_type_);
+      cursor_record_ = -1;
+      return;
+    }
+    vector<int32_t> ranks;
+    bool repeated = false;
+    string previous;
+    int32_t rank = 0;
+    int64_t index = 0;
+    for (cursor->SeekToFirst(); cursor->Valid(); cursor->Next(), ++index) {
+      string key = cursor->key();
+      rank = index > 0 && key == previous ? rank + 1 : 0;
+      const bool mine = key_range
+          ? index >= shard_begin_ && index < shard_begin_ + shard_size_
+          : index % num_shards_ == shard_id_;
+      if (mine) {
+        keys_.push_back(key);
+        ranks.push_back(rank);
+        repeated = repeated || rank > 0;
+      }
+      previous = std::move(key);
+    }
+    if (!key_range) {
+      SetShardBounds(index);
+    }
+    CAFFE_ENFORCE_EQ(
+        static_cast<int64_t>(keys_.size()),
+        shard_size_,
+        "Db changed while indexing it.");
+    if (repeated) {
+      key_ranks_ = std::move(ranks);
+    }
+  }
+
+  string db_type_;
+  string source_;
+  unique_ptr<DB> db_;
+  unique_ptr<Cursor> cursor_;
+  mutable std::mutex reader_mutex_;
+  uint32_t num_shards_;
+  uint32_t shard_id_;
+
+  // Indexed mode, see ShardedDBReaderOptions. All mutable state below is
+  // protected by reader_mutex_, except for a cursor taken out of
+  // idle_cursors_, which only the Read() that took it uses.
+  ShardedDBReaderOptions options_;
+  bool indexed_{false};
+  bool seekable_{false};
+  bool zero_copy_{false};
+  int64_t shard_begin_{0};
+  int64_t shard_size_{0};
+  vector<string> keys_;
+  // For each entry of keys_, the number of records right before it with the
+  // same key. Empty if no key repeats.
+  vector<int32_t> key_ranks_;
+  mutable int64_t next_read_{0};
+  mutable int64_t order_epoch_{-1};
+  mutable vector<int64_t> order_;
+  mutable int64_t cursor_record_{-1};
+  mutable vector<RecordCursor> idle_cursors_;
+
+  DISABLE_COPY_AND_ASSIGN(ShardedDBReader);
+};
+
+/**
+ * Serializes a ShardedDBReader as the CreateShardedDB op that reopens it,
+ * with the key of the record it reads next as an extra "key" argument, so
+ * that a loaded reader resumes with the same db, shard and options.
+ */
+class ShardedDBReaderSerializer : public BlobSerializerBase {
+ public:
+  void Serialize(
+      const Blob& blob,
+      const string& name,
+      BlobSerializerBase::SerializationAcceptor acceptor) override;
+};
+
+class ShardedDBReaderDeserializer : public BlobDeserializerBase {
+ public:
+  void Deserialize(const BlobProto& proto, Blob* blob) override;
+};
+
+// Reads the reader options from the arguments of a CreateShardedDB op, given
+// as its OperatorBase or as an ArgumentHelper.
+template <class Arguments>
+inline ShardedDBReaderOptions ShardedDBReaderOptionsFromArguments(
+    const Arguments& args) {
+  ShardedDBReaderOptions options;
+  options.num_shards = args.template GetSingleArgument<int>("num_shards", 1);
+  options.shard_id = args.template GetSingleArgument<int>("shard_id", 0);
+  const string mode =
+      args.template GetSingleArgument<string>("shard_mode", "index");
+  CAFFE_ENFORCE(
+      mode == "index" || mode == "key_range",
+      "shard_mode must be \"index\" or \"key_range\", got ",
+      mode);
+  options.shard_mode =
+      mode == "key_range" ? ShardMode::KEY_RANGE : ShardMode::INDEX;
+  options.shuffle = args.template GetSingleArgument<int>("shuffle", 0);
+  options.seed = args.template GetSingleArgument<int64_t>("seed", 0);
+  options.per_thread_cursors =
+      args.template GetSingleArgument<int>("per_thread_cursors", 0);
+  return options;
+}
+
+/**
+ * Reads the next record of the reader held by blob, a DBReader or a
+ * ShardedDBReader, for the input ops that take either. Values of a
+ * ShardedDBReader over a zero-copy db are not copied: *data and *size then
+ * point into the db, which keeps them valid while it is open, and *value is
+ * left alone. Otherwise *value receives the value and *data and *size point
+ * at it.
+ */
+inline void ReadDBRecord(
+    const Blob& blob,
+    string* key,
+    string* value,
+    const char** data,
+    size_t* size) {
+  if (blob.IsType<ShardedDBReader>()) {
+    const auto& reader = blob.Get<ShardedDBReader>();
+    if (reader.SupportsZeroCopy()) {
+      reader.Read(key, data, size);
+      return;
+    }
+    reader.Read(key, value);
+  } else {
+    blob.Get<DBReader>().Read(key, value);
+  }
+  *data = value->data();
+  *size = value->size();
+}
+
+} // namespace db
+
+// CAFFE_KNOWN_TYPE defines TypeMeta::Id<T>() out of line, so it cannot be
+// used in a header, see lazy_blob.h.
+template <>
+inline CaffeTypeId TypeMeta::Id<db::ShardedDBReader>() {
+  static bool type_id_bit[1];
+  static TypeNameRegisterer<db::ShardedDBReader> registerer(
+      reinterpret_cast<CaffeTypeId>(type_id_bit));
+  return reinterpret_cast<CaffeTypeId>(type_id_bit);
+}
+
+/**
+ * Opens a ShardedDBReader, the way CreateDB opens a DBReader, with the
+ * sharding, shuffling and cursor options of ShardedDBReaderOptions as
+ * arguments.
+ */
+template <class Context>
+class CreateShardedDBOp final : public Operator<Context> {
+ public:
+  CreateShardedDBOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        db_type_(OperatorBase::template GetSingleArgument<string>(
+            "db_type",
+            "leveldb")),
+        db_name_(OperatorBase::template GetSingleArgument<string>("db", "")),
+        options_(db::ShardedDBReaderOptionsFromArguments(
+            static_cast<const OperatorBase&>(*this))) {
+    CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
+  }
+
+  bool RunOnDevice() final {
+    OperatorBase::Output<db::ShardedDBReader>(0)->Open(
+        db_type_, db_name_, options_);
+    return true;
+  }
+
+ private:
+  string db_type_;
+  string db_name_;
+  db::ShardedDBReaderOptions options_;
+  DISABLE_COPY_AND_ASSIGN(CreateShardedDBOp);
+};
+
+namespace db {
+
+inline void ShardedDBReaderSerializer::Serialize(
+    const Blob& blob,
+    const string& name,
+    BlobSerializerBase::SerializationAcceptor acceptor) {
+  CAFFE_ENFORCE(blob.IsType<ShardedDBReader>());
+  const auto& reader = blob.Get<ShardedDBReader>();
+  const auto& options = reader.options_;
+  OperatorDef def;
+  def.set_type("CreateShardedDB");
+  def.add_output(name);
+  AddArgument<string>("db_type", reader.db_type_, &def);
+  AddArgument<string>("db", reader.source_, &def);
+  AddArgument<int>("num_shards", options.num_shards, &def);
+  AddArgument<int>("shard_id", options.shard_id, &def);
+  AddArgument<string>(
+      "shard_mode",
+      options.shard_mode == ShardMode::KEY_RANGE ? "key_range" : "index",
+      &def);
+  AddArgument<int>("shuffle", options.shuffle, &def);
+  AddArgument<int64_t>("seed", options.seed, &def);
+  AddArgument<int>("per_thread_cursors", options.per_thread_cursors, &def);
+  if (reader.cursor_ && reader.cursor_->SupportsSeek()) {
+    AddArgument<string>("key", reader.cursor_->key(), &def);
+  }
+  BlobProto blob_proto;
+  blob_proto.set_name(name);
+  blob_proto.set_type("ShardedDBReader");
+  blob_proto.set_content(def.SerializeAsString());
+  acceptor(name, blob_proto.SerializeAsString());
+}
+
+inline void ShardedDBReaderDeserializer::Deserialize(
+    const BlobProto& proto,
+    Blob* blob) {
+  OperatorDef def;
+  CAFFE_ENFORCE(
+      def.ParseFromString(proto.content()),
+      "Cannot parse the content of ShardedDBReader ",
+      proto.name());
+  ArgumentHelper args(def);
+  DBReaderProto reader_proto;
+  reader_proto.set_name(proto.name());
+  reader_proto.set_db_type(args.GetSingleArgument<string>("db_type", ""));
+  reader_proto.set_source(args.GetSingleArgument<string>("db", ""));
+  if (args.HasArgument("key")) {
+    reader_proto.set_key(args.GetSingleArgument<string>("key", ""));
+  }
+  blob->Reset(new ShardedDBReader(
+      reader_proto, ShardedDBReaderOptionsFromArguments(args)));
+}
+
+} // namespace db
+
+/**
+ * Registers CreateShardedDB and the ShardedDBReader serializers, once per
+ * process however many translation units include this header. The
+ * REGISTER_ and OPERATOR_SCHEMA macros cannot be used in a header, as a
+ * second registration of a key exits the process.
+ */
+inline bool RegisterShardedDBReader() {
+  static const bool registered = []() {
+    const CaffeTypeId id = TypeMeta::Id<db::ShardedDBReader>();
+    if (!BlobSerializerRegistry()->Has(id)) {
+      BlobSerializerRegistry()->Register(
+          id, RegistererBlobSerializerRegistry::DefaultCreator<
+                  db::ShardedDBReaderSerializer>);
+    }
+    if (!BlobDeserializerRegistry()->Has("ShardedDBReader")) {
+      BlobDeserializerRegistry()->Register(
+          "ShardedDBReader",
+          RegistererBlobDeserializerRegistry::DefaultCreator<
+              db::ShardedDBReaderDeserializer>);
+    }
+    if (!CPUOperatorRegistry()->Has("CreateShardedDB")) {
+      CPUOperatorRegistry()->Register(
+          "CreateShardedDB",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CreateShardedDBOp<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("CreateShardedDB")) {
+      OpSchemaRegistry::NewSchema("CreateShardedDB", __FILE__, __LINE__)
+          .NumInputs(0)
+          .NumOutputs(1)
+          .SetDoc(R"DOC(
+Opens a sharded db reader, like CreateDB, that can also shard by key range,
+shuffle every epoch and read from several threads with cursors of their own.
+The reader can be fed to PipelinedTensorProtosDBInput and PipelinedImageInput
+instead of the output of CreateDB.
+)DOC")
+          .Arg("db_type", "Type of the db, \"leveldb\" by default.")
+          .Arg("db", "Path or name of the db.")
+          .Arg("num_shards", "Number of shards to split the db into.")
+          .Arg("shard_id", "Shard this reader reads, in [0, num_shards).")
+          .Arg(
+              "shard_mode",
+              "\"index\" (default) gives shard s every num_shards-th "
+              "record starting at s, \"key_range\" the s-th of num_shards "
+              "contiguous key ranges.")
+          .Arg(
+              "shuffle",
+              "If nonzero, visit the shard in a new pseudo-random order "
+              "every epoch. Needs a db that supports seeking.")
+          .Arg("seed", "Seed of the shuffled order.")
+          .Arg(
+              "per_thread_cursors",
+              "If nonzero and the db supports seeking, concurrent reads use "
+              "cursors of their own.")
+          .Output(0, "reader", "The ShardedDBReader.");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_sharded_db_reader_registered = RegisterShardedDBReader();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_DB_SHARDED_DB_READER_H_
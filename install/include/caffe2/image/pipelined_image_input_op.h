@@ -0,0 +1,750 @@
+#ifndef CAFFE2_IMAGE_PIPELINED_IMAGE_INPUT_OP_H_
+#define CAFFE2_IMAGE_PIPELINED_IMAGE_INPUT_OP_H_
+
+#include <opencv2/opencv.hpp>
+
+#include <iostream>
+#include <thread>
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe2/core/db.h"
+#include "caffe2/db/mmap_db.h"
+#include "caffe2/db/sharded_db_reader.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/bounded_queue.h"
+#include "caffe2/operators/pipelined_prefetch_op.h"
+#include "caffe2/image/image_input_op.h"
+#include "caffe2/image/transform_gpu.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+namespace caffe2 {
+
+// PipelinedImageInputOp is the ImageInput op, with the same arguments, that
+// assembles each batch through a pipeline of stages connected by bounded
+// queues:
+//
+//   read (prefetch_threads) -> decode (decode_threads)
+//     -> augment: scale, crop, mirror (augment_threads)
+//     -> pack: normalize into the batch tensor (pack_threads)
+//
+// Stage threads live as long as the operator and are shared by all batches in
+// flight, so a slow image only holds up its own batch. Up to prefetch_depth
+// batches are in flight, see PipelinedPrefetchOperator.
+//
+// It is an op of its own, registered as PipelinedImageInput, because
+// ImageInputOp is compiled into the prebuilt libraries. Besides a DBReader it
+// takes a ShardedDBReader as input, and decodes the values of a zero-copy db
+// in place.
+template <class Context>
+class PipelinedImageInputOp final
+    : public PipelinedPrefetchOperator<Context> {
+ public:
+  using OperatorBase::OutputSize;
+  using PipelinedPrefetchOperator<Context>::context_;
+  using PipelinedPrefetchOperator<Context>::prefetch_threads_;
+  explicit PipelinedImageInputOp(
+      const OperatorDef& operator_def,
+      Workspace* ws);
+  ~PipelinedImageInputOp() {
+    PipelinedPrefetchOperator<Context>::Finalize();
+    StopStages();
+  }
+
+  bool PrefetchSlot(int slot) override;
+  bool CopyPrefetchedSlot(int slot) override;
+
+ private:
+  // Completion state of one batch being assembled into a prefetch slot.
+  struct BatchState {
+    int slot;
+    int pending;
+    bool failed{false};
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  // One image on its way through the stages.
+  struct Item {
+    BatchState* batch;
+    int item_id;
+    // The db value, either owned by value or, for dbs supporting zero-copy
+    // reads, pointing into the db itself.
+    string value;
+    const char* data;
+    size_t size;
+    cv::Mat img;
+    vector<uint8_t> cropped;
+  };
+  using ItemQueue = BoundedQueue<unique_ptr<Item>>;
+
+  bool GetImageAndLabelFromDBValue(
+      const char* data,
+      size_t size,
+      cv::Mat* img,
+      TensorCPU* label,
+      int item_id);
+  void ScaleImage(const cv::Mat& img, cv::Mat* scaled_img);
+  void DecodeWorker();
+  void AugmentWorker(unsigned int seed);
+  void PackWorker();
+  void FinishItem(unique_ptr<Item> item, bool success);
+  void StopStages();
+
+  unique_ptr<db::DBReader> owned_reader_;
+  const db::DBReader* reader_;
+  CPUContext cpu_context_;
+  // One batch buffer per prefetch slot.
+  vector<TensorCPU> prefetched_image_;
+  vector<TensorCPU> prefetched_label_;
+  vector<Tensor<Context>> prefetched_image_on_device_;
+  vector<Tensor<Context>> prefetched_label_on_device_;
+  int batch_size_;
+  float mean_;
+  float std_;
+  bool color_;
+  int scale_;
+  bool warp_;
+  int crop_;
+  bool mirror_;
+  bool is_test_;
+  bool use_caffe_datum_;
+  bool gpu_transform_;
+  StorageOrder order_;
+
+  // Per-stage thread counts. Reading happens on the prefetch threads.
+  int num_decode_threads_;
+  int num_augment_threads_;
+  int num_pack_threads_;
+  ItemQueue decode_queue_;
+  ItemQueue augment_queue_;
+  ItemQueue pack_queue_;
+  vector<std::thread> decode_threads_;
+  vector<std::thread> augment_threads_;
+  vector<std::thread> pack_threads_;
+};
+
+
+template <class Context>
+PipelinedImageInputOp<Context>::PipelinedImageInputOp(
+      const OperatorDef& operator_def, Workspace* ws)
+      : PipelinedPrefetchOperator<Context>(operator_def, ws),
+        reader_(nullptr),
+        prefetched_image_(this->prefetch_depth()),
+        prefetched_label_(this->prefetch_depth()),
+        prefetched_image_on_device_(this->prefetch_depth()),
+        prefetched_label_on_device_(this->prefetch_depth()),
+        batch_size_(
+            OperatorBase::template GetSingleArgument<int>("batch_size", 0)),
+        mean_(OperatorBase::template GetSingleArgument<float>("mean", 0.)),
+        std_(OperatorBase::template GetSingleArgument<float>("std", 1.)),
+        color_(OperatorBase::template GetSingleArgument<int>("color", 1)),
+        scale_(OperatorBase::template GetSingleArgument<int>("scale", -1)),
+        warp_(OperatorBase::template GetSingleArgument<int>("warp", 0)),
+        crop_(OperatorBase::template GetSingleArgument<int>("crop", -1)),
+        mirror_(OperatorBase::template GetSingleArgument<int>("mirror", 0)),
+        is_test_(OperatorBase::template GetSingleArgument<int>("is_test", 0)),
+        use_caffe_datum_(OperatorBase::template GetSingleArgument<int>(
+              "use_caffe_datum", 0)),
+        gpu_transform_(OperatorBase::template GetSingleArgument<int>(
+              "use_gpu_transform", 0)),
+        order_(StringToStorageOrder(
+            OperatorBase::template GetSingleArgument<string>(
+                "order", "NHWC"))),
+        num_decode_threads_(OperatorBase::template GetSingleArgument<int>(
+              "decode_threads", 4)),
+        num_augment_threads_(OperatorBase::template GetSingleArgument<int>(
+              "augment_threads", 2)),
+        num_pack_threads_(OperatorBase::template GetSingleArgument<int>(
+              "pack_threads", 1)),
+        // Bound each stage to one batch worth of images so that memory stays
+        // flat however far ahead the readers get.
+        decode_queue_(std::max(batch_size_, 1)),
+        augment_queue_(std::max(batch_size_, 1)),
+        pack_queue_(std::max(batch_size_, 1))
+{
+  if (operator_def.input_size() == 0) {
+    LOG(ERROR) << "You are using an old ImageInputOp format that creates "
+                       "a local db reader. Consider moving to the new style "
+                       "that takes in a DBReader blob instead.";
+    string db_name =
+        OperatorBase::template GetSingleArgument<string>("db", "");
+    CAFFE_ENFORCE_GT(db_name.size(), 0, "Must specify a db name.");
+    owned_reader_.reset(new db::DBReader(
+        OperatorBase::template GetSingleArgument<string>(
+            "db_type", "leveldb"),
+        db_name));
+    reader_ = owned_reader_.get();
+  }
+  CAFFE_ENFORCE_GT(batch_size_, 0, "Batch size should be nonnegative.");
+  CAFFE_ENFORCE_GT(scale_, 0, "Must provide the scaling factor.");
+  CAFFE_ENFORCE_GT(crop_, 0, "Must provide the cropping value.");
+  CAFFE_ENFORCE_GE(
+      scale_, crop_, "The scale value must be no smaller than the crop value.");
+  CAFFE_ENFORCE_GT(num_decode_threads_, 0);
+  CAFFE_ENFORCE_GT(num_augment_threads_, 0);
+  CAFFE_ENFORCE_GT(num_pack_threads_, 0);
+  CAFFE_ENFORCE(
+      order_ == StorageOrder::NHWC || order_ == StorageOrder::NCHW,
+      "Unsupported order.");
+  CAFFE_ENFORCE(
+      !gpu_transform_ || order_ == StorageOrder::NHWC,
+      "use_gpu_transform only supports NHWC output.");
+
+  LOG(INFO) << "Creating an image input op with the following setting: ";
+  LOG(INFO) << "    Using " << this->num_prefetch_threads_ << " read, "
+            << num_decode_threads_ << " decode, " << num_augment_threads_
+            << " augment and " << num_pack_threads_ << " pack CPU threads;";
+  if (gpu_transform_) {
+    LOG(INFO) << "    Performing transformation on GPU";
+  }
+  LOG(INFO) << "    Outputting in batches of " << batch_size_ << " images;";
+  LOG(INFO) << "    Prefetching up to " << this->prefetch_depth()
+            << " batches ahead;";
+  LOG(INFO) << "    Treating input image as "
+            << (color_ ? "color " : "grayscale ") << "image;";
+  LOG(INFO) << "    Scaling image to " << scale_
+            << (warp_ ? " with " : " without ") << "warping;";
+  LOG(INFO) << "    " << (is_test_ ? "Central" : "Random") << " cropping image to " << crop_
+            << (mirror_ ? " with " : " without ") << "random mirroring;";
+  LOG(INFO) << "    Subtract mean " << mean_ << " and divide by std " << std_
+            << ";";
+  LOG(INFO) << "    Outputting images in "
+            << (order_ == StorageOrder::NCHW ? "NCHW" : "NHWC") << " order.";
+  for (int slot = 0; slot < this->prefetch_depth(); ++slot) {
+    if (order_ == StorageOrder::NCHW) {
+      prefetched_image_[slot].Resize(
+          TIndex(batch_size_),
+          TIndex(color_ ? 3 : 1),
+          TIndex(crop_),
+          TIndex(crop_));
+    } else {
+      prefetched_image_[slot].Resize(
+          TIndex(batch_size_),
+          TIndex(crop_),
+          TIndex(crop_),
+          TIndex(color_ ? 3 : 1));
+    }
+    prefetched_label_[slot].Resize(vector<TIndex>(1, batch_size_));
+  }
+
+  // Start the stages last, once every member they touch is set up.
+  std::mt19937 meta_randgen(time(nullptr));
+  for (int i = 0; i < num_decode_threads_; ++i) {
+    decode_threads_.emplace_back([this] { this->DecodeWorker(); });
+  }
+  for (int i = 0; i < num_augment_threads_; ++i) {
+    const unsigned int seed = meta_randgen();
+    augment_threads_.emplace_back(
+        [this, seed] { this->AugmentWorker(seed); });
+  }
+  for (int i = 0; i < num_pack_threads_; ++i) {
+    pack_threads_.emplace_back([this] { this->PackWorker(); });
+  }
+}
+
+template <class Context>
+void PipelinedImageInputOp<Context>::StopStages() {
+  // Drain the stages front to back: each stage only stops once the stage
+  // feeding it has exited and its queue is empty.
+  decode_queue_.NoMoreJobs();
+  for (auto& thread : decode_threads_) {
+    thread.join();
+  }
+  augment_queue_.NoMoreJobs();
+  for (auto& thread : augment_threads_) {
+    thread.join();
+  }
+  pack_queue_.NoMoreJobs();
+  for (auto& thread : pack_threads_) {
+    thread.join();
+  }
+}
+
+template <class Context>
+bool PipelinedImageInputOp<Context>::GetImageAndLabelFromDBValue(
+    const char* data,
+    size_t size,
+    cv::Mat* img,
+    TensorCPU* label,
+    int item_id) {
+  //
+  // recommend using --caffe2_use_fatal_for_enforce=1 when using ImageInputOp
+  // as this function runs on a worker thread and the exceptions from
+  // CAFFE_ENFORCE are silently dropped by the thread worker functions
+  //
+  cv::Mat src;
+  if (use_caffe_datum_) {
+    // The input is a caffe datum format.
+    caffe::Datum datum;
+    CAFFE_ENFORCE(datum.ParseFromArray(data, size));
+
+    label->mutable_data<int>()[item_id] = datum.label();
+    if (datum.encoded()) {
+      // encoded image in datum.
+      src = cv::imdecode(
+          cv::Mat(
+              1,
+              datum.data().size(),
+              CV_8UC1,
+              const_cast<char*>(datum.data().data())),
+          color_ ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+    } else {
+      // Raw image in datum.
+      CAFFE_ENFORCE(datum.channels() == 3 || datum.channels() == 1);
+
+      int src_c = datum.channels();
+      src.create(
+          datum.height(), datum.width(), (src_c == 3) ? CV_8UC3 : CV_8UC1);
+
+      if (src_c == 1) {
+        memcpy(src.ptr<uchar>(0), datum.data().data(), datum.data().size());
+      } else {
+        // Datum stores things in CHW order, let's do HWC for images to make
+        // things more consistent with conventional image storage.
+        for (int c = 0; c < 3; ++c) {
+          const char* datum_buffer =
+              datum.data().data() + datum.height() * datum.width() * c;
+          uchar* ptr = src.ptr<uchar>(0) + c;
+          for (int h = 0; h < datum.height(); ++h) {
+            for (int w = 0; w < datum.width(); ++w) {
+              *ptr = *(datum_buffer++);
+              ptr += 3;
+            }
+          }
+        }
+      }
+    }
+  } else {
+    // The input is a caffe2 format.
+    TensorProtos protos;
+    CAFFE_ENFORCE(protos.ParseFromArray(data, size));
+    const TensorProto& image_proto = protos.protos(0);
+    const TensorProto& label_proto = protos.protos(1);
+
+    if (image_proto.data_type() == TensorProto::STRING) {
+      // encoded image string.
+      DCHECK_EQ(image_proto.string_data_size(), 1);
+      const string& encoded_image_str = image_proto.string_data(0);
+      int encoded_size = encoded_image_str.size();
+      // We use a cv::Mat to wrap the encoded str so we do not need a copy.
+      src = cv::imdecode(
+          cv::Mat(
+              1,
+              &encoded_size,
+              CV_8UC1,
+              const_cast<char*>(encoded_image_str.data())),
+          color_ ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+    } else if (image_proto.data_type() == TensorProto::BYTE) {
+      // raw image content.
+      int src_c = (image_proto.dims_size() == 3) ? image_proto.dims(2) : 1;
+      CAFFE_ENFORCE(src_c == 3 || src_c == 1);
+
+      src.create(
+          image_proto.dims(0),
+          image_proto.dims(1),
+          (src_c == 3) ? CV_8UC3 : CV_8UC1);
+      memcpy(
+          src.ptr<uchar>(0),
+          image_proto.byte_data().data(),
+          image_proto.byte_data().size());
+    } else {
+      LOG(FATAL) << "Unknown image data type.";
+    }
+
+    if (label_proto.data_type() == TensorProto::FLOAT) {
+      DCHECK_EQ(label_proto.float_data_size(), 1);
+
+      label->mutable_data<float>()[item_id] = label_proto.float_data(0);
+    } else if (label_proto.data_type() == TensorProto::INT32) {
+      DCHECK_EQ(label_proto.int32_data_size(), 1);
+
+      label->mutable_data<int>()[item_id] = label_proto.int32_data(0);
+    } else {
+      LOG(FATAL) << "Unsupported label type.";
+    }
+  }
+
+  //
+  // convert source to the color format requested from Op
+  //
+  int out_c = color_ ? 3 : 1;
+  if (out_c == src.channels()) {
+    *img = src;
+  } else {
+    cv::cvtColor(src, *img, (out_c == 1) ? CV_BGR2GRAY : CV_GRAY2BGR);
+  }
+
+  // Note(Yangqing): I believe that the mat should be created continuous.
+  CAFFE_ENFORCE(img->isContinuous());
+
+  // TODO(Yangqing): return false if any error happens.
+  return true;
+}
+
+#ifdef __ARM_NEON__
+// Converts 16 uint8 values to float, subtracts mean and multiplies by std_inv.
+inline void NormalizeU8x16(
+    uint8x16_t v,
+    float32x4_t mean,
+    float32x4_t std_inv,
+    float* dst) {
+  uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+  uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+  float32x4_t f0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo)));
+  float32x4_t f1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo)));
+  float32x4_t f2 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi)));
+  float32x4_t f3 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi)));
+  vst1q_f32(dst + 0, vmulq_f32(vsubq_f32(f0, mean), std_inv));
+  vst1q_f32(dst + 4, vmulq_f32(vsubq_f32(f1, mean), std_inv));
+  vst1q_f32(dst + 8, vmulq_f32(vsubq_f32(f2, mean), std_inv));
+  vst1q_f32(dst + 12, vmulq_f32(vsubq_f32(f3, mean), std_inv));
+}
+#endif
+
+// Converts a cropped HWC uint8 image of `size` = H * W pixels to float,
+// subtracting mean and dividing by std, and writes it in HWC order (for NHWC
+// batches) or CHW order (for NCHW batches).
+inline void NormalizeImage(
+    const uint8_t* src,
+    const int size,
+    const int channels,
+    const float mean,
+    const float std,
+    const StorageOrder order,
+    float* dst) {
+  const float std_inv = 1.f / std;
+  int i = 0;
+  if (order == StorageOrder::NHWC || channels == 1) {
+    // Same layout on both sides, just a contiguous conversion.
+    const int count = size * channels;
+#ifdef __ARM_NEON__
+    const float32x4_t meanV = vdupq_n_f32(mean);
+    const float32x4_t stdInvV = vdupq_n_f32(std_inv);
+    for (; i + 16 <= count; i += 16) {
+      NormalizeU8x16(vld1q_u8(src + i), meanV, stdInvV, dst + i);
+    }
+#endif
+    for (; i < count; ++i) {
+      dst[i] = (static_cast<float>(src[i]) - mean) * std_inv;
+    }
+    return;
+  }
+
+  CAFFE_ENFORCE_EQ(channels, 3);
+#ifdef __ARM_NEON__
+  // De-interleave 16 pixels at a time into the three planes.
+  const float32x4_t meanV = vdupq_n_f32(mean);
+  const float32x4_t stdInvV = vdupq_n_f32(std_inv);
+  for (; i + 16 <= size; i += 16) {
+    uint8x16x3_t v = vld3q_u8(src + 3 * i);
+    NormalizeU8x16(v.val[0], meanV, stdInvV, dst + i);
+    NormalizeU8x16(v.val[1], meanV, stdInvV, dst + size + i);
+    NormalizeU8x16(v.val[2], meanV, stdInvV, dst + 2 * size + i);
+  }
+#endif
+  for (; i < size; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      dst[c * size + i] =
+          (static_cast<float>(src[3 * i + c]) - mean) * std_inv;
+    }
+  }
+}
+
+template <class Context>
+void PipelinedImageInputOp<Context>::ScaleImage(
+    const cv::Mat& img,
+    cv::Mat* scaled_img) {
+  int scaled_width, scaled_height;
+  if (warp_) {
+    scaled_width = scale_;
+    scaled_height = scale_;
+  } else if (img.rows > img.cols) {
+    scaled_width = scale_;
+    scaled_height = static_cast<float>(img.rows) * scale_ / img.cols;
+  } else {
+    scaled_height = scale_;
+    scaled_width = static_cast<float>(img.cols) * scale_ / img.rows;
+  }
+  if (scaled_height != img.rows || scaled_width != img.cols) {
+    cv::resize(img, *scaled_img, cv::Size(scaled_width, scaled_height),
+               0, 0, cv::INTER_AREA);
+  } else {
+    // No scaling needs to be done.
+    *scaled_img = img;
+  }
+}
+
+template <class Context>
+void PipelinedImageInputOp<Context>::FinishItem(
+    unique_ptr<Item> item,
+    bool success) {
+  BatchState* batch = item->batch;
+  item.reset();
+  // Notify while holding the lock: the batch lives on the waiting reader's
+  // stack and may be gone as soon as the lock is released.
+  std::lock_guard<std::mutex> lock(batch->mutex);
+  batch->failed |= !success;
+  if (--batch->pending == 0) {
+    batch->done.notify_all();
+  }
+}
+
+// Decode stage: parse the db value, decode the image and fill in its label.
+template <class Context>
+void PipelinedImageInputOp<Context>::DecodeWorker() {
+  unique_ptr<Item> item;
+  while (decode_queue_.Pop(&item)) {
+    bool success = false;
+    //
+    // exceptions from CAFFE_ENFORCE in here fail the batch instead of being
+    // silently dropped by the worker thread
+    //
+    try {
+      success = GetImageAndLabelFromDBValue(
+          item->data,
+          item->size,
+          &item->img,
+          &prefetched_label_[item->batch->slot],
+          item->item_id);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Error decoding image: " << e.what();
+    }
+    string().swap(item->value);
+    if (success) {
+      augment_queue_.Push(std::move(item));
+    } else {
+      FinishItem(std::move(item), false);
+    }
+  }
+}
+
+// Augment stage: scale, then crop and optionally mirror into a uint8 HWC
+// buffer of crop x crop pixels.
+template <class Context>
+void PipelinedImageInputOp<Context>::AugmentWorker(unsigned int seed) {
+  std::mt19937 randgen(seed);
+  std::bernoulli_distribution mirror_this_image(0.5);
+  const int channels = color_ ? 3 : 1;
+  unique_ptr<Item> item;
+  while (augment_queue_.Pop(&item)) {
+    try {
+      cv::Mat scaled_img;
+      ScaleImage(item->img, &scaled_img);
+      item->img = cv::Mat();
+      item->cropped.resize(crop_ * crop_ * channels);
+      CropTransposeImage<Context>(scaled_img, channels, item->cropped.data(),
+                                  crop_, mirror_, &randgen,
+                                  &mirror_this_image, is_test_);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Error transforming image: " << e.what();
+      FinishItem(std::move(item), false);
+      continue;
+    }
+    pack_queue_.Push(std::move(item));
+  }
+}
+
+// Pack stage: write the cropped image into its place in the batch, normalized
+// to float unless the transform is left to the GPU.
+template <class Context>
+void PipelinedImageInputOp<Context>::PackWorker() {
+  const int channels = color_ ? 3 : 1;
+  const int image_size = crop_ * crop_ * channels;
+  unique_ptr<Item> item;
+  while (pack_queue_.Pop(&item)) {
+    TensorCPU& prefetched_image = prefetched_image_[item->batch->slot];
+    if (gpu_transform_) {
+      // output of decode will still be int8
+      memcpy(
+          prefetched_image.mutable_data<uint8_t>() +
+              image_size * item->item_id,
+          item->cropped.data(),
+          image_size);
+    } else {
+      NormalizeImage(
+          item->cropped.data(),
+          crop_ * crop_,
+          channels,
+          mean_,
+          std_,
+          order_,
+          prefetched_image.mutable_data<float>() +
+              image_size * item->item_id);
+    }
+    FinishItem(std::move(item), true);
+  }
+}
+
+// Read stage, run on the prefetch threads: feed the values of one batch into
+// the pipeline and wait for all of them to be packed.
+template <class Context>
+bool PipelinedImageInputOp<Context>::PrefetchSlot(int slot) {
+  TensorCPU& prefetched_image = prefetched_image_[slot];
+  TensorCPU& prefetched_label = prefetched_label_[slot];
+  // Call mutable_data() once to allocate the underlying memory, so that the
+  // stage threads only ever write into it.
+  if (gpu_transform_) {
+    // we'll transfer up in int8, then convert later
+    prefetched_image.mutable_data<uint8_t>();
+  } else {
+    prefetched_image.mutable_data<float>();
+  }
+
+  BatchState batch;
+  batch.slot = slot;
+  batch.pending = batch_size_;
+  auto wait_for_batch = [&batch]() {
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&batch]() { return batch.pending == 0; });
+  };
+
+  int item_id = 0;
+  try {
+    for (; item_id < batch_size_; ++item_id) {
+      unique_ptr<Item> item(new Item);
+      item->batch = &batch;
+      item->item_id = item_id;
+      string key;
+
+      // read data. If we are not owning the reader, the input holds it, a
+      // DBReader or a ShardedDBReader. Otherwise the constructor should have
+      // already set the reader pointer.
+      if (owned_reader_.get()) {
+        reader_->Read(&key, &item->value);
+        item->data = item->value.data();
+        item->size = item->value.size();
+      } else {
+        db::ReadDBRecord(
+            OperatorBase::InputBlob(0),
+            &key,
+            &item->value,
+            &item->data,
+            &item->size);
+      }
+
+      // determine label type based on first item
+      if (item_id == 0) {
+        if (use_caffe_datum_) {
+          prefetched_label.mutable_data<int>();
+        } else {
+          TensorProtos protos;
+          CAFFE_ENFORCE(protos.ParseFromArray(item->data, item->size));
+          TensorProto_DataType labeldt = protos.protos(1).data_type();
+          if (labeldt == TensorProto::INT32) {
+            prefetched_label.mutable_data<int>();
+          } else if (labeldt == TensorProto::FLOAT) {
+            prefetched_label.mutable_data<float>();
+          } else {
+            LOG(FATAL) << "Unsupported label type.";
+          }
+        }
+      }
+
+      decode_queue_.Push(std::move(item));
+    }
+  } catch (...) {
+    // Items already in the pipeline point at batch; let them finish first.
+    {
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      batch.pending -= batch_size_ - item_id;
+    }
+    wait_for_batch();
+    throw;
+  }
+  wait_for_batch();
+  if (batch.failed) {
+    return false;
+  }
+
+  // If the context is not CPUContext, we will need to do a copy in the
+  // prefetch function as well.
+  if (!std::is_same<Context, CPUContext>::value) {
+    prefetched_image_on_device_[slot].CopyFrom(prefetched_image, &context_);
+    prefetched_label_on_device_[slot].CopyFrom(prefetched_label, &context_);
+  }
+  return true;
+}
+
+template <class Context>
+bool PipelinedImageInputOp<Context>::CopyPrefetchedSlot(int slot) {
+  auto* image_output = OperatorBase::Output<Tensor<Context> >(0);
+  auto* label_output = OperatorBase::Output<Tensor<Context> >(1);
+  // Note(jiayq): The if statement below should be optimized away by the
+  // compiler since std::is_same is a constexpr.
+  if (std::is_same<Context, CPUContext>::value) {
+    image_output->CopyFrom(prefetched_image_[slot], &context_);
+    label_output->CopyFrom(prefetched_label_[slot], &context_);
+  } else {
+    if (gpu_transform_) {
+      TransformOnGPU<uint8_t,float,Context>(prefetched_image_on_device_[slot], image_output, std_, mean_, &context_);
+    } else {
+      image_output->CopyFrom(prefetched_image_on_device_[slot], &context_);
+    }
+    label_output->CopyFrom(prefetched_label_on_device_[slot], &context_);
+  }
+  return true;
+}
+// Registers the op and its schema, once per process however many
+// translation units include this header: the REGISTER_ and OPERATOR_SCHEMA
+// macros cannot be used in a header, as a second registration of a key exits
+// the process.
+inline bool RegisterPipelinedImageInput() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("PipelinedImageInput")) {
+      CPUOperatorRegistry()->Register(
+          "PipelinedImageInput",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              PipelinedImageInputOp<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("PipelinedImageInput")) {
+      OpSchemaRegistry::NewSchema("PipelinedImageInput", __FILE__, __LINE__)
+          .NumInputs(0, 1)
+          .NumOutputs(2)
+          .SetDoc(R"DOC(
+ImageInput, with the same arguments, that decodes, augments and packs the
+images of a batch on stages of threads of their own, connected by bounded
+queues, and keeps several batches in flight. Takes the output of CreateDB or
+CreateShardedDB.
+)DOC")
+          .Arg(
+              "prefetch_depth",
+              "(int, default 1) the number of batches prefetched ahead.")
+          .Arg(
+              "prefetch_threads",
+              "(int, default 1) the number of threads reading records, at "
+              "most prefetch_depth.")
+          .Arg(
+              "decode_threads",
+              "(int, default 4) the number of threads decoding images.")
+          .Arg(
+              "augment_threads",
+              "(int, default 2) the number of threads scaling, cropping and "
+              "mirroring images.")
+          .Arg(
+              "pack_threads",
+              "(int, default 1) the number of threads normalizing images "
+              "into the batch.")
+          .Arg(
+              "order",
+              "(string, default \"NHWC\") the order of the image batch, "
+              "\"NHWC\" or \"NCHW\".")
+          .Input(
+              0,
+              "reader",
+              "A pre-initialized DB reader, a DBReader or a ShardedDBReader.")
+          .Output(0, "data", "The batch of images.")
+          .Output(1, "label", "The labels of the images.");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_pipelined_image_input_registered = RegisterPipelinedImageInput();
+} // namespace
+}  // namespace caffe2
+
+#endif  // CAFFE2_IMAGE_PIPELINED_IMAGE_INPUT_OP_H_
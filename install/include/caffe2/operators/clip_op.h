@@ -6,6 +6,8 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
 namespace caffe2 {
@@ -57,6 +59,60 @@ class ClipGradientOp final : public Operator<Context> {
   // Input: Y, dY; Output: dX
 };
 
+/**
+ * Clip of float CPU tensors with the SIMD engine, split over the thread pool
+ * by ParallelFor(). The bounds default as in ClipOp.
+ */
+class SIMDClipOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDClipOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        min_(std::numeric_limits<float>::min()),
+        max_(std::numeric_limits<float>::max()) {
+    if (HasArgument("min")) {
+      min_ = OperatorBase::GetSingleArgument<float>("min", 0);
+    }
+    if (HasArgument("max")) {
+      max_ = OperatorBase::GetSingleArgument<float>("max", 0);
+    }
+  }
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    const float min = min_;
+    const float max = max_;
+    ParallelFor(X.size(), [=](size_t begin, size_t end) {
+      EigenVectorArrayMap<float>(Ydata + begin, end - begin) =
+          ConstEigenVectorArrayMap<float>(Xdata + begin, end - begin)
+              .cwiseMax(min)
+              .cwiseMin(max);
+    });
+    return true;
+  }
+
+ private:
+  float min_;
+  float max_;
+};
+
+// Registers SIMDClipOp with the SIMD engine, once per process.
+inline bool RegisterSIMDClipOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDClipOp>("Clip");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_clip_op_registered = RegisterSIMDClipOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_CLIP_OP_H_
@@ -0,0 +1,819 @@
+#ifndef CAFFE2_OPERATORS_COMPILED_RECURRENT_NETWORK_OP_H_
+#define CAFFE2_OPERATORS_COMPILED_RECURRENT_NETWORK_OP_H_
+
+#include <climits>
+#include <memory>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_gradient.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/operators/recurrent_network_op.h"
+#include "caffe2/utils/proto_utils.h"
+#include "google/protobuf/text_format.h"
+
+namespace caffe2 {
+namespace detail {
+
+/**
+ * A forward step workspace with everything CompiledRecurrentNetworkOp touches
+ * at its timestep already looked up: the step net, and the internal and
+ * external tensor of each link. Built once per step workspace, so that later
+ * runs rebind the links by pointer instead of by name.
+ */
+template <class Context>
+struct CompiledStep {
+  // The step workspace this was compiled for. Held weakly, so that a step
+  // workspace that was freed, and another one allocated at its address, is
+  // told apart and recompiled rather than run through stale pointers.
+  std::weak_ptr<Workspace> ws;
+  NetBase* net{nullptr};
+  TensorCPU* timestep{nullptr};
+  // Indexed like the op's links.
+  std::vector<Tensor<Context>*> internals;
+  std::vector<Tensor<Context>*> externals;
+};
+
+// applyLink() on tensors that were already looked up.
+template <typename T, typename Context>
+void bindLink(
+    const Link& link,
+    size_t t,
+    Tensor<Context>* internalTensor,
+    Tensor<Context>* externalTensor) {
+  CAFFE_ENFORCE_GT(externalTensor->size(), 0);
+  const TIndex externalTimestepSize =
+      externalTensor->size() / externalTensor->dim(0);
+  auto* externalData = externalTensor->template mutable_data<T>() +
+      (t + link.offset) * externalTimestepSize;
+  auto internalDims = externalTensor->dims();
+  // Single timestep
+  internalDims[0] = link.window;
+  internalTensor->Resize(internalDims);
+  internalTensor->ShareExternalPointer(
+      externalData, externalTimestepSize * link.window);
+}
+
+// Creates the link and timestep blobs in ws and looks up everything
+// runStep() needs from it. The step net is created after the first binding
+// of the links, as its operators may expect their inputs to be shaped.
+template <class Context>
+void compileStep(
+    const std::vector<Link>& links,
+    const std::string& timestep,
+    const std::shared_ptr<Workspace>& ws,
+    CompiledStep<Context>* step) {
+  step->ws = ws;
+  step->net = nullptr;
+  step->internals.clear();
+  step->externals.clear();
+  for (const auto& link : links) {
+    auto internalBlob = ws->CreateBlob(link.internal);
+    CAFFE_ENFORCE(internalBlob);
+    auto externalBlob = ws->GetBlob(link.external);
+    CAFFE_ENFORCE(externalBlob, "Missing link external: ", link.external);
+    step->internals.push_back(
+        internalBlob->template GetMutable<Tensor<Context>>());
+    step->externals.push_back(
+        externalBlob->template GetMutable<Tensor<Context>>());
+  }
+  step->timestep = ws->CreateBlob(timestep)->template GetMutable<TensorCPU>();
+  step->timestep->Resize(1);
+}
+
+// Runs the forward step net for timestep t in a compiled step workspace.
+template <typename T, class Context>
+void runStep(
+    const std::vector<Link>& links,
+    const NetDef& stepNetDef,
+    int t,
+    CompiledStep<Context>* step) {
+  for (int i = 0; i < links.size(); ++i) {
+    bindLink<T, Context>(links[i], t, step->internals[i], step->externals[i]);
+  }
+  step->timestep->template mutable_data<int32_t>()[0] = t;
+  if (!step->net) {
+    std::shared_ptr<Workspace> ws = step->ws.lock();
+    CAFFE_ENFORCE(ws, "Step workspace freed after compiling it");
+    step->net = ws->GetNet(stepNetDef.name());
+    if (step->net == nullptr) {
+      step->net = ws->CreateNet(stepNetDef);
+    }
+    CAFFE_ENFORCE(step->net, "Step Net construction failure");
+  }
+  // Since we have a SimpleNet, there are no races here.
+  step->net->RunAsync();
+}
+
+} // namespace detail
+
+/**
+ * RecurrentNetworkOp with its timesteps compiled: the links, timestep blob
+ * and step net of each step workspace are looked up the first time it runs a
+ * timestep, and later timesteps and runs only rebind the link tensors by
+ * pointer. RecurrentNetworkOp looks all of them up by name at every
+ * timestep, which dominates the cost of small step nets. Takes the same
+ * inputs, outputs and arguments, and "max_step_workspaces".
+ *
+ * With max_step_workspaces set, there may be fewer step workspaces than
+ * timesteps: timestep t then runs in step workspace
+ * t % max_step_workspaces, so that after the forward pass only the last
+ * max_step_workspaces timesteps still have their activations, and the
+ * gradient op recomputes the others.
+ */
+template <typename T, class Context>
+class CompiledRecurrentNetworkOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  CompiledRecurrentNetworkOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        sharedWs_(ws),
+        timestep_(OperatorBase::template GetSingleArgument<std::string>(
+            "timestep",
+            "timestep")),
+        maxStepWorkspaces_(OperatorBase::template GetSingleArgument<int>(
+            "max_step_workspaces",
+            0)) {
+    CAFFE_ENFORCE(ws);
+    CAFFE_ENFORCE_GE(maxStepWorkspaces_, 0);
+    if (maxStepWorkspaces_ > 0) {
+      LOG(INFO) << "CompiledRecurrentNetwork keeps the activations of at most "
+                << maxStepWorkspaces_ << " timesteps; the gradient "
+                << "recomputes the forward pass of all earlier ones.";
+    }
+    const auto stepNet =
+        OperatorBase::GetSingleArgument<string>("step_net", "");
+    CAFFE_ENFORCE(
+        google::protobuf::TextFormat::ParseFromString(stepNet, &stepNetDef_),
+        "Invalid netdef");
+
+    recurrentInputs_ = constructRecurrentInputs(sharedWs_);
+    detail::extractLinks(
+        this,
+        "link_internal",
+        "link_external",
+        "link_offset",
+        "link_window",
+        &links_);
+    aliases_ = constructAliases();
+  }
+
+  bool RunOnDevice() override {
+    const auto seqLen = Input(0).dim32(0);
+    const auto batchSize = Input(0).dim32(1);
+    for (const auto& ri : recurrentInputs_) {
+      detail::initializeRecurrentInput<T, Context>(
+          ri, seqLen, batchSize, sharedWs_, &context_);
+    }
+
+    detail::ScratchWorkspaces* scratch =
+        OperatorBase::Output<detail::ScratchWorkspaces>(OutputSize() - 1);
+    std::vector<std::shared_ptr<Workspace>>& stepWorkspaces =
+        scratch->stepWorkspaces;
+    std::shared_ptr<Workspace>& forwardSharedWs = scratch->forwardSharedWs;
+    if (!forwardSharedWs) {
+      forwardSharedWs = std::make_shared<Workspace>(sharedWs_);
+    }
+
+    // Caller can decide that some of the forward activations
+    // are recomputed on backward pass. Then those activations do not
+    // have to be stored in step workspaces but can be shared.
+    for (const auto& b : OperatorBase::GetRepeatedArgument<std::string>(
+             "recompute_blobs_on_backward")) {
+      // Note: if the blob already was created, this is a no-op.
+      forwardSharedWs->CreateBlob(b);
+    }
+
+    const size_t numStepWorkspaces = maxStepWorkspaces_ > 0
+        ? std::min<size_t>(maxStepWorkspaces_, seqLen)
+        : seqLen;
+    if (numStepWorkspaces > stepWorkspaces.size()) {
+      stepWorkspaces.resize(numStepWorkspaces);
+    }
+    if (stepWorkspaces.size() > compiledSteps_.size()) {
+      compiledSteps_.resize(stepWorkspaces.size());
+    }
+
+    for (auto t = 0; t < seqLen; ++t) {
+      const size_t slot = t % stepWorkspaces.size();
+      auto& currentStepWorkspace = stepWorkspaces[slot];
+      if (!currentStepWorkspace) {
+        currentStepWorkspace =
+            std::make_shared<Workspace>(forwardSharedWs.get());
+      }
+      auto& step = compiledSteps_[slot];
+      if (step.ws.lock() != currentStepWorkspace) {
+        VLOG(1) << "Compiling step workspace " << slot;
+        detail::compileStep(links_, timestep_, currentStepWorkspace, &step);
+      }
+      detail::runStep<T, Context>(links_, stepNetDef_, t, &step);
+    }
+
+    for (const auto& alias : aliases_) {
+      detail::applyOffsetAlias<T, Context>(alias, sharedWs_, &context_);
+    }
+
+    return true;
+  }
+
+ private:
+  std::vector<detail::RecurrentInput> constructRecurrentInputs(
+      Workspace* sharedWs) {
+    const auto states =
+        OperatorBase::GetRepeatedArgument<std::string>("recurrent_states");
+    const auto inputs =
+        OperatorBase::GetRepeatedArgument<int>("initial_recurrent_state_ids");
+    CAFFE_ENFORCE_EQ(states.size(), inputs.size(), "states/inputs mismatch");
+    std::vector<detail::RecurrentInput> ris;
+    for (auto i = 0; i < states.size(); ++i) {
+      // States need to be "global" (since they are shared between
+      // forward and backward).
+      sharedWs->CreateBlob(states[i]);
+
+      detail::RecurrentInput ri;
+      ri.state = states[i];
+      ri.input = def().input(inputs[i]);
+      ris.push_back(ri);
+    }
+    return ris;
+  }
+
+  std::vector<detail::OffsetAlias> constructAliases() {
+    const auto& src =
+        OperatorBase::GetRepeatedArgument<std::string>("alias_src");
+    const auto& dst =
+        OperatorBase::GetRepeatedArgument<std::string>("alias_dst");
+    const auto& offset =
+        OperatorBase::GetRepeatedArgument<int32_t>("alias_offset");
+    CAFFE_ENFORCE(
+        src.size() == offset.size(), "alias_src/alias_offset mismatch");
+    CAFFE_ENFORCE(
+        dst.size() == offset.size(), "alias_dst/alias_offset mismatch");
+    std::vector<detail::OffsetAlias> aliases;
+    for (auto i = 0; i < src.size(); ++i) {
+      detail::OffsetAlias oc;
+      oc.src = src[i];
+      oc.dst = dst[i];
+      oc.offset = offset[i];
+      aliases.push_back(oc);
+    }
+    return aliases;
+  }
+
+  NetDef stepNetDef_;
+  Workspace* sharedWs_;
+  std::vector<detail::Link> links_;
+  std::vector<detail::OffsetAlias> aliases_;
+  std::vector<detail::RecurrentInput> recurrentInputs_;
+  std::string timestep_;
+  // Bounds the step workspaces kept for the gradient; 0 keeps one per
+  // timestep.
+  int maxStepWorkspaces_;
+  // Indexed like the step workspaces; recompiled whenever one of them
+  // changes.
+  std::vector<detail::CompiledStep<Context>> compiledSteps_;
+};
+
+/**
+ * RecurrentNetworkGradientOp for CompiledRecurrentNetwork, which may leave
+ * fewer step workspaces than timesteps (see its max_step_workspaces
+ * argument). Walking the timesteps backwards, it reruns the forward step net
+ * of each timestep whose step workspace was reused by a later one, from the
+ * recurrent states the forward op kept, before running the backward step
+ * net of that timestep. It needs the step_net and links of the forward op.
+ */
+template <typename T, class Context>
+class CompiledRecurrentNetworkGradientOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  CompiledRecurrentNetworkGradientOp(
+      const OperatorDef& operator_def,
+      Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        sharedWs_(ws),
+        localWs_(ws),
+        timestep_(OperatorBase::template GetSingleArgument<std::string>(
+            "timestep",
+            "timestep")),
+        gradInputs_(OperatorBase::template GetRepeatedArgument<int32_t>(
+            "outputs_with_grads")) {
+    links_ = constructLinks();
+    params_ = constructParams();
+    recurrentGradients_ = constructRecurrentGradients();
+    recurrentInputIds_ = OperatorBase::template GetRepeatedArgument<int32_t>(
+        "initial_recurrent_state_ids");
+
+    CAFFE_ENFORCE(ws);
+    const auto stepNet =
+        OperatorBase::GetSingleArgument<string>("backward_step_net", "");
+    CAFFE_ENFORCE(
+        google::protobuf::TextFormat::ParseFromString(stepNet, &stepNetDef_));
+
+    // The forward step net and links, to recompute the timesteps whose step
+    // workspace the forward op reused (see max_step_workspaces).
+    CAFFE_ENFORCE(
+        OperatorBase::HasArgument("step_net"),
+        "CompiledRecurrentNetworkGradient needs the step_net of the forward "
+        "op, which GetCompiledRecurrentNetworkGradient passes on.");
+    CAFFE_ENFORCE(
+        google::protobuf::TextFormat::ParseFromString(
+            OperatorBase::GetSingleArgument<string>("step_net", ""),
+            &forwardStepNetDef_),
+        "Invalid netdef");
+    detail::extractLinks(
+        this,
+        "link_internal",
+        "link_external",
+        "link_offset",
+        "link_window",
+        &forwardLinks_);
+  }
+
+  // Renaming maps (generated by memonger.py)
+  std::string remappedName(std::string blob_name) {
+    return OperatorBase::template GetSingleArgument<std::string>(
+        blob_name + ".rename", blob_name);
+  }
+
+  detail::Link remappedLink(const detail::Link& link) {
+    detail::Link renamed_link = link;
+    renamed_link.internal = remappedName(link.internal);
+    renamed_link.external = remappedName(link.external);
+    return renamed_link;
+  }
+
+  std::vector<detail::Param> constructParams() {
+    std::vector<detail::Param> params;
+    const auto& param = OperatorBase::GetRepeatedArgument<int32_t>("param");
+    for (int i = 0; i < param.size(); ++i) {
+      detail::Param p;
+      // Forward inputs come after [outputs_with_grads] gradient inputs
+      p.param = def().input(param[i] + gradInputs_.size());
+      // See GetRecurrentNetworkGradient to understand offseting here
+      p.grad = def().output(i + numSequences_);
+      p.accGrad = p.grad + "_acc";
+      params.push_back(p);
+    }
+    return params;
+  }
+
+  std::vector<detail::RecurrentGradient> constructRecurrentGradients() {
+    std::vector<detail::RecurrentGradient> rgs;
+    const auto& recurrent =
+        OperatorBase::GetRepeatedArgument<std::string>("recurrent_states");
+    const auto& alias_src =
+        OperatorBase::GetRepeatedArgument<std::string>("alias_src");
+    const auto& offset =
+        OperatorBase::GetRepeatedArgument<int32_t>("alias_offset");
+
+    for (auto i = 0; i < recurrent.size(); ++i) {
+      detail::RecurrentGradient rg;
+      rg.param = recurrent[i];
+      rg.grad = remappedName(recurrent[i] + "_grad");
+
+      for (int j = 0; j < alias_src.size(); ++j) {
+        if (alias_src[j] != recurrent[i]) {
+          continue;
+        }
+        int idx = -1;
+        for (int k = 0; k < gradInputs_.size(); ++k) {
+          if (gradInputs_[k] == j) {
+            idx = k;
+          }
+        }
+        if (idx == -1) {
+          continue;
+        }
+
+        CAFFE_ENFORCE(offset[j] == 1 || offset[j] == -1);
+        if (offset[j] == 1) {
+          rg.externalGrad = def().input(idx);
+        } else if (offset[j] == -1) {
+          rg.lastExternalGrad = def().input(idx);
+        }
+      }
+      rg.offset = 1;
+      rgs.push_back(rg);
+    }
+    return rgs;
+  }
+
+  std::vector<detail::Link> constructLinks() {
+    std::vector<detail::Link> links;
+    detail::extractLinks(
+        this,
+        "link_internal",
+        "link_external",
+        "link_offset",
+        "link_window",
+        &links);
+    detail::extractLinks(
+        this,
+        "backward_link_internal",
+        "backward_link_external",
+        "backward_link_offset",
+        "",
+        &links);
+    for (int i = 0; i < links.size(); i++) {
+      links[i] = remappedLink(links[i]);
+    }
+    return links;
+  }
+
+  bool RunOnDevice() override {
+    const auto seqLen = Input(gradInputs_.size()).dim32(0);
+    VLOG(1) << "seqLen: " << seqLen;
+
+    const auto batchSize = Input(0).dim32(1);
+    for (auto& param : params_) {
+      auto pBlob = sharedWs_->GetBlob(param.param);
+      CAFFE_ENFORCE(pBlob);
+      const auto& p = pBlob->template Get<Tensor<Context>>();
+
+      auto gBlob = sharedWs_->GetBlob(param.grad);
+      CAFFE_ENFORCE(gBlob);
+      auto* g = gBlob->template GetMutable<Tensor<Context>>();
+
+      auto agBlob = localWs_.CreateBlob(param.accGrad);
+      CAFFE_ENFORCE(agBlob);
+      auto* ag = agBlob->template GetMutable<Tensor<Context>>();
+      g->ResizeLike(p);
+      ag->ResizeLike(p);
+      math::Set<T, Context>(
+          ag->size(), 0.0, ag->template mutable_data<T>(), &context_);
+    }
+
+    for (auto& rg : recurrentGradients_) {
+      auto pBlob = sharedWs_->GetBlob(rg.param);
+      CAFFE_ENFORCE(pBlob);
+      const auto& p = pBlob->template Get<Tensor<Context>>();
+
+      auto gBlob = sharedWs_->CreateBlob(rg.grad);
+      CAFFE_ENFORCE(gBlob);
+      auto* g = gBlob->template GetMutable<Tensor<Context>>();
+      g->ResizeLike(p);
+      CAFFE_ENFORCE_EQ(g->ndim(), 3);
+      const auto timestep = g->size() / g->dim(0);
+      // Fill the last timestep with zeros for the gradient
+      math::Set<T, Context>(
+          timestep,
+          0.0,
+          g->template mutable_data<T>() + (g->dim(0) - 1) * timestep,
+          &context_);
+    }
+
+    // This code assumes that there are several input
+    // sequences. Actually it is not supported by the rest of the code,
+    // and numSequences_ is a constant, equal to 1.
+    for (int i = 0; i < numSequences_; ++i) {
+      // Offseting as the first gradInputs_.size() inputs of the op
+      // are from GO. Then all I(0..N).
+      const int gradientInputIndex = i + gradInputs_.size();
+      const auto& inputName = def().input(gradientInputIndex);
+      auto gradientName = remappedName(inputName + "_grad");
+      VLOG(1) << "Initializing gradient for input " << gradientInputIndex
+              << " (" << inputName << ") "
+              << " as blob " << gradientName
+              << ". Size: " << Input(gradientInputIndex).size();
+      auto pGradientBlob = sharedWs_->GetBlob(gradientName);
+      CAFFE_ENFORCE(pGradientBlob);
+      auto* g = pGradientBlob->template GetMutable<Tensor<Context>>();
+      g->ResizeLike(Input(gradientInputIndex));
+      g->template mutable_data<T>();
+    }
+
+    auto accumulateParameterGradients = [&]() {
+      for (const auto& param : params_) {
+        auto gBlob = sharedWs_->GetBlob(param.grad);
+        CAFFE_ENFORCE(gBlob);
+        const auto& g = gBlob->template Get<Tensor<Context>>();
+
+        auto agBlob = localWs_.GetBlob(param.accGrad);
+        CAFFE_ENFORCE(agBlob);
+        auto* ag = agBlob->template GetMutable<Tensor<Context>>();
+        CAFFE_ENFORCE(ag->dims() == g.dims());
+        T* ag_data = ag->template mutable_data<T>();
+        math::Add<T, Context>(
+            g.size(), g.template data<T>(), ag_data, ag_data, &context_);
+      }
+    };
+
+    auto accumulateInputGradients = [&](int t) {
+      // Input gradients
+      for (const auto& rg : recurrentGradients_) {
+        if (rg.externalGrad.empty()) {
+          continue;
+        }
+        VLOG(1) << "Accumulating into: " << rg.grad << " from "
+                << rg.externalGrad << " at time: " << t
+                << ", offset: " << rg.offset;
+        auto gBlob = sharedWs_->GetBlob(rg.grad);
+        CAFFE_ENFORCE(gBlob);
+        auto* g = gBlob->template GetMutable<Tensor<Context>>();
+
+        auto ogBlob = sharedWs_->GetBlob(rg.externalGrad);
+        CAFFE_ENFORCE(ogBlob);
+        const auto& og = ogBlob->template Get<Tensor<Context>>();
+
+        // g[T+offset] += og[T]
+        CAFFE_ENFORCE_EQ(g->size() / g->dim(0), og.size() / og.dim(0));
+        const auto timestep_size = g->size() / g->dim(0);
+        CAFFE_ENFORCE_EQ(timestep_size, og.size() / og.dim(0));
+        T* g_data = g->template mutable_data<T>();
+        math::Add<T, Context>(
+            timestep_size,
+            og.template data<T>() + t * timestep_size,
+            g_data + (t + rg.offset) * timestep_size,
+            g_data + (t + rg.offset) * timestep_size,
+            &context_);
+      }
+    };
+
+    auto accumulateFinalInputGradients = [&]() {
+      for (const auto& rg : recurrentGradients_) {
+        if (rg.lastExternalGrad.empty()) {
+          continue;
+        }
+        VLOG(1) << "Accumulating into: " << rg.grad << " from "
+                << rg.lastExternalGrad << " for final time step (sep. blob)";
+        auto gBlob = sharedWs_->GetBlob(rg.grad);
+        CAFFE_ENFORCE(gBlob);
+        auto* g = gBlob->template GetMutable<Tensor<Context>>();
+
+        auto oglastBlob = sharedWs_->GetBlob(rg.lastExternalGrad);
+        CAFFE_ENFORCE(oglastBlob);
+        const auto& oglast = oglastBlob->template Get<Tensor<Context>>();
+        CAFFE_ENFORCE_EQ(g->dim(1), oglast.dim(1));
+        CAFFE_ENFORCE_EQ(g->dim(2), oglast.dim(2));
+
+        const auto t = g->dim(0) - 1;
+        const auto timestep_size = g->size() / g->dim(0);
+        CAFFE_ENFORCE_EQ(timestep_size, oglast.size());
+        T* g_data_with_offset =
+            g->template mutable_data<T>() + t * timestep_size;
+        math::Add<T, Context>(
+            timestep_size,
+            oglast.template data<T>(),
+            g_data_with_offset,
+            g_data_with_offset,
+            &context_);
+      }
+    };
+
+    const detail::ScratchWorkspaces& scratch =
+        OperatorBase::Input<detail::ScratchWorkspaces>(InputSize() - 1);
+    const std::vector<std::shared_ptr<Workspace>>& stepWorkspaces =
+        scratch.stepWorkspaces;
+    const size_t numStepWorkspaces = stepWorkspaces.size();
+    CAFFE_ENFORCE(seqLen == 0 || numStepWorkspaces > 0);
+    int recomputed = 0;
+
+    accumulateFinalInputGradients();
+    for (int32_t t = seqLen - 1; t >= 0; --t) {
+      // Timestep t ran in slot t % numStepWorkspaces, and unless it is one
+      // of the last numStepWorkspaces timesteps, t + numStepWorkspaces ran
+      // there after it.
+      const size_t slot = t % numStepWorkspaces;
+      if (t + numStepWorkspaces < static_cast<size_t>(seqLen)) {
+        recomputeStep(stepWorkspaces[slot], slot, t);
+        ++recomputed;
+      }
+      // We use local workspace for all the blobs which are not a part
+      // of backward links. This way we reuse memory for all the internal
+      // gradient blobs of the backward step net across all the timesteps
+      localWs_.SetParentWorkspace(stepWorkspaces[slot].get());
+      accumulateInputGradients(t);
+      for (const auto& link : links_) {
+        detail::applyLink<T, Context>(link, t, &localWs_);
+      }
+      // We create different nets in the localWs_.
+      // There is no name clash here as localWs_ is a private
+      // workspace of this operator. The reason for this is that
+      // otherwise if we use the same net at each timestep,
+      // its inputs / outputs won't peak up new blobs after
+      // attaching a new parent using SetParentWorkspace
+      auto old_net_name = stepNetDef_.name();
+      auto net_name = MakeString(old_net_name, "_", t);
+      auto* stepNet = localWs_.GetNet(net_name);
+      if (stepNet == nullptr) {
+        stepNetDef_.set_name(net_name);
+        stepNet = localWs_.CreateNet(stepNetDef_);
+        stepNetDef_.set_name(old_net_name);
+      }
+      CAFFE_ENFORCE(stepNet);
+      stepNet->RunAsync();
+      accumulateParameterGradients();
+    }
+    VLOG(1) << "Recomputed " << recomputed << " of " << seqLen
+            << " timesteps in " << numStepWorkspaces << " step workspaces";
+
+    for (const auto& param : params_) {
+      // Swap the accumulated gradients with the actual gradients so
+      // the rest of the network sees the accumulated gradients.
+      using std::swap;
+      auto accGradBlob = localWs_.GetBlob(param.accGrad);
+      auto gradBlob = sharedWs_->GetBlob(param.grad);
+      CAFFE_ENFORCE(accGradBlob);
+      CAFFE_ENFORCE(gradBlob);
+      swap(*accGradBlob, *gradBlob);
+    }
+
+    CAFFE_ENFORCE_EQ(recurrentInputIds_.size(), recurrentGradients_.size());
+    for (int i = 0; i < recurrentInputIds_.size(); ++i) {
+      // See GetRecurrentNetworkGradient to understand offseting here
+      // Outputs of the gradient are inputs of the forward pass.
+      // So we need to offset on all inputs that go before recurrent
+      // initial ones
+      auto outputIdx = i + params_.size() + numSequences_;
+      // because first gradInputs_.size() inputs are from GO
+      int inputId = recurrentInputIds_[i] + gradInputs_.size();
+      VLOG(1) << "Resetting output " << def().output(outputIdx)
+              << " like input " << def().input(inputId);
+      Output(outputIdx)->ResizeLike(Input(inputId));
+      T* output_data = Output(outputIdx)->template mutable_data<T>();
+      auto pBlob = sharedWs_->GetBlob(recurrentGradients_[i].grad);
+      CAFFE_ENFORCE(pBlob);
+      auto* p = pBlob->template GetMutable<Tensor<Context>>();
+
+      if (Input(inputId).ndim() >= 2) {
+        // Gradient states blob should live. And if it gets changed by the
+        // backward pass, then output should be changed as well. Thus it should
+        // be okay to share data here
+        Output(outputIdx)->template ShareExternalPointer<T>(
+            p->template mutable_data<T>());
+      } else {
+        // We need to do a bunch of Adds any way. So lets not worry about
+        // copy / share data here. One way to speed this up could be a kernel
+        // which sums up several tensors together instead of going 1 by 1
+        const auto recurrentStateSize = Input(inputId).dim32(0);
+
+        math::Set<T, Context>(recurrentStateSize, 0.0, output_data, &context_);
+
+        math::AddStripedBatch<T, Context>(
+            recurrentStateSize,
+            p->template data<T>(),
+            output_data,
+            recurrentStateSize,
+            batchSize,
+            &context_);
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  // Reruns the forward step net of timestep t in ws, the step workspace
+  // slot the forward op ran it in.
+  void recomputeStep(
+      const std::shared_ptr<Workspace>& ws,
+      size_t slot,
+      int t) {
+    if (slot >= recomputeSteps_.size()) {
+      recomputeSteps_.resize(slot + 1);
+    }
+    auto& step = recomputeSteps_[slot];
+    if (step.ws.lock() != ws) {
+      detail::compileStep(forwardLinks_, timestep_, ws, &step);
+    }
+    detail::runStep<T, Context>(forwardLinks_, forwardStepNetDef_, t, &step);
+  }
+
+  NetDef stepNetDef_;
+  Workspace* sharedWs_;
+  Workspace localWs_;
+  std::vector<detail::Link> links_;
+  std::vector<detail::Param> params_;
+  std::vector<detail::RecurrentGradient> recurrentGradients_;
+  std::string timestep_;
+  // For now we support only one input sequence
+  const int numSequences_{1};
+  std::vector<int32_t> recurrentInputIds_;
+  std::vector<int32_t> gradInputs_;
+  // For recomputing forward timesteps.
+  NetDef forwardStepNetDef_;
+  std::vector<detail::Link> forwardLinks_;
+  std::vector<detail::CompiledStep<Context>> recomputeSteps_;
+};
+
+/**
+ * The gradient of CompiledRecurrentNetwork: a CompiledRecurrentNetworkGradient
+ * op taking the gradients of the outputs in "outputs_with_grads", then all the
+ * inputs and outputs of the forward op, and giving the gradients of the input
+ * sequence, of the "param" inputs and of the initial recurrent states.
+ *
+ * It passes on the arguments of the forward op itself rather than through
+ * CopyArguments(), so that the gradient op always gets the step_net and
+ * links it recomputes timesteps with.
+ */
+class GetCompiledRecurrentNetworkGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  bool CopyArguments() const override {
+    return false;
+  }
+  vector<OperatorDef> GetGradientDefs() override {
+    ArgumentHelper argsHelper(def_);
+    CAFFE_ENFORCE(
+        argsHelper.HasArgument("step_net"),
+        "CompiledRecurrentNetwork needs a step_net");
+    auto params = argsHelper.GetRepeatedArgument<int32_t>("param");
+    auto recurrentInputs =
+        argsHelper.GetRepeatedArgument<int32_t>("initial_recurrent_state_ids");
+    auto outputsWithGrads =
+        argsHelper.GetRepeatedArgument<int32_t>("outputs_with_grads");
+    CAFFE_ENFORCE(
+        outputsWithGrads.size() > 0, "outputs_with_grads must not be empty");
+
+    vector<string> gradientInputs;
+    for (auto id : outputsWithGrads) {
+      gradientInputs.push_back(GO(id));
+    }
+    for (int i = 0; i < def_.input_size(); ++i) {
+      gradientInputs.push_back(I(i));
+    }
+    for (int i = 0; i < def_.output_size(); ++i) {
+      gradientInputs.push_back(O(i));
+    }
+
+    // Gradients of the input sequence, the parameters and the initial
+    // recurrent states, in the order RecurrentNetworkGradientOp expects.
+    vector<string> gradientOutputs;
+    gradientOutputs.push_back(GI(0));
+    for (auto id : params) {
+      gradientOutputs.push_back(GI(id));
+    }
+    for (auto id : recurrentInputs) {
+      gradientOutputs.push_back(GI(id));
+    }
+    auto gradientDefs = SingleGradientDef(
+        "CompiledRecurrentNetworkGradient",
+        "",
+        gradientInputs,
+        gradientOutputs);
+    gradientDefs[0].mutable_arg()->CopyFrom(def_.arg());
+    return gradientDefs;
+  }
+};
+
+// Registers the op, its schema and its gradient, once per process however
+// many translation units include this header: the REGISTER_ and
+// OPERATOR_SCHEMA macros cannot be used in a header, as a second
+// registration of a key exits the process.
+inline bool RegisterCompiledRecurrentNetworkOps() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("CompiledRecurrentNetwork")) {
+      CPUOperatorRegistry()->Register(
+          "CompiledRecurrentNetwork",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CompiledRecurrentNetworkOp<float, CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("CompiledRecurrentNetwork")) {
+      OpSchemaRegistry::NewSchema(
+          "CompiledRecurrentNetwork", __FILE__, __LINE__)
+          .NumInputs(1, INT_MAX)
+          .NumOutputs(2, INT_MAX)
+          .SetDoc(R"DOC(
+RecurrentNetwork with its timesteps compiled: each step workspace looks up
+its link tensors, timestep blob and step net once, and later timesteps and
+runs rebind the links by pointer instead of looking them up by name. Takes
+the inputs, outputs and arguments of RecurrentNetwork, and
+max_step_workspaces, which when positive keeps at most that many step
+workspaces, reused round robin across the timesteps; the gradient then
+recomputes the forward pass of the timesteps whose activations were
+overwritten, trading compute for memory.
+)DOC")
+          .Arg(
+              "max_step_workspaces",
+              "Step workspaces kept for the gradient, or 0 (the default) for "
+              "one per timestep.");
+    }
+    if (!CPUOperatorRegistry()->Has("CompiledRecurrentNetworkGradient")) {
+      CPUOperatorRegistry()->Register(
+          "CompiledRecurrentNetworkGradient",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CompiledRecurrentNetworkGradientOp<float, CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("CompiledRecurrentNetworkGradient")) {
+      OpSchemaRegistry::NewSchema(
+          "CompiledRecurrentNetworkGradient", __FILE__, __LINE__);
+    }
+    if (!GradientRegistry()->Has("CompiledRecurrentNetwork")) {
+      GradientRegistry()->Register(
+          "CompiledRecurrentNetwork",
+          RegistererGradientRegistry::DefaultCreator<
+              GetCompiledRecurrentNetworkGradient>);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_compiled_recurrent_network_ops_registered =
+    RegisterCompiledRecurrentNetworkOps();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_COMPILED_RECURRENT_NETWORK_OP_H_
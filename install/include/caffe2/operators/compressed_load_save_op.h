@@ -0,0 +1,944 @@
+#ifndef CAFFE2_OPERATORS_COMPRESSED_LOAD_SAVE_OP_H_
+#define CAFFE2_OPERATORS_COMPRESSED_LOAD_SAVE_OP_H_
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/db.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/raw_tensor_serialization.h"
+#include "caffe2/core/serialization_thread_pool.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/operators/load_save_op.h"
+#include "caffe2/utils/compression.h"
+#include "caffe2/utils/murmur_hash3.h"
+
+namespace caffe2 {
+
+// Sizes before and after compression of the values a CompressedSaveOp or
+// CompressedLoadOp run has (de)compressed, and the time spent on it summed
+// over all threads.
+struct CompressionStats {
+  std::atomic<int64_t> raw_bytes{0};
+  std::atomic<int64_t> stored_bytes{0};
+  std::atomic<int64_t> nanos{0};
+
+  void Add(size_t raw, size_t stored, float ns) {
+    raw_bytes += raw;
+    stored_bytes += stored;
+    nanos += static_cast<int64_t>(ns);
+  }
+
+  void Report(const char* action, const string& db_name) {
+    if (stored_bytes > 0) {
+      const double raw_mb = raw_bytes / 1e6;
+      LOG(INFO) << action << " " << db_name << ": " << raw_mb
+                << " MB stored as " << stored_bytes / 1e6 << " MB (ratio "
+                << static_cast<double>(raw_bytes) / stored_bytes << ") at "
+                << raw_mb / std::max<double>(nanos / 1e9, 1e-9)
+                << " MB/s per thread";
+    }
+    raw_bytes = 0;
+    stored_bytes = 0;
+    nanos = 0;
+  }
+};
+
+// A delta checkpoint stores, under this key, the name of the checkpoint db it
+// is a delta against, relative to its own directory. Loading it first loads
+// that parent (itself possibly a delta), and then overwrites the chunks
+// stored in the delta. CompressedSaveOp writes the key as the first record,
+// so that dbs that cannot seek only have to look at that record.
+constexpr auto kDeltaCheckpointParentKey = "__delta_checkpoint_parent__";
+
+// Digests of the chunks of a tensor as of the last checkpoint, used to find
+// the chunks a delta checkpoint has to store.
+struct TensorChunkDigests {
+  vector<TIndex> dims;
+  TypeMeta meta;
+  int64_t chunk_size{0};
+  vector<std::array<uint64_t, 2>> digests;
+};
+using ChunkDigestMap = std::unordered_map<string, TensorChunkDigests>;
+
+// Returns whether the db the cursor reads is a delta checkpoint, and if so
+// its parent, as stored, in *parent. Leaves the cursor at the first record.
+inline bool ReadDeltaCheckpointParent(Cursor* cursor, string* parent) {
+  if (cursor->SupportsSeek()) {
+    cursor->Seek(kDeltaCheckpointParentKey);
+  } else {
+    cursor->SeekToFirst();
+  }
+  const bool found =
+      cursor->Valid() && cursor->key() == kDeltaCheckpointParentKey;
+  if (found) {
+    *parent = cursor->value();
+  }
+  cursor->SeekToFirst();
+  return found;
+}
+
+// Returns the path of db to_db relative to the directory of db from_db, or
+// to_db itself if only one of them is absolute.
+inline string RelativeDbPath(const string& from_db, const string& to_db) {
+  if (from_db.empty() || to_db.empty() ||
+      (from_db[0] == '/') != (to_db[0] == '/')) {
+    return to_db;
+  }
+  auto split = [](const string& path) {
+    vector<string> parts;
+    size_t begin = 0;
+    for (;;) {
+      const size_t end = path.find('/', begin);
+      parts.push_back(path.substr(begin, end - begin));
+      if (end == string::npos) {
+        return parts;
+      }
+      begin = end + 1;
+    }
+  };
+  const vector<string> from = split(from_db);
+  const vector<string> to = split(to_db);
+  // The last part of from_db is the db itself, not a directory.
+  size_t common = 0;
+  while (common + 1 < from.size() && common + 1 < to.size() &&
+         from[common] == to[common]) {
+    ++common;
+  }
+  string relative;
+  for (size_t i = common; i + 1 < from.size(); ++i) {
+    relative += "../";
+  }
+  for (size_t i = common; i < to.size(); ++i) {
+    relative += to[i];
+    if (i + 1 < to.size()) {
+      relative += '/';
+    }
+  }
+  return relative;
+}
+
+// Inverse of RelativeDbPath(): resolves path, relative to the directory of
+// db from_db unless it is absolute.
+inline string ResolveDbPath(const string& from_db, const string& path) {
+  if (!path.empty() && path[0] == '/') {
+    return path;
+  }
+  const size_t slash = from_db.rfind('/');
+  return slash == string::npos ? path : from_db.substr(0, slash + 1) + path;
+}
+
+// CompressedLoadOp is LoadOp for dbs written by CompressedSaveOp: it takes
+// the same arguments, and decompresses the values compressed by
+// CompressValue() before parsing them. Values that are not compressed load as
+// they do with LoadOp, so it reads the dbs of SaveOp as well. A delta
+// checkpoint written by DeltaCheckpointOp is loaded by loading its parent
+// first, see kDeltaCheckpointParentKey.
+template <class Context>
+class CompressedLoadOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  CompressedLoadOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        ws_(ws),
+        absolute_path_(
+            OperatorBase::GetSingleArgument<int>("absolute_path", false)),
+        add_prefix_(OperatorBase::GetSingleArgument<string>("add_prefix", "")),
+        strip_prefix_(
+            OperatorBase::GetSingleArgument<string>("strip_prefix", "")),
+        db_name_(OperatorBase::GetSingleArgument<string>("db", "")),
+        db_type_(OperatorBase::GetSingleArgument<string>("db_type", "")),
+        keep_device_(OperatorBase::GetSingleArgument<int>("keep_device", 0)),
+        load_all_(OperatorBase::GetSingleArgument<int>("load_all", 0)),
+        allow_incomplete_(
+            OperatorBase::GetSingleArgument<bool>("allow_incomplete", false)) {
+    if (InputSize() == 0) {
+      CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
+      CAFFE_ENFORCE_GT(db_type_.size(), 0, "Must specify a db type.");
+    }
+    if (!load_all_) {
+      int idx = 0;
+      std::set<std::string> input_names;
+      for (const string& output_name : this->def().output()) {
+        std::string name = output_name;
+        CAFFE_ENFORCE(
+            input_names.insert(name).second, "Duplicated input: ", name);
+        output_indices_[name] = idx++;
+      }
+    }
+  }
+
+  void SetCurrentDevice(BlobProto* proto);
+
+  bool RunOnDevice() override {
+    if (InputSize() == 1) {
+      const db::DBReader& reader = OperatorBase::Input<db::DBReader>(0);
+      extract(reader.cursor());
+    } else {
+      string full_db_name =
+          absolute_path_ ? db_name_ : (ws_->RootFolder() + "/" + db_name_);
+      loadDb(full_db_name);
+    }
+    decompression_stats_.Report("Decompressed", db_name_);
+
+    return true;
+  }
+
+ private:
+  // Loads a db by its full name, following the chain of parents if it is a
+  // delta checkpoint.
+  void loadDb(const string& full_db_name) {
+    std::unique_ptr<DB> in_db(
+        caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::READ));
+    CAFFE_ENFORCE(in_db.get(), "Cannot open db: ", full_db_name);
+    std::unique_ptr<Cursor> cursor(in_db->NewCursor());
+    string parent;
+    if (ReadDeltaCheckpointParent(cursor.get(), &parent)) {
+      VLOG(1) << "Loading " << full_db_name << " as a delta of " << parent;
+      loadDb(ResolveDbPath(full_db_name, parent));
+      // The parent already filled every blob completely; apply the stored
+      // chunks on top of it.
+      patching_ = true;
+      try {
+        extract(cursor.get());
+      } catch (...) {
+        patching_ = false;
+        throw;
+      }
+      patching_ = false;
+    } else {
+      extract(cursor.get());
+    }
+  }
+
+  void extract(Cursor* cursor) {
+    if (load_all_) {
+      extractAll(cursor);
+    } else {
+      extractFrom(cursor, OperatorBase::Outputs());
+    }
+  }
+
+  // Calls apply(key, proto) for the records of the cursor whose blob name
+  // passes filter(key), in db order, until apply returns true. Decompressing
+  // and parsing the protos, which dominates for large tensors, runs on the
+  // serialization pool, with at most SerializationChunksInFlight() records
+  // read ahead. The protos are applied on the calling thread, as
+  // deserializing into a shared tensor is not safe to do concurrently.
+  template <typename Filter, typename Apply>
+  void forEachBlobProto(Cursor* cursor, Filter filter, Apply apply) {
+    struct PendingProto {
+      string key;
+      string value;
+      BlobProto proto;
+      bool parsed{false};
+      bool success{false};
+    };
+    const size_t max_in_flight = SerializationChunksInFlight();
+    std::mutex mutex;
+    std::condition_variable parsed;
+    std::deque<std::unique_ptr<PendingProto>> pending;
+    // Declared last, so that its destructor waits for outstanding parses
+    // before anything they use goes away.
+    BoundedTaskRunner runner(GetSerializationThreadPool(), max_in_flight);
+
+    auto apply_oldest = [&]() {
+      PendingProto* oldest = pending.front().get();
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        parsed.wait(lock, [oldest] { return oldest->parsed; });
+      }
+      CAFFE_ENFORCE(oldest->success, "Couldn't parse Proto for ", oldest->key);
+      if (!keep_device_) {
+        // If we are not keeping the device as the one specified in the
+        // proto, we will set the current device.
+        SetCurrentDevice(&oldest->proto);
+      }
+      const bool stop = apply(oldest->key, oldest->proto);
+      pending.pop_front();
+      return stop;
+    };
+
+    for (; cursor->Valid(); cursor->Next()) {
+      if (cursor->key() == kDeltaCheckpointParentKey) {
+        continue;
+      }
+      auto key = buildBlobNameFromDbKey(cursor->key());
+      if (!filter(key)) {
+        continue;
+      }
+      if (pending.size() >= max_in_flight && apply_oldest()) {
+        return;
+      }
+      pending.emplace_back(new PendingProto);
+      PendingProto* item = pending.back().get();
+      item->key = std::move(key);
+      item->value = cursor->value();
+      runner.Run([this, item, &mutex, &parsed]() {
+        if (IsCompressedValue(item->value)) {
+          Timer timer;
+          const size_t stored = item->value.size();
+          item->value = DecompressValue(item->value);
+          decompression_stats_.Add(
+              item->value.size(), stored, timer.NanoSeconds());
+        }
+        const bool success = item->proto.ParseFromString(item->value);
+        string().swap(item->value);
+        std::lock_guard<std::mutex> lock(mutex);
+        item->success = success;
+        item->parsed = true;
+        parsed.notify_all();
+      });
+    }
+    while (!pending.empty()) {
+      if (apply_oldest()) {
+        return;
+      }
+    }
+  }
+
+  void extractAll(Cursor* cursor) {
+    CAFFE_ENFORCE(cursor, "cursor is not valid");
+    std::unordered_map<string, BlobState> blob_states;
+    int loaded_blobs = 0;
+    forEachBlobProto(
+        cursor,
+        [](const string& /* key */) { return true; },
+        [&](const string& key, const BlobProto& proto) {
+          Blob* blob = ws_->CreateBlob(key);
+          ProcessBlob(blob, proto, &blob_states, key, &loaded_blobs);
+          return false;
+        });
+
+    VLOG(1) << "Loaded " << loaded_blobs << " from db";
+    if (!patching_) {
+      validateBlobStates(blob_states);
+    }
+  }
+
+  void extractFrom(Cursor* cursor, const vector<Blob*>& outputs) {
+    CAFFE_ENFORCE(cursor);
+    std::unordered_map<string, BlobState> blob_states;
+    int loaded_blobs = 0;
+    forEachBlobProto(
+        cursor,
+        [this](const string& key) {
+          if (!output_indices_.count(key)) {
+            VLOG(1) << "Key " << key << " not used. Skipping.";
+            return false;
+          }
+          return true;
+        },
+        [&](const string& key, const BlobProto& proto) {
+          VLOG(2) << "Deserializing blob " << key;
+          auto blobIndex = output_indices_[key];
+          Blob* blob = outputs.at(blobIndex);
+          ProcessBlob(blob, proto, &blob_states, key, &loaded_blobs);
+
+          if (!patching_ && loaded_blobs == OutputSize()) {
+            VLOG(1) << "Read all required blobs";
+            return true;
+          }
+          return false;
+        });
+
+    if (patching_) {
+      VLOG(1) << "Applied " << loaded_blobs << " delta chunks";
+      return;
+    }
+    validateBlobStates(blob_states);
+    VLOG(1) << "Fully loaded " << blob_states.size() << " blobs";
+
+    if (loaded_blobs != OutputSize()) {
+      if (allow_incomplete_ && loaded_blobs < OutputSize()) {
+        VLOG(1) << "Loaded " << loaded_blobs << " blobs out of " << OutputSize()
+                << " blobs from db.";
+        return;
+      }
+      for (const string& output_name : this->def().output()) {
+        if (blob_states.count(output_name) == 0) {
+          LOG(ERROR) << "Failed to load blob: " << output_name;
+        }
+      }
+      CAFFE_THROW(
+          "Expected to load ",
+          OutputSize(),
+          " blobs, got ",
+          loaded_blobs,
+          " only.\n");
+    }
+  }
+
+  string buildBlobNameFromDbKey(const string& dbKey) {
+    string key = dbKey.substr(0, dbKey.find(kChunkIdSeparator));
+    if (!strip_prefix_.empty()) {
+      auto match_pos = key.find(strip_prefix_);
+      if (match_pos != string::npos) {
+        key = key.substr(match_pos + strip_prefix_.size());
+      }
+    }
+    key = add_prefix_ + key;
+    return key;
+  }
+
+  // Same as LoadOp::ProcessBlob(): tracks the sizes of the tensor parts read
+  // so far, so that we can make sure that all chunks were loaded in the end.
+  void ProcessBlob(
+      Blob* blob,
+      const BlobProto& proto,
+      std::unordered_map<string, BlobState>* blob_states_ptr,
+      const string& key,
+      int* loaded_blobs) {
+    if (patching_) {
+      // Chunks of a delta checkpoint overwrite their segment of a blob that
+      // is already fully loaded, so neither reset the blob nor track sizes.
+      blob->Deserialize(proto);
+      (*loaded_blobs)++;
+      return;
+    }
+    auto& blob_states = *blob_states_ptr;
+    if (blob_states.count(key) == 0) {
+      // We reset the blob so that any existing content is destroyed. This
+      // is to guaranee correct device placement: if we are deserializing
+      // into a TensorCUDA, without explicit Reset we might be loading data
+      // into an existing TensorCUDA that has pre-allocated memory on a
+      // different GPU.
+      blob->Reset();
+    }
+    blob->Deserialize(proto);
+    if (!proto.has_tensor()) {
+      // Only tensors can be seen multiple times as chunks.
+      CAFFE_ENFORCE(blob_states.count(key) == 0, "Blob duplicated:", key);
+      blob_states[key] = BlobState();
+      (*loaded_blobs)++;
+      return;
+    }
+
+    CAFFE_ENFORCE(proto.has_tensor());
+    if (blob_states.count(key)) {
+      CAFFE_ENFORCE(blob_states[key].is_tensor, "Must be tensor ", key);
+      CAFFE_ENFORCE(
+          blob_states[key].current_size < blob_states[key].total_size,
+          "Found an extra part for an already filled tensor: ",
+          key);
+      CAFFE_ENFORCE(
+          proto.tensor().has_segment(),
+          "Partial tensor must have a segment: ",
+          key);
+      blob_states[key].current_size +=
+          proto.tensor().segment().end() - proto.tensor().segment().begin();
+      CAFFE_ENFORCE(
+          blob_states[key].current_size <= blob_states[key].total_size,
+          "Tensor parts are bigger than target size for tensor: ",
+          key);
+    } else {
+      const auto& dims = proto.tensor().dims();
+      int64_t total_size = 1;
+      for (const auto& dim : dims) {
+        total_size *= dim;
+      }
+      auto current_size = total_size;
+      if (proto.tensor().has_segment()) {
+        current_size =
+            proto.tensor().segment().end() - proto.tensor().segment().begin();
+      }
+      blob_states[key] =
+          BlobState(total_size, current_size, true /* is_tensor */);
+    }
+
+    if (blob_states[key].current_size == blob_states[key].total_size) {
+      (*loaded_blobs)++;
+    }
+  }
+
+  void validateBlobStates(
+      const std::unordered_map<string, BlobState>& blob_states) {
+    for (const auto& iter : blob_states) {
+      const BlobState& blob_state = iter.second;
+      if (blob_state.is_tensor) {
+        CAFFE_ENFORCE(
+            blob_state.current_size == blob_state.total_size,
+            "Data size mismatch for blob ",
+            iter.first,
+            ". Expected: ",
+            blob_state.total_size,
+            " Read: ",
+            blob_state.current_size);
+      }
+    }
+  }
+
+  Workspace* ws_;
+  bool absolute_path_;
+  string add_prefix_;
+  string strip_prefix_;
+  string db_name_;
+  string db_type_;
+  bool keep_device_;
+  bool load_all_;
+  bool allow_incomplete_;
+  std::map<string, int> output_indices_;
+  CompressionStats decompression_stats_;
+  // Whether the db being extracted is a delta checkpoint.
+  bool patching_{false};
+};
+
+template <>
+inline void CompressedLoadOp<CPUContext>::SetCurrentDevice(BlobProto* proto) {
+  if (proto->has_tensor()) {
+    proto->mutable_tensor()->mutable_device_detail()->set_device_type(CPU);
+  }
+}
+
+// CompressedSaveOp is SaveOp with optional compression of each serialized
+// chunk, see caffe2/utils/compression.h. It takes the same arguments, plus
+// "compression", "compression_shuffle" and "raw_tensors". Chunks reach the
+// acceptor from several serialization threads at once, so they are
+// compressed in parallel as well. Its dbs are read by CompressedLoadOp, or,
+// without compression and raw_tensors, by LoadOp too.
+template <class Context>
+class CompressedSaveOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  CompressedSaveOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        ws_(ws),
+        absolute_path_(
+            OperatorBase::GetSingleArgument<int>("absolute_path", false)),
+        strip_prefix_(
+            OperatorBase::GetSingleArgument<string>("strip_prefix", "")),
+        db_name_(OperatorBase::GetSingleArgument<string>("db", "")),
+        db_type_(OperatorBase::GetSingleArgument<string>("db_type", "")),
+        blob_names_(
+            OperatorBase::GetRepeatedArgument<string>("blob_name_overrides")),
+        compression_(StringToCompressionCodec(
+            OperatorBase::GetSingleArgument<string>("compression", "lz4"))),
+        compression_shuffle_(
+            OperatorBase::GetSingleArgument<int>("compression_shuffle", 4)),
+        raw_tensors_(
+            OperatorBase::GetSingleArgument<bool>("raw_tensors", false)) {
+    CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
+    CAFFE_ENFORCE_GT(db_type_.size(), 0, "Must specify a db type.");
+    CAFFE_ENFORCE(
+        blob_names_.empty() ||
+            blob_names_.size() == OperatorBase::Inputs().size(),
+        "Number of blobs and blob_name_overrides mismatch.");
+    CAFFE_ENFORCE(
+        blob_names_.empty() || strip_prefix_.empty(),
+        "strip_prefix and blob_name_overrides are mutually exclusive.");
+
+    if (blob_names_.empty()) {
+      std::set<std::string> input_names;
+      blob_names_.resize(OperatorBase::Inputs().size());
+      for (int i = 0; i < blob_names_.size(); ++i) {
+        std::string name;
+        if (strip_prefix_.empty()) {
+          name = def().input(i);
+        } else {
+          auto match_pos = def().input(i).find(strip_prefix_);
+          name = def().input(i).substr(
+              match_pos + strip_prefix_.size(), string::npos);
+        }
+        CAFFE_ENFORCE(
+            input_names.insert(name).second, "Duplicated input: ", name);
+        blob_names_[i] = name;
+      }
+    }
+  }
+
+  /**
+   * Makes the next run track the chunks of CPU tensors in *digests: it then
+   * writes a delta checkpoint against parent_db that only stores the chunks
+   * whose digest changed, or, if parent_db is empty, a full checkpoint. In
+   * both cases *digests is updated to describe what this run saw.
+   */
+  void SetDeltaCheckpoint(ChunkDigestMap* digests, const string& parent_db) {
+    digests_ = digests;
+    parent_db_ = parent_db;
+  }
+
+  string FullDbName() const {
+    return absolute_path_ ? db_name_ : (ws_->RootFolder() + "/" + db_name_);
+  }
+
+  bool RunOnDevice() override {
+    string full_db_name = FullDbName();
+    std::unique_ptr<DB> out_db(
+        caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::NEW));
+    CAFFE_ENFORCE(out_db.get(), "Cannot open db for writing: ", full_db_name);
+
+    BlobSerializerBase::SerializationAcceptor acceptor = [&](
+        const std::string& blobName, const std::string& data) {
+      // transaction should take care of locking
+      VLOG(2) << "Sending " << blobName << " blob's data of size "
+              << data.size() << " to db";
+      auto transaction = out_db->NewTransaction();
+      if (compression_ != CompressionCodec::NONE) {
+        Timer timer;
+        const string compressed =
+            CompressValue(data, compression_, compression_shuffle_);
+        compression_stats_.Add(
+            data.size(), compressed.size(), timer.NanoSeconds());
+        transaction->Put(blobName, compressed);
+      } else {
+        transaction->Put(blobName, data);
+      }
+      transaction->Commit();
+    };
+
+    const vector<const Blob*>& inputs = OperatorBase::Inputs();
+    if (digests_) {
+      if (!parent_db_.empty()) {
+        // First, see kDeltaCheckpointParentKey.
+        auto transaction = out_db->NewTransaction();
+        transaction->Put(
+            kDeltaCheckpointParentKey,
+            RelativeDbPath(full_db_name, parent_db_));
+        transaction->Commit();
+      }
+      SaveTrackingChunks(inputs, acceptor);
+    } else {
+      for (int i = 0; i < inputs.size(); ++i) {
+        serialize(*inputs[i], blob_names_[i], acceptor);
+      }
+    }
+    out_db->Close();
+    compression_stats_.Report("Compressed", full_db_name);
+    return true;
+  }
+
+ private:
+  Workspace* ws_;
+  bool absolute_path_;
+  string strip_prefix_;
+  string db_name_;
+  string db_type_;
+  std::vector<std::string> blob_names_;
+  CompressionCodec compression_;
+  int compression_shuffle_;
+  // Whether to store CPU tensors of fixed-size types as raw bytes, see
+  // RawTensorSerializer.
+  bool raw_tensors_;
+  CompressionStats compression_stats_;
+  // Delta checkpoint state, see SetDeltaCheckpoint().
+  ChunkDigestMap* digests_{nullptr};
+  string parent_db_;
+
+  void serialize(
+      const Blob& blob,
+      const string& name,
+      BlobSerializerBase::SerializationAcceptor acceptor) {
+    if (raw_tensors_) {
+      SerializeBlobAsRawTensor(blob, name, acceptor);
+    } else {
+      blob.Serialize(name, acceptor);
+    }
+  }
+
+  // Serializes the inputs chunk by chunk like Blob::Serialize() does,
+  // skipping chunks of CPU tensors whose digest did not change since the
+  // parent checkpoint. Other blobs are always stored whole.
+  void SaveTrackingChunks(
+      const vector<const Blob*>& inputs,
+      BlobSerializerBase::SerializationAcceptor acceptor) {
+    const int64_t chunk_size = FLAGS_caffe2_tensor_chunk_size;
+    std::atomic<int64_t> total_chunks(0);
+    std::atomic<int64_t> written_chunks(0);
+    BoundedTaskRunner runner(
+        GetSerializationThreadPool(), SerializationChunksInFlight());
+    for (int i = 0; i < inputs.size(); ++i) {
+      const string& name = blob_names_[i];
+      // Only plain old data can be hashed byte by byte.
+      if (!inputs[i]->IsType<TensorCPU>() ||
+          inputs[i]->Get<TensorCPU>().meta().copy()) {
+        digests_->erase(name);
+        serialize(*inputs[i], name, acceptor);
+        continue;
+      }
+      const TensorCPU& tensor = inputs[i]->Get<TensorCPU>();
+      const bool raw = raw_tensors_ &&
+          RawTensorSerializer<CPUContext>::CanSerialize(*inputs[i]);
+      const int64_t num_chunks =
+          std::max<int64_t>(1, (tensor.size() + chunk_size - 1) / chunk_size);
+      TensorChunkDigests& state = (*digests_)[name];
+      const bool all_dirty = parent_db_.empty() ||
+          state.dims != tensor.dims() || state.meta != tensor.meta() ||
+          state.chunk_size != chunk_size ||
+          static_cast<int64_t>(state.digests.size()) != num_chunks;
+      state.dims = tensor.dims();
+      state.meta = tensor.meta();
+      state.chunk_size = chunk_size;
+      state.digests.resize(num_chunks);
+      total_chunks += num_chunks;
+      for (int64_t chunk = 0; chunk < num_chunks; ++chunk) {
+        std::array<uint64_t, 2>* digest = &state.digests[chunk];
+        runner.Run([&, chunk, digest, all_dirty, raw]() {
+          const int64_t begin = chunk * chunk_size;
+          const int64_t count =
+              std::min<int64_t>(chunk_size, tensor.size() - begin);
+          const size_t nbytes = count * tensor.itemsize();
+          CAFFE_ENFORCE_LE(nbytes, std::numeric_limits<int>::max());
+          std::array<uint64_t, 2> current = {{0, 0}};
+          if (nbytes) {
+            MurmurHash3_x64_128(
+                static_cast<const char*>(tensor.raw_data()) +
+                    begin * tensor.itemsize(),
+                static_cast<int>(nbytes),
+                0,
+                current.data());
+          }
+          if (!all_dirty && current == *digest) {
+            return;
+          }
+          *digest = current;
+          BlobProto blob_proto;
+          blob_proto.set_name(name);
+          blob_proto.mutable_tensor()->set_name(name);
+          if (raw) {
+            blob_proto.set_type(kRawTensorBlobType);
+            RawTensorSerializer<CPUContext>().Serialize(
+                tensor, name, blob_proto.mutable_tensor(), begin, chunk_size);
+          } else {
+            blob_proto.set_type(kTensorBlobType);
+            TensorSerializer<CPUContext>().Serialize(
+                tensor, name, blob_proto.mutable_tensor(), begin, chunk_size);
+          }
+          acceptor(
+              MakeString(name, kChunkIdSeparator, chunk),
+              blob_proto.SerializeAsString());
+          ++written_chunks;
+        });
+      }
+    }
+    runner.Wait();
+    VLOG(1) << (parent_db_.empty() ? "Full" : "Delta") << " checkpoint wrote "
+            << written_chunks << " of " << total_chunks << " tensor chunks";
+  }
+};
+
+// DeltaCheckpointOp is CheckpointOp over a CompressedSaveOp, whose
+// checkpoints in between full ones only store the chunks (of
+// caffe2_tensor_chunk_size elements) of CPU tensors that changed since the
+// previous checkpoint, and the name of that checkpoint relative to it.
+// CompressedLoadOp follows that chain back to the last full checkpoint, so
+// none of its members may be deleted while a later delta is still needed, but
+// the chain can be moved as a whole.
+// The file pattern in db_name should be a format string that can be passed
+// into sprintf with an int argument specifying the current iteration, as for
+// CheckpointOp. Every full_every-th checkpoint after a full one is full again.
+template <class Context>
+class DeltaCheckpointOp final : public Operator<Context> {
+ public:
+  DeltaCheckpointOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        db_pattern_(OperatorBase::GetSingleArgument<string>("db", "")),
+        every_(OperatorBase::GetSingleArgument<int>("every", 1)),
+        full_every_(OperatorBase::GetSingleArgument<int>("full_every", 10)),
+        ws_(ws),
+        save_op_def_(operator_def) {
+    CAFFE_ENFORCE_GT(
+        db_pattern_.size(), 0, "Must specify a checkpoint file pattern.");
+    CAFFE_ENFORCE_GT(every_, 0, "Checkpoint interval should be positive.");
+    CAFFE_ENFORCE_GT(full_every_, 0, "full_every should be positive.");
+    if (every_ == 1) {
+      // Just issue a warning, but it's totally legal so we don't do anything.
+      LOG(WARNING) << "It seems that we are checkpointting every iteration. "
+                   << "Is that intended?";
+    }
+    save_op_def_.set_type("CompressedSave");
+  }
+
+  bool RunOnDevice() override {
+    int64_t iter =
+        OperatorBase::Input<TensorCPU>(0).template data<int64_t>()[0];
+    if (iter % every_ != 0) {
+      return true;
+    }
+    GetMutableArgument("db", true, &save_op_def_)
+        ->set_s(FormatString(db_pattern_, iter));
+    CompressedSaveOp<Context> sub_op(save_op_def_, ws_);
+    const bool full = last_db_.empty() || deltas_since_full_ >= full_every_;
+    sub_op.SetDeltaCheckpoint(&digests_, full ? "" : last_db_);
+    bool success = false;
+    try {
+      success = sub_op.Run();
+    } catch (...) {
+      // The digests may no longer match what is on disk.
+      digests_.clear();
+      last_db_.clear();
+      throw;
+    }
+    if (success) {
+      last_db_ = sub_op.FullDbName();
+      deltas_since_full_ = full ? 0 : deltas_since_full_ + 1;
+    } else {
+      digests_.clear();
+      last_db_.clear();
+    }
+    return success;
+  }
+
+ private:
+  string db_pattern_;
+  int every_;
+  int full_every_;
+  int deltas_since_full_{0};
+  string last_db_;
+  ChunkDigestMap digests_;
+  Workspace* ws_;
+  OperatorDef save_op_def_;
+};
+
+// Registers the ops above and their schemas, once per process however many
+// translation units include this header: the REGISTER_ and OPERATOR_SCHEMA
+// macros cannot be used in a header, as a second registration of a key exits
+// the process.
+inline bool RegisterCompressedLoadSaveOps() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("CompressedLoad")) {
+      CPUOperatorRegistry()->Register(
+          "CompressedLoad",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CompressedLoadOp<CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("CompressedSave")) {
+      CPUOperatorRegistry()->Register(
+          "CompressedSave",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CompressedSaveOp<CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("DeltaCheckpoint")) {
+      CPUOperatorRegistry()->Register(
+          "DeltaCheckpoint",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              DeltaCheckpointOp<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("CompressedLoad")) {
+      OpSchemaRegistry::NewSchema("CompressedLoad", __FILE__, __LINE__)
+          .NumInputs(0, 1)
+          .NumOutputs(0, INT_MAX)
+          .SetDoc(R"DOC(
+The Load operator for dbs written by CompressedSave. Takes the arguments of
+Load. Values compressed by CompressedSave are decompressed and parsed on the
+serialization thread pool, ahead of being deserialized in db order; other
+values load as they do with Load. A delta checkpoint written by
+DeltaCheckpoint is loaded on top of its parent, which is loaded first.
+)DOC")
+          .Arg(
+              "absolute_path",
+              "(int, default 0) if set, use the db path directly and do not "
+              "prepend the current root folder of the workspace.")
+          .Arg("add_prefix", "(string, default \"\") prefix of blob names.")
+          .Arg(
+              "strip_prefix",
+              "(string, default \"\") prefix to strip from the db keys.")
+          .Arg("db", "(string) the path to the db to load.")
+          .Arg("db_type", "(string) the type of the db.")
+          .Arg(
+              "keep_device",
+              "(int, default 0) if nonzero, the blobs are loaded into the "
+              "device that is specified in the serialized BlobProto.")
+          .Arg(
+              "load_all",
+              "(int, default 0) if nonzero, will load all blobs pointed to "
+              "by the db to the workspace overwriting/creating blobs as "
+              "needed.")
+          .Arg(
+              "allow_incomplete",
+              "(bool, default false) if true, will allow not loading all "
+              "the output blobs specified in the outputs")
+          .Input(
+              0,
+              "X, Y, ...",
+              "[OPTIONAL] An already opened DBReader to load from.");
+    }
+    if (!OpSchemaRegistry::Schema("CompressedSave")) {
+      OpSchemaRegistry::NewSchema("CompressedSave", __FILE__, __LINE__)
+          .NumInputs(1, INT_MAX)
+          .NumOutputs(0)
+          .SetDoc(R"DOC(
+The Save operator with each serialized chunk byte-shuffled and compressed into
+a standard LZ4 frame, on the serialization threads. Takes the arguments of
+Save, logs the compression ratio and speed, and stores a chunk as it is when
+compression does not shrink it. Load the db with CompressedLoad.
+)DOC")
+          .Arg(
+              "absolute_path",
+              "(int, default 0) if set, use the db path directly and do not "
+              "prepend the current root folder of the workspace.")
+          .Arg(
+              "strip_prefix",
+              "(string, default \"\") prefix to strip from the blob names.")
+          .Arg(
+              "blob_name_overrides",
+              "(list of strings) if set, used instead of the input names.")
+          .Arg("db", "(string) the path to the db to save to.")
+          .Arg("db_type", "(string) the type of the db.")
+          .Arg(
+              "compression",
+              "(string, default \"lz4\") the codec, \"lz4\" or \"none\".")
+          .Arg(
+              "compression_shuffle",
+              "(int, default 4) the byte-shuffle stride, e.g. the item size "
+              "of the tensors; 1 does not shuffle.")
+          .Arg(
+              "raw_tensors",
+              "(bool, default false) if set, CPU tensors of fixed-size types "
+              "are stored as raw little endian bytes rather than in the typed "
+              "fields of TensorProto. Only programs that include "
+              "caffe2/core/raw_tensor_serialization.h can load them.")
+          .Input(0, "X, Y, ...", "The blobs to save.");
+    }
+    if (!OpSchemaRegistry::Schema("DeltaCheckpoint")) {
+      OpSchemaRegistry::NewSchema("DeltaCheckpoint", __FILE__, __LINE__)
+          .NumInputs(1, INT_MAX)
+          .NumOutputs(0)
+          .SetDoc(R"DOC(
+The Checkpoint operator over CompressedSave, writing delta checkpoints: those
+in between full ones only store the chunks (of caffe2_tensor_chunk_size
+elements) of CPU tensors that changed since the previous checkpoint, found by
+comparing chunk digests, plus the path of that checkpoint relative to the new
+one. Load them with CompressedLoad, which loads the chain of parents back to
+the last full checkpoint first; keep the whole chain, or move it as a whole.
+Takes the arguments of Checkpoint and CompressedSave.
+)DOC")
+          .Arg(
+              "db",
+              "(string) a format string for the checkpoint db names, given "
+              "the iteration, e.g. \"/path/to/checkpoint_at_%d.pb\".")
+          .Arg("db_type", "(string) the type of the db.")
+          .Arg(
+              "every",
+              "(int, default 1) the checkpointing is carried out when "
+              "(iter mod every) is zero.")
+          .Arg(
+              "full_every",
+              "(int, default 10) the number of delta checkpoints after a "
+              "full one until the next full one.")
+          .Input(
+              0,
+              "iter",
+              "The iteration, an int64 tensor of a single element.")
+          .Input(1, "X, Y, ...", "The blobs to checkpoint.");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_compressed_load_save_ops_registered =
+    RegisterCompressedLoadSaveOps();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_COMPRESSED_LOAD_SAVE_OP_H_
@@ -5,7 +5,9 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
 #include "caffe2/core/tensor.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
 namespace caffe2 {
@@ -399,6 +401,192 @@ bool DivGradientOp<Context>::RunOnDevice() {
           Eigen##name##Functor,                                              \
           output_type>)
 
+namespace detail {
+
+// The float arithmetic of SIMDBinaryElementwiseOp, over Eigen arrays and
+// their broadcasts.
+#define CAFFE2_SIMD_BINARY_FUNCTOR(name, op)                         \
+  struct SIMD##name##Functor {                                       \
+    template <typename A, typename B>                                \
+    static auto Apply(const A& a, const B& b) -> decltype(a op b) {  \
+      return a op b;                                                 \
+    }                                                                \
+  };
+CAFFE2_SIMD_BINARY_FUNCTOR(Add, +)
+CAFFE2_SIMD_BINARY_FUNCTOR(Sub, -)
+CAFFE2_SIMD_BINARY_FUNCTOR(Mul, *)
+CAFFE2_SIMD_BINARY_FUNCTOR(Div, /)
+#undef CAFFE2_SIMD_BINARY_FUNCTOR
+
+} // namespace detail
+
+/**
+ * Add, Sub, Mul and Div for float CPU inputs with the SIMD engine: the
+ * arithmetic of BinaryElementwiseOp, split over the thread pool by
+ * ParallelFor(). Other input types run the default engine operator.
+ */
+template <class Functor>
+class SIMDBinaryElementwiseOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDBinaryElementwiseOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(bool, "broadcast", enable_broadcast_, 0),
+        OP_SINGLE_ARG(int, "axis", axis_, -1),
+        OP_SINGLE_ARG(string, "axis_str", axis_str_, ""),
+        OP_SINGLE_ARG(string, "order", order_, "NCHW"),
+        fallback_(CreateDefaultEngineOperator(operator_def, ws)) {
+    // The default engine operator has checked the arguments already.
+    if (enable_broadcast_ && axis_ == -1 && axis_str_.size()) {
+      axis_ = order_.find(axis_str_);
+    }
+  }
+
+  bool RunOnDevice() override {
+    const auto& A = Input(0);
+    const auto& B = Input(1);
+    if (!A.IsType<float>() || !B.IsType<float>()) {
+      return fallback_->Run();
+    }
+    auto* C = Output(0);
+    CAFFE_ENFORCE(
+        &B != C || !enable_broadcast_,
+        "In-place is allowed only with the first tensor when broadcasting");
+    C->ResizeLike(A);
+    const float* Adata = A.data<float>();
+    const float* Bdata = B.data<float>();
+    float* Cdata = C->mutable_data<float>();
+    if (!enable_broadcast_) {
+      CAFFE_ENFORCE_EQ(
+          A.dims(),
+          B.dims(),
+          "Dimension mismatch - did you forget to set broadcast=1?");
+      ParallelFor(A.size(), [&](size_t begin, size_t end) {
+        EigenVectorArrayMap<float>(Cdata + begin, end - begin) = Functor::Apply(
+            ConstEigenVectorArrayMap<float>(Adata + begin, end - begin),
+            ConstEigenVectorArrayMap<float>(Bdata + begin, end - begin));
+      });
+    } else if (B.size() == 1) {
+      const float b = Bdata[0];
+      ParallelFor(A.size(), [&](size_t begin, size_t end) {
+        EigenVectorArrayMap<float>(Cdata + begin, end - begin) = Functor::Apply(
+            ConstEigenVectorArrayMap<float>(Adata + begin, end - begin), b);
+      });
+    } else {
+      CAFFE_ENFORCE_GT(
+          A.ndim(),
+          B.ndim(),
+          "If you are doing broadcasting, input1 should have "
+          "a smaller number of dimensions.");
+      const int axis = (axis_ == -1 ? A.ndim() - B.ndim() : axis_);
+      CAFFE_ENFORCE(
+          axis >= 0 && axis < A.ndim(),
+          "Broadcast axis should be in the range of the number "
+          "of dimensions of the first input.");
+      size_t pre = 1, n = 1, post = 1;
+      for (int i = 0; i < axis; ++i) {
+        pre *= A.dim(i);
+      }
+      for (int i = 0; i < B.ndim(); ++i) {
+        CAFFE_ENFORCE_EQ(
+            A.dim(i + axis), B.dim(i), "Broadcast dimension mismatch.");
+        n *= B.dim(i);
+      }
+      for (int i = axis + B.ndim(); i < A.ndim(); ++i) {
+        post *= A.dim(i);
+      }
+      RunBroadcastInParallel(Adata, Bdata, Cdata, pre, n, post);
+    }
+    return true;
+  }
+
+ private:
+  // Broadcasts b over groups of n rows of post elements of a, the rows
+  // starting at row offset of b.
+  static void RunBroadcast(
+      const float* a,
+      const float* b,
+      float* out,
+      size_t groups,
+      size_t n,
+      size_t post) {
+    if (post == 1) {
+      EigenArrayMap<float>(out, n, groups) = Functor::Apply(
+          ConstEigenArrayMap<float>(a, n, groups).colwise(),
+          ConstEigenVectorArrayMap<float>(b, n));
+      return;
+    }
+    for (size_t i = 0; i < groups; ++i) {
+      EigenArrayMap<float>(out + i * n * post, post, n) = Functor::Apply(
+          ConstEigenArrayMap<float>(a + i * n * post, post, n).rowwise(),
+          Eigen::Map<const Eigen::Array<float, 1, Eigen::Dynamic>>(b, n));
+    }
+  }
+
+  // Splits a broadcast of B over the pre x n x post elements of A into
+  // chunks of the pre * n rows of post elements. Each chunk is broadcast with
+  // one call for the complete groups of n rows it covers, and one for each
+  // partial group at its ends.
+  static void RunBroadcastInParallel(
+      const float* Adata,
+      const float* Bdata,
+      float* Cdata,
+      size_t pre,
+      size_t n,
+      size_t post) {
+    auto run_rows = [&](size_t begin, size_t end) {
+      while (begin < end) {
+        const size_t offset = begin % n;
+        size_t groups = 1;
+        size_t cols = std::min(n - offset, end - begin);
+        if (offset == 0 && end - begin >= n) {
+          groups = (end - begin) / n;
+        }
+        RunBroadcast(
+            Adata + begin * post,
+            Bdata + offset,
+            Cdata + begin * post,
+            groups,
+            cols,
+            post);
+        begin += groups * cols;
+      }
+    };
+    ParallelFor(
+        pre * n,
+        run_rows,
+        std::max<size_t>(CAFFE2_PARALLEL_GRAIN / post, 1),
+        std::max<size_t>(kParallelAlign / post, 1));
+  }
+
+  bool enable_broadcast_;
+  int axis_;
+  string axis_str_;
+  string order_;
+  unique_ptr<OperatorBase> fallback_;
+};
+
+// Registers SIMDBinaryElementwiseOp with the SIMD engine, once per process.
+inline bool RegisterSIMDBinaryElementwiseOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<
+        SIMDBinaryElementwiseOp<detail::SIMDAddFunctor>>("Add");
+    RegisterSIMDEngineOperator<
+        SIMDBinaryElementwiseOp<detail::SIMDSubFunctor>>("Sub");
+    RegisterSIMDEngineOperator<
+        SIMDBinaryElementwiseOp<detail::SIMDMulFunctor>>("Mul");
+    RegisterSIMDEngineOperator<
+        SIMDBinaryElementwiseOp<detail::SIMDDivFunctor>>("Div");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_binary_elementwise_ops_registered =
+    RegisterSIMDBinaryElementwiseOps();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_ELEMENTWISE_OP_H_
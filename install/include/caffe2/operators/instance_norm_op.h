@@ -3,9 +3,125 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
 namespace caffe2 {
+namespace detail {
+
+// Values InstanceNormNCHW() takes the statistics of at a time.
+constexpr int kInstanceNormBlock = 512;
+
+/**
+ * Float CPU instance normalization in NCHW order, over the N * C planes of
+ * HW values of X: Y = (X - mean) * inv_stdev * scale + bias, with the mean
+ * and inv_stdev = 1 / sqrt(var + epsilon) of each plane.
+ *
+ * The statistics take a single pass over the plane: each block of values
+ * gets its own mean and sum of squared deviations while in L1, merged into
+ * the running ones with the parallel form of Welford's update (Chan et al.),
+ * which stays accurate where E[x^2] - E[x]^2 would cancel. Normalization is
+ * then a subtract and a multiply-add per value; folding the mean into the
+ * shift instead would cancel as badly for planes with a large mean and a
+ * small variance. Planes are split over the thread pool.
+ */
+inline void InstanceNormNCHW(
+    int N,
+    int C,
+    int HW,
+    float epsilon,
+    const float* scale,
+    const float* bias,
+    const float* X,
+    float* Y,
+    float* mean,
+    float* inv_stdev) {
+  ParallelFor(
+      static_cast<size_t>(N) * C,
+      [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const float* x = X + i * HW;
+          double count = 0;
+          double m = 0;
+          double m2 = 0;
+          for (int j = 0; j < HW; j += kInstanceNormBlock) {
+            const int len = std::min(kInstanceNormBlock, HW - j);
+            ConstEigenVectorArrayMap<float> block(x + j, len);
+            const float block_mean = block.mean();
+            const float block_m2 = (block - block_mean).square().sum();
+            const double delta = block_mean - m;
+            const double total = count + len;
+            m += delta * len / total;
+            m2 += block_m2 + delta * delta * count * len / total;
+            count = total;
+          }
+          const int c = i % C;
+          mean[i] = m;
+          inv_stdev[i] = 1 / std::sqrt(static_cast<float>(m2 / HW) + epsilon);
+          const float a = inv_stdev[i] * scale[c];
+          EigenVectorArrayMap<float>(Y + i * HW, HW) =
+              (ConstEigenVectorArrayMap<float>(x, HW) - mean[i]) * a + bias[c];
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / HW, 1),
+      1);
+}
+
+/**
+ * InstanceNormNCHW() in NHWC order. The statistics of a range of channels
+ * of an image take one pass over its HW rows with Welford's update, which
+ * vectorizes across the channels; the normalization is a second pass. The
+ * N * C (image, channel) pairs are split over the thread pool.
+ */
+inline void InstanceNormNHWC(
+    int N,
+    int C,
+    int HW,
+    float epsilon,
+    const float* scale,
+    const float* bias,
+    const float* X,
+    float* Y,
+    float* mean,
+    float* inv_stdev) {
+  ParallelFor(
+      static_cast<size_t>(N) * C,
+      [=](size_t begin, size_t end) {
+        Eigen::ArrayXf m2_buffer(C);
+        while (begin < end) {
+          const int n = begin / C;
+          const int c = begin % C;
+          const int len = std::min<size_t>(C - c, end - begin);
+          const size_t offset = static_cast<size_t>(n) * HW * C + c;
+          auto row = [&](int j) {
+            return ConstEigenVectorArrayMap<float>(X + offset + j * C, len);
+          };
+          EigenVectorArrayMap<float> m(mean + begin, len);
+          EigenVectorArrayMap<float> inv(inv_stdev + begin, len);
+          auto m2 = m2_buffer.head(len);
+          m.setZero();
+          m2.setZero();
+          for (int j = 0; j < HW; ++j) {
+            const auto delta = (row(j) - m).eval();
+            m += delta * (1.f / (j + 1));
+            m2 += delta * (row(j) - m);
+          }
+          inv = (m2 / HW + epsilon).rsqrt();
+          // m2 is no longer needed: reuse it for the scale of Y.
+          m2 = inv * ConstEigenVectorArrayMap<float>(scale + c, len);
+          ConstEigenVectorArrayMap<float> b(bias + c, len);
+          for (int j = 0; j < HW; ++j) {
+            EigenVectorArrayMap<float>(Y + offset + j * C, len) =
+                (row(j) - m) * m2 + b;
+          }
+          begin += len;
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / HW, 1));
+}
+
+} // namespace detail
 
 template <typename T, class Context>
 class InstanceNormOp : public Operator<Context> {
@@ -88,6 +204,102 @@ class InstanceNormGradientOp : public Operator<Context> {
   OUTPUT_TAGS(INPUT_GRAD, SCALE_GRAD, BIAS_GRAD);
 };
 
+
+/**
+ * InstanceNorm on float CPU tensors for the SIMD engine, see simd_engine.h:
+ * the statistics take one read of X and the normalization one subtract and
+ * multiply-add per value, with the kernels above, in place of the separate
+ * mean, variance and normalization passes of InstanceNormOp. MEAN and
+ * INV_STDEV keep their meaning for InstanceNormGradientOp.
+ */
+class SIMDInstanceNormOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDInstanceNormOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        order_(StringToStorageOrder(
+            OperatorBase::GetSingleArgument<string>("order", "NCHW"))) {
+    CAFFE_ENFORCE(epsilon_ >= 0, "Must pass a nonnegative epsilon.");
+  }
+
+  bool RunOnDevice() override {
+    const auto& X = Input(INPUT);
+    CAFFE_ENFORCE_EQ(X.ndim(), 4);
+    const bool nchw = order_ == StorageOrder::NCHW;
+    const int N = X.dim32(0);
+    const int C = X.dim32(nchw ? 1 : 3);
+    const int HW = X.dim32(nchw ? 2 : 1) * X.dim32(nchw ? 3 : 2);
+    CAFFE_ENFORCE_EQ(Input(SCALE).size(), C);
+    CAFFE_ENFORCE_EQ(Input(BIAS).size(), C);
+    auto* Y = Output(OUTPUT);
+    auto* mean = OutputSize() >= 2 ? Output(MEAN) : &mean_;
+    auto* inv_stdev = OutputSize() >= 3 ? Output(INV_STDEV) : &inv_stdev_;
+    Y->ResizeLike(X);
+    mean->Resize(N, C);
+    inv_stdev->Resize(N, C);
+    if (X.size() == 0) {
+      return true;
+    }
+    const float* scale = Input(SCALE).data<float>();
+    const float* bias = Input(BIAS).data<float>();
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    float* mean_data = mean->mutable_data<float>();
+    float* inv_stdev_data = inv_stdev->mutable_data<float>();
+    if (nchw) {
+      detail::InstanceNormNCHW(
+          N,
+          C,
+          HW,
+          epsilon_,
+          scale,
+          bias,
+          Xdata,
+          Ydata,
+          mean_data,
+          inv_stdev_data);
+    } else {
+      detail::InstanceNormNHWC(
+          N,
+          C,
+          HW,
+          epsilon_,
+          scale,
+          bias,
+          Xdata,
+          Ydata,
+          mean_data,
+          inv_stdev_data);
+    }
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(INPUT, SCALE, BIAS);
+  OUTPUT_TAGS(OUTPUT, MEAN, INV_STDEV);
+
+ private:
+  float epsilon_;
+  StorageOrder order_;
+  // MEAN and INV_STDEV, when those outputs are not requested.
+  TensorCPU mean_;
+  TensorCPU inv_stdev_;
+};
+
+// Registers SIMDInstanceNormOp with the SIMD engine, once per process.
+inline bool RegisterSIMDInstanceNormOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDInstanceNormOp>("InstanceNorm");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_instance_norm_op_registered = RegisterSIMDInstanceNormOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_INSTANCE_NORM_OP_H_
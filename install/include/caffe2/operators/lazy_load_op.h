@@ -0,0 +1,523 @@
+#ifndef CAFFE2_OPERATORS_LAZY_LOAD_OP_H_
+#define CAFFE2_OPERATORS_LAZY_LOAD_OP_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "caffe2/core/db.h"
+#include "caffe2/core/lazy_blob.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/serialization_thread_pool.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/operators/compressed_load_save_op.h"
+#include "caffe2/utils/compression.h"
+
+namespace caffe2 {
+
+// Returns the blobs a net reads, in the order of their first use, e.g. to
+// pass as "prefetch_order" to a LazyLoad op of the net's parameters.
+inline vector<string> BlobsInFirstUseOrder(const NetDef& net) {
+  vector<string> order;
+  std::unordered_set<string> seen;
+  for (const auto& op : net.op()) {
+    for (const auto& input : op.input()) {
+      if (seen.insert(input).second) {
+        order.push_back(input);
+      }
+    }
+  }
+  return order;
+}
+
+// Backs the LazyBlob stubs registered by a LazyLoadOp. It keeps the db open
+// and remembers which records hold each blob: their keys if the db can seek,
+// and otherwise the records themselves. A blob is decompressed, parsed and
+// deserialized when its stub is materialized (see MaterializeLazyBlob()), or
+// ahead of that by StartPrefetch(), in which case materializing only swaps
+// the prefetched content in.
+class LazyBlobSource : public std::enable_shared_from_this<LazyBlobSource> {
+ public:
+  // If device is null, blobs keep the device stored in the db.
+  LazyBlobSource(
+      std::unique_ptr<DB> db,
+      const string& db_name,
+      const DeviceOption* device)
+      : db_(std::move(db)),
+        cursor_(db_->NewCursor()),
+        seekable_(cursor_->SupportsSeek()),
+        db_name_(db_name),
+        has_device_(device != nullptr) {
+    if (device) {
+      device_ = *device;
+    }
+  }
+
+  ~LazyBlobSource() {
+    LOG_IF(INFO, !entries_.empty())
+        << "Lazy load of " << db_name_ << ": " << used_ << " of "
+        << entries_.size() << " blobs used, " << prefetched_used_
+        << " of them prefetched.";
+  }
+
+  Cursor* cursor() {
+    return cursor_.get();
+  }
+
+  // Adds the record the cursor is at to the records of blob name.
+  void AddRecord(const string& name) {
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+      it = index_.emplace(name, entries_.size()).first;
+      entries_.emplace_back(new Entry);
+      entries_.back()->name = name;
+    }
+    entries_[it->second]->records.push_back(
+        seekable_ ? cursor_->key() : cursor_->value());
+  }
+
+  bool Has(const string& name) const {
+    return index_.count(name) > 0;
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  const string& name(size_t index) const {
+    return entries_[index]->name;
+  }
+
+  LazyBlob::Loader Loader(const string& name) {
+    std::shared_ptr<LazyBlobSource> self = shared_from_this();
+    const size_t index = index_.at(name);
+    return [self, index](Blob* blob) { self->Load(index, blob); };
+  }
+
+  // Decodes blobs ahead of use on the serialization pool, first those in
+  // order, and then the others in db order. The task does not keep the
+  // source alive, so it stops once all stubs are gone.
+  void StartPrefetch(const vector<string>& order) {
+    vector<size_t> indices;
+    vector<bool> queued(entries_.size(), false);
+    for (const auto& name : order) {
+      auto it = index_.find(name);
+      if (it != index_.end() && !queued[it->second]) {
+        queued[it->second] = true;
+        indices.push_back(it->second);
+      }
+    }
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (!queued[i]) {
+        indices.push_back(i);
+      }
+    }
+    std::weak_ptr<LazyBlobSource> weak = shared_from_this();
+    GetSerializationThreadPool()->runTask([weak, indices]() {
+      for (size_t index : indices) {
+        auto source = weak.lock();
+        if (!source) {
+          return;
+        }
+        source->Prefetch(index);
+      }
+      if (auto source = weak.lock()) {
+        LOG(INFO) << "Prefetched the lazy blobs of " << source->db_name_
+                  << " " << source->timer_.MilliSeconds()
+                  << " ms after the load started.";
+      }
+    });
+  }
+
+ private:
+  enum class State { PENDING, LOADING, READY, TAKEN };
+  struct Entry {
+    string name;
+    // Db keys, or values if the db cannot seek, of the blob's chunks.
+    vector<string> records;
+    State state{State::PENDING};
+    // Content decoded by Prefetch() until the stub takes it.
+    Blob staged;
+  };
+
+  void Load(size_t index, Blob* blob) {
+    Entry& entry = *entries_[index];
+    if (used_++ == 0) {
+      // The first blob a net reads is the best proxy we have for the time
+      // until the first inference could start.
+      LOG(INFO) << "First lazily loaded blob " << entry.name << " of "
+                << db_name_ << " requested " << timer_.MilliSeconds()
+                << " ms after the load started.";
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    state_changed_.wait(
+        lock, [&entry] { return entry.state != State::LOADING; });
+    if (entry.state == State::READY) {
+      blob->swap(entry.staged);
+      entry.state = State::TAKEN;
+      prefetched_used_++;
+      return;
+    }
+    entry.state = State::LOADING;
+    lock.unlock();
+    try {
+      Decode(&entry, blob);
+    } catch (...) {
+      Finish(&entry, State::PENDING);
+      throw;
+    }
+    Finish(&entry, State::TAKEN);
+  }
+
+  void Prefetch(size_t index) {
+    Entry& entry = *entries_[index];
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (entry.state != State::PENDING) {
+        return;
+      }
+      entry.state = State::LOADING;
+    }
+    try {
+      Decode(&entry, &entry.staged);
+    } catch (const std::exception& e) {
+      // Leave it to the first access to retry and report the error.
+      LOG(WARNING) << "Prefetching blob " << entry.name << " failed: "
+                   << e.what();
+      entry.staged.Reset();
+      Finish(&entry, State::PENDING);
+      return;
+    }
+    Finish(&entry, State::READY);
+  }
+
+  void Finish(Entry* entry, State state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->state = state;
+    if (state == State::TAKEN && !seekable_) {
+      vector<string>().swap(entry->records);
+    }
+    state_changed_.notify_all();
+  }
+
+  string ReadRecord(const Entry& entry, size_t i) {
+    if (!seekable_) {
+      return entry.records[i];
+    }
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    cursor_->Seek(entry.records[i]);
+    CAFFE_ENFORCE(
+        cursor_->Valid() && cursor_->key() == entry.records[i],
+        "Record ",
+        entry.records[i],
+        " disappeared from ",
+        db_name_);
+    return cursor_->value();
+  }
+
+  // Same checks as LoadOp::ProcessBlob(), for all chunks of one blob.
+  void Decode(const Entry* entry, Blob* blob) {
+    blob->Reset();
+    int64_t total_size = 0;
+    int64_t current_size = 0;
+    bool is_tensor = false;
+    for (size_t i = 0; i < entry->records.size(); ++i) {
+      string value = ReadRecord(*entry, i);
+      if (IsCompressedValue(value)) {
+        value = DecompressValue(value);
+      }
+      BlobProto proto;
+      CAFFE_ENFORCE(
+          proto.ParseFromString(value), "Couldn't parse Proto for ",
+          entry->name);
+      if (!proto.has_tensor()) {
+        CAFFE_ENFORCE_EQ(
+            entry->records.size(), 1, "Blob duplicated:", entry->name);
+        blob->Deserialize(proto);
+        return;
+      }
+      if (has_device_) {
+        proto.mutable_tensor()->mutable_device_detail()->CopyFrom(device_);
+      }
+      blob->Deserialize(proto);
+      const auto& tensor = proto.tensor();
+      if (!is_tensor) {
+        is_tensor = true;
+        total_size = 1;
+        for (const auto& dim : tensor.dims()) {
+          total_size *= dim;
+        }
+      } else {
+        CAFFE_ENFORCE(
+            tensor.has_segment(),
+            "Partial tensor must have a segment: ",
+            entry->name);
+      }
+      current_size += tensor.has_segment()
+          ? tensor.segment().end() - tensor.segment().begin()
+          : total_size;
+    }
+    CAFFE_ENFORCE_EQ(
+        current_size,
+        total_size,
+        "Data size mismatch for blob ",
+        entry->name);
+  }
+
+  std::unique_ptr<DB> db_;
+  std::unique_ptr<Cursor> cursor_;
+  // Serializes the use of cursor_ once the stubs are registered.
+  std::mutex db_mutex_;
+  const bool seekable_;
+  const string db_name_;
+  const bool has_device_;
+  DeviceOption device_;
+  std::unordered_map<string, size_t> index_;
+  vector<std::unique_ptr<Entry>> entries_;
+  // Protects the entries' state and staged blobs.
+  std::mutex mutex_;
+  std::condition_variable state_changed_;
+  Timer timer_;
+  std::atomic<int> used_{0};
+  std::atomic<int> prefetched_used_{0};
+};
+
+// LazyLoadOp takes the arguments of LoadOp, but instead of loading the blobs
+// registers a LazyBlob stub for each of them, see LazyBlobSource, so that
+// only the blobs a net reads are ever loaded. The nets reading them have to
+// materialize them first, see MaterializeLazyBlobs(). With "prefetch", the
+// blobs are decoded ahead of use in the background, those in
+// "prefetch_order" first. It reads the dbs of SaveOp and CompressedSaveOp;
+// delta checkpoints, whose blobs span several dbs, and DBReader inputs are
+// loaded eagerly by a CompressedLoadOp.
+template <class Context>
+class LazyLoadOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  LazyLoadOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        ws_(ws),
+        absolute_path_(
+            OperatorBase::GetSingleArgument<int>("absolute_path", false)),
+        add_prefix_(OperatorBase::GetSingleArgument<string>("add_prefix", "")),
+        strip_prefix_(
+            OperatorBase::GetSingleArgument<string>("strip_prefix", "")),
+        db_name_(OperatorBase::GetSingleArgument<string>("db", "")),
+        db_type_(OperatorBase::GetSingleArgument<string>("db_type", "")),
+        keep_device_(OperatorBase::GetSingleArgument<int>("keep_device", 0)),
+        load_all_(OperatorBase::GetSingleArgument<int>("load_all", 0)),
+        allow_incomplete_(
+            OperatorBase::GetSingleArgument<bool>("allow_incomplete", false)),
+        prefetch_(OperatorBase::GetSingleArgument<bool>("prefetch", false)),
+        prefetch_order_(
+            OperatorBase::GetRepeatedArgument<string>("prefetch_order")),
+        eager_load_def_(operator_def) {
+    if (InputSize() == 0) {
+      CAFFE_ENFORCE_GT(db_name_.size(), 0, "Must specify a db name.");
+      CAFFE_ENFORCE_GT(db_type_.size(), 0, "Must specify a db type.");
+    }
+    if (!load_all_) {
+      int idx = 0;
+      std::set<std::string> input_names;
+      for (const string& output_name : this->def().output()) {
+        std::string name = output_name;
+        CAFFE_ENFORCE(
+            input_names.insert(name).second, "Duplicated input: ", name);
+        output_indices_[name] = idx++;
+      }
+    }
+    eager_load_def_.set_type("CompressedLoad");
+  }
+
+  void SetCurrentDevice(BlobProto* proto);
+
+  bool RunOnDevice() override {
+    if (InputSize() == 1) {
+      // The reader may go away after the run, so stubs could not use it.
+      VLOG(1) << "Loading eagerly from a DBReader input.";
+      return loadEagerly();
+    }
+    string full_db_name =
+        absolute_path_ ? db_name_ : (ws_->RootFolder() + "/" + db_name_);
+    Timer timer;
+    std::unique_ptr<DB> in_db(
+        caffe2::db::CreateDB(db_type_, full_db_name, caffe2::db::READ));
+    CAFFE_ENFORCE(in_db.get(), "Cannot open db: ", full_db_name);
+    // SetCurrentDevice() only touches the device of the tensor, so apply it
+    // to a dummy proto once, and let the source copy that device.
+    BlobProto device_proto;
+    device_proto.mutable_tensor();
+    SetCurrentDevice(&device_proto);
+    auto source = std::make_shared<LazyBlobSource>(
+        std::move(in_db),
+        full_db_name,
+        keep_device_ ? nullptr : &device_proto.tensor().device_detail());
+    Cursor* cursor = source->cursor();
+    string parent;
+    if (ReadDeltaCheckpointParent(cursor, &parent)) {
+      VLOG(1) << "Loading delta checkpoint " << full_db_name << " eagerly.";
+      source.reset();
+      return loadEagerly();
+    }
+    for (; cursor->Valid(); cursor->Next()) {
+      const auto key = buildBlobNameFromDbKey(cursor->key());
+      if (load_all_ || output_indices_.count(key)) {
+        source->AddRecord(key);
+      }
+    }
+
+    int registered = 0;
+    if (load_all_) {
+      for (size_t i = 0; i < source->size(); ++i) {
+        SetLazyBlob(
+            ws_->CreateBlob(source->name(i)), source->Loader(source->name(i)));
+        registered++;
+      }
+    } else {
+      for (const auto& output : output_indices_) {
+        if (source->Has(output.first)) {
+          SetLazyBlob(
+              OperatorBase::Outputs().at(output.second),
+              source->Loader(output.first));
+          registered++;
+        } else if (!allow_incomplete_) {
+          LOG(ERROR) << "Failed to load blob: " << output.first;
+        }
+      }
+      if (!allow_incomplete_) {
+        CAFFE_ENFORCE_EQ(
+            registered,
+            OutputSize(),
+            "Expected to load ",
+            OutputSize(),
+            " blobs, got ",
+            registered,
+            " only.");
+      }
+    }
+    LOG(INFO) << "Registered " << registered << " lazy blobs from "
+              << full_db_name << " in " << timer.MilliSeconds() << " ms.";
+    if (prefetch_) {
+      source->StartPrefetch(prefetch_order_);
+    }
+    return true;
+  }
+
+ private:
+  bool loadEagerly() {
+    CompressedLoadOp<Context> sub_op(eager_load_def_, ws_);
+    return sub_op.Run();
+  }
+
+  string buildBlobNameFromDbKey(const string& dbKey) {
+    string key = dbKey.substr(0, dbKey.find(kChunkIdSeparator));
+    if (!strip_prefix_.empty()) {
+      auto match_pos = key.find(strip_prefix_);
+      if (match_pos != string::npos) {
+        key = key.substr(match_pos + strip_prefix_.size());
+      }
+    }
+    key = add_prefix_ + key;
+    return key;
+  }
+
+  Workspace* ws_;
+  bool absolute_path_;
+  string add_prefix_;
+  string strip_prefix_;
+  string db_name_;
+  string db_type_;
+  bool keep_device_;
+  bool load_all_;
+  bool allow_incomplete_;
+  bool prefetch_;
+  vector<string> prefetch_order_;
+  std::map<string, int> output_indices_;
+  OperatorDef eager_load_def_;
+};
+
+template <>
+inline void LazyLoadOp<CPUContext>::SetCurrentDevice(BlobProto* proto) {
+  if (proto->has_tensor()) {
+    proto->mutable_tensor()->mutable_device_detail()->set_device_type(CPU);
+  }
+}
+
+// Registers the op and its schema, once per process however many
+// translation units include this header: the REGISTER_ and OPERATOR_SCHEMA
+// macros cannot be used in a header, as a second registration of a key exits
+// the process.
+inline bool RegisterLazyLoadOp() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("LazyLoad")) {
+      CPUOperatorRegistry()->Register(
+          "LazyLoad",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              LazyLoadOp<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("LazyLoad")) {
+      OpSchemaRegistry::NewSchema("LazyLoad", __FILE__, __LINE__)
+          .NumInputs(0, 1)
+          .NumOutputs(0, INT_MAX)
+          .SetDoc(R"DOC(
+The Load operator, but the blobs are registered as stubs that load on first
+use instead of being loaded, so that start up does not pay for blobs a net
+never reads. The stubs have to be materialized before a net reads them, with
+MaterializeLazyBlobs() (caffe2/core/lazy_blob.h), which Predictor::runTopK
+and the iOS wrapper call before each run. The time from the load to the first
+use of a blob is logged, as well as how many blobs were used. Reads the dbs
+of Save and CompressedSave. Delta checkpoints and DBReader inputs are loaded
+eagerly, as by CompressedLoad.
+)DOC")
+          .Arg(
+              "absolute_path",
+              "(int, default 0) if set, use the db path directly and do not "
+              "prepend the current root folder of the workspace.")
+          .Arg("add_prefix", "(string, default \"\") prefix of blob names.")
+          .Arg(
+              "strip_prefix",
+              "(string, default \"\") prefix to strip from the db keys.")
+          .Arg("db", "(string) the path to the db to load.")
+          .Arg("db_type", "(string) the type of the db.")
+          .Arg(
+              "keep_device",
+              "(int, default 0) if nonzero, the blobs are loaded into the "
+              "device that is specified in the serialized BlobProto.")
+          .Arg(
+              "load_all",
+              "(int, default 0) if nonzero, will register all blobs pointed "
+              "to by the db in the workspace.")
+          .Arg(
+              "allow_incomplete",
+              "(bool, default false) if true, will allow not finding all "
+              "the output blobs specified in the outputs")
+          .Arg(
+              "prefetch",
+              "(bool, default false) if true, decode the blobs ahead of use "
+              "on the serialization thread pool.")
+          .Arg(
+              "prefetch_order",
+              "(list of strings) blobs to prefetch first, in order, e.g. the "
+              "inputs of the predict net in the order of their first use.")
+          .Input(
+              0,
+              "X, Y, ...",
+              "[OPTIONAL] An already opened DBReader to load from, eagerly.");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_lazy_load_op_registered = RegisterLazyLoadOp();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LAZY_LOAD_OP_H_
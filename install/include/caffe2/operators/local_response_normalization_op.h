@@ -4,9 +4,125 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
+namespace detail {
+
+// Positions the NCHW kernel below keeps its running sums for at a time.
+constexpr int kLRNBlock = 256;
+
+/**
+ * Float CPU LRN in NCHW order: scale = bias + alpha / size * (sum of x^2 over
+ * the size channels centered on each value), Y = X * scale^-beta, over N
+ * images of C planes of HW values.
+ *
+ * Blocks of positions of an image walk down the channels keeping a running
+ * sum of squares, adding the channel entering the window and subtracting
+ * the one leaving it, so each value is squared twice whatever the size, and
+ * every pass is a vector operation across positions. Blocks are split over
+ * the thread pool.
+ */
+inline void LRNCPUNCHW(
+    int N,
+    int C,
+    int HW,
+    int size,
+    float alpha,
+    float beta,
+    float bias,
+    const float* X,
+    float* Y,
+    float* scale) {
+  const int pre_pad = (size - 1) / 2;
+  const float alpha_over_size = alpha / size;
+  ParallelFor(
+      static_cast<size_t>(N) * HW,
+      [=](size_t begin, size_t end) {
+        Eigen::ArrayXf acc(kLRNBlock);
+        while (begin < end) {
+          const int n = begin / HW;
+          const int p = begin % HW;
+          const int len = std::min<size_t>(
+              std::min(HW - p, kLRNBlock), end - begin);
+          const size_t offset = static_cast<size_t>(n) * C * HW + p;
+          auto x = [&](int c) {
+            return ConstEigenVectorArrayMap<float>(X + offset + c * HW, len);
+          };
+          auto a = acc.head(len);
+          a.setZero();
+          for (int c = 0; c < std::min(pre_pad, C); ++c) {
+            a += x(c).square();
+          }
+          for (int c = 0; c < C; ++c) {
+            if (c + pre_pad < C) {
+              a += x(c + pre_pad).square();
+            }
+            if (c - pre_pad - 1 >= 0) {
+              a -= x(c - pre_pad - 1).square();
+            }
+            float* scale_c = scale + offset + c * HW;
+            float* y_c = Y + offset + c * HW;
+            EigenVectorArrayMap<float>(scale_c, len) =
+                bias + alpha_over_size * a;
+            math::VectorPowx(len, scale_c, -beta, y_c);
+            EigenVectorArrayMap<float>(y_c, len) *= x(c);
+          }
+          begin += len;
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / C, 1));
+}
+
+/**
+ * Float CPU LRN in NHWC order, as LRNCPUNCHW() over N * HW rows of C
+ * channels. A running sum would run along the channels of each row, one
+ * value at a time; instead each window sum is added up from size shifted
+ * copies of the row of squares, which vectorizes across channels and does
+ * not accumulate rounding error along the row. Rows are split over the
+ * thread pool.
+ */
+inline void LRNCPUNHWC(
+    int rows,
+    int C,
+    int size,
+    float alpha,
+    float beta,
+    float bias,
+    const float* X,
+    float* Y,
+    float* scale) {
+  const int pre_pad = (size - 1) / 2;
+  const float alpha_over_size = alpha / size;
+  ParallelFor(
+      rows,
+      [=](size_t begin, size_t end) {
+        // Squares of a row, with pre_pad zeros on both sides.
+        Eigen::ArrayXf padded_square = Eigen::ArrayXf::Zero(C + size - 1);
+        for (size_t row = begin; row < end; ++row) {
+          const float* x = X + row * C;
+          float* y = Y + row * C;
+          EigenVectorArrayMap<float> scale_row(scale + row * C, C);
+          padded_square.segment(pre_pad, C) =
+              ConstEigenVectorArrayMap<float>(x, C).square();
+          scale_row = padded_square.head(C);
+          for (int k = 1; k < size; ++k) {
+            scale_row += padded_square.segment(k, C);
+          }
+          scale_row = bias + alpha_over_size * scale_row;
+          math::VectorPowx(C, scale_row.data(), -beta, y);
+          EigenVectorArrayMap<float>(y, C) *=
+              ConstEigenVectorArrayMap<float>(x, C);
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / (C * size), 1),
+      1);
+}
+
+} // namespace detail
 
 template <typename T, class Context>
 class LRNOpBase : public Operator<Context> {
@@ -83,6 +199,84 @@ class LRNGradientOp final : public LRNOpBase<T, Context> {
   INPUT_TAGS(INPUT, OUTPUT, SCALE, OUTPUT_GRAD);
 };
 
+
+/**
+ * Float CPU LRN for the SIMD engine, see simd_engine.h: one sliding window
+ * pass in either order with the kernels above, in place of the per channel
+ * Axpy passes and scalar pow of LRNOp. The gradient is LRNGradientOp's, as
+ * SCALE keeps its meaning.
+ */
+class SIMDLRNOp final : public LRNOpBase<float, CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDLRNOp(const OperatorDef& operator_def, Workspace* ws)
+      : LRNOpBase<float, CPUContext>(operator_def, ws) {}
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    const auto& X = Input(0);
+    CAFFE_ENFORCE_EQ(X.ndim(), 4);
+    float* scale = ResizeOutputs();
+    detail::LRNCPUNCHW(
+        X.dim32(0),
+        X.dim32(1),
+        X.dim32(2) * X.dim32(3),
+        size_,
+        alpha_,
+        beta_,
+        bias_,
+        X.data<float>(),
+        Output(OUTPUT)->mutable_data<float>(),
+        scale);
+    return true;
+  }
+
+  bool RunOnDeviceWithOrderNHWC() override {
+    const auto& X = Input(0);
+    CAFFE_ENFORCE_EQ(X.ndim(), 4);
+    float* scale = ResizeOutputs();
+    detail::LRNCPUNHWC(
+        X.dim32(0) * X.dim32(1) * X.dim32(2),
+        X.dim32(3),
+        size_,
+        alpha_,
+        beta_,
+        bias_,
+        X.data<float>(),
+        Output(OUTPUT)->mutable_data<float>(),
+        scale);
+    return true;
+  }
+
+ protected:
+  // Input: X; Output: Y, scale.
+  OUTPUT_TAGS(OUTPUT, SCALE);
+
+ private:
+  // Resizes Y and scale like X, and returns the scale data, which goes to a
+  // private tensor if the SCALE output is not requested.
+  float* ResizeOutputs() {
+    auto* scale = OutputSize() > 1 ? Output(SCALE) : &local_scale_;
+    Output(OUTPUT)->ResizeLike(Input(0));
+    scale->ResizeLike(Input(0));
+    return scale->mutable_data<float>();
+  }
+
+  TensorCPU local_scale_;
+};
+
+// Registers SIMDLRNOp with the SIMD engine, once per process.
+inline bool RegisterSIMDLRNOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDLRNOp>("LRN");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_lrn_op_registered = RegisterSIMDLRNOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_LOCAL_RESPONSE_NORMALIZATION_OP_H_
@@ -0,0 +1,667 @@
+#ifndef CAFFE2_OPERATORS_LSTM_LAYER_OP_H_
+#define CAFFE2_OPERATORS_LSTM_LAYER_OP_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/lstm_unit_op.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/math_vector.h"
+
+namespace caffe2 {
+namespace detail {
+
+// The LSTMUnit kernels LSTMLayerOp and LSTMLayerGradientOp run, which are
+// those of LSTMUnitOp except for the float CPU overloads below. They have
+// names of their own, as LSTMUnit<float, CPUContext> is already instantiated
+// in the prebuilt libraries and cannot be specialized here.
+template <typename T, typename Context>
+void LSTMLayerUnit(
+    int N,
+    int D,
+    int t,
+    const T* H_prev,
+    const T* C_prev,
+    const T* X,
+    const int32_t* seqLengths,
+    T* C,
+    T* H,
+    const T forget_bias,
+    Context* context) {
+  LSTMUnit<T, Context>(
+      N, D, t, H_prev, C_prev, X, seqLengths, C, H, forget_bias, context);
+}
+
+template <typename T, typename Context>
+void LSTMLayerUnitGradient(
+    int N,
+    int D,
+    int t,
+    const T* C_prev,
+    const T* X,
+    const int32_t* seqLengths,
+    const T* C,
+    const T* H,
+    const T* C_diff,
+    const T* H_diff,
+    T* H_prev_diff,
+    T* C_prev_diff,
+    T* X_diff,
+    const T forget_bias,
+    Context* context) {
+  LSTMUnitGradient<T, Context>(
+      N,
+      D,
+      t,
+      C_prev,
+      X,
+      seqLengths,
+      C,
+      H,
+      C_diff,
+      H_diff,
+      H_prev_diff,
+      C_prev_diff,
+      X_diff,
+      forget_bias,
+      context);
+}
+
+// Gate columns the vectorized float kernels below activate at a time, so that
+// their scratch fits on the stack.
+constexpr int kLSTMBlock = 64;
+
+// Activates columns [d, d + len) of one row of gates X, laid out as i, f, o
+// and g blocks of D columns each, into i, f, o (sigmoid) and g (tanh). The
+// outputs may alias the matching columns of X.
+inline void LSTMActivateBlock(
+    int D,
+    int d,
+    int len,
+    const float* X,
+    float forget_bias,
+    float* i,
+    float* f,
+    float* o,
+    float* g) {
+  math::VectorSigmoid(len, X + d, i);
+  for (int k = 0; k < len; ++k) {
+    f[k] = X[D + d + k] + forget_bias;
+  }
+  math::VectorSigmoid(len, f, f);
+  math::VectorSigmoid(len, X + 2 * D + d, o);
+  math::VectorTanh(len, X + 3 * D + d, g);
+}
+
+// LSTMLayerUnit for float on the CPU, with the nonlinearities evaluated by
+// the SIMD kernels of math_vector.h instead of one exp() call per element.
+inline void LSTMLayerUnit(
+    int N,
+    int D,
+    int t,
+    const float* H_prev,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    float* C,
+    float* H,
+    const float forget_bias,
+    CPUContext* /* context */) {
+  float i[kLSTMBlock], f[kLSTMBlock], o[kLSTMBlock], g[kLSTMBlock];
+  float tanh_c[kLSTMBlock];
+  for (int n = 0; n < N; ++n) {
+    if (t >= seqLengths[n]) {
+      std::copy(H_prev, H_prev + D, H);
+      std::copy(C_prev, C_prev + D, C);
+    } else {
+      for (int d = 0; d < D; d += kLSTMBlock) {
+        const int len = std::min(kLSTMBlock, D - d);
+        LSTMActivateBlock(D, d, len, X, forget_bias, i, f, o, g);
+        for (int k = 0; k < len; ++k) {
+          C[d + k] = f[k] * C_prev[d + k] + i[k] * g[k];
+        }
+        math::VectorTanh(len, C + d, tanh_c);
+        for (int k = 0; k < len; ++k) {
+          H[d + k] = o[k] * tanh_c[k];
+        }
+      }
+    }
+    H_prev += D;
+    C_prev += D;
+    X += 4 * D;
+    C += D;
+    H += D;
+  }
+}
+
+// The gradient of the float LSTMLayerUnit above.
+inline void LSTMLayerUnitGradient(
+    int N,
+    int D,
+    int t,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    const float* C,
+    const float* /* H */,
+    const float* C_diff,
+    const float* H_diff,
+    float* H_prev_diff,
+    float* C_prev_diff,
+    float* X_diff,
+    const float forget_bias,
+    CPUContext* /* context */) {
+  float i[kLSTMBlock], f[kLSTMBlock], o[kLSTMBlock], g[kLSTMBlock];
+  float tanh_c[kLSTMBlock];
+  for (int n = 0; n < N; ++n) {
+    if (t >= seqLengths[n]) {
+      std::copy(C_diff, C_diff + D, C_prev_diff);
+      std::copy(H_diff, H_diff + D, H_prev_diff);
+      std::fill(X_diff, X_diff + 4 * D, 0.f);
+    } else {
+      for (int d = 0; d < D; d += kLSTMBlock) {
+        const int len = std::min(kLSTMBlock, D - d);
+        LSTMActivateBlock(D, d, len, X, forget_bias, i, f, o, g);
+        math::VectorTanh(len, C + d, tanh_c);
+        for (int k = 0; k < len; ++k) {
+          const float h_diff = H_diff[d + k];
+          const float c_term_diff = C_diff[d + k] +
+              h_diff * o[k] * (1 - tanh_c[k] * tanh_c[k]);
+          C_prev_diff[d + k] = c_term_diff * f[k];
+          // gradient passed back through X_diff
+          H_prev_diff[d + k] = 0;
+          X_diff[d + k] = c_term_diff * g[k] * i[k] * (1 - i[k]);
+          X_diff[D + d + k] =
+              c_term_diff * C_prev[d + k] * f[k] * (1 - f[k]);
+          X_diff[2 * D + d + k] = h_diff * tanh_c[k] * o[k] * (1 - o[k]);
+          X_diff[3 * D + d + k] = c_term_diff * i[k] * (1 - g[k] * g[k]);
+        }
+      }
+    }
+    C_prev += D;
+    X += 4 * D;
+    C += D;
+    C_diff += D;
+    H_diff += D;
+    X_diff += 4 * D;
+    H_prev_diff += D;
+    C_prev_diff += D;
+  }
+}
+} // namespace detail
+
+/**
+ * A whole LSTM layer over a [T, N, I] input sequence, as one operator rather
+ * than a RecurrentNetwork step net of FC, Sum and LSTMUnit ops.
+ *
+ * The input projection does not depend on the recurrence, so it is computed
+ * for all T * N rows by a single GEMM up front, bias included. Each timestep
+ * then only adds H_{t-1} * W_hh^T to its slice of the gates and runs the
+ * LSTMUnit gate kernel, which copies the previous state through for rows at
+ * or past their sequence length.
+ *
+ * Gates are laid out i, f, o, g as in LSTMUnit, so W_ih is [4D, I], W_hh is
+ * [4D, D] and bias is [4D]. The pre-activation gates are kept in the GATES
+ * output for the gradient.
+ */
+template <typename T, class Context>
+class LSTMLayerOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  LSTMLayerOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        forget_bias_(
+            static_cast<T>(OperatorBase::template GetSingleArgument<float>(
+                "forget_bias",
+                0.0))) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(INPUT);
+    const auto& W_ih = Input(W_IH);
+    const auto& W_hh = Input(W_HH);
+    CAFFE_ENFORCE_EQ(X.ndim(), 3);
+    const int T_ = X.dim32(0);
+    const int N = X.dim32(1);
+    const int I = X.dim32(2);
+    const int G = W_hh.dim32(0);
+    const int D = W_hh.dim32(1);
+    CAFFE_ENFORCE_EQ(G, 4 * D);
+    CAFFE_ENFORCE_EQ(W_ih.dim32(0), G);
+    CAFFE_ENFORCE_EQ(W_ih.dim32(1), I);
+    CAFFE_ENFORCE_EQ(Input(BIAS).size(), G);
+    CAFFE_ENFORCE_EQ(Input(SEQ_LENGTHS).size(), N);
+    CAFFE_ENFORCE_EQ(Input(HIDDEN_INIT).size(), N * D);
+    CAFFE_ENFORCE_EQ(Input(CELL_INIT).size(), N * D);
+    CAFFE_ENFORCE_GT(T_, 0);
+    const auto* seqLengths = Input(SEQ_LENGTHS).template data<int32_t>();
+
+    auto* gates = Output(GATES);
+    gates->Resize(T_, N, G);
+    auto* hidden_all = Output(HIDDEN_ALL);
+    hidden_all->Resize(T_, N, D);
+    auto* cell_all = Output(CELL_ALL);
+    cell_all->Resize(T_, N, D);
+    T* gates_data = gates->template mutable_data<T>();
+    T* H = hidden_all->template mutable_data<T>();
+    T* C = cell_all->template mutable_data<T>();
+
+    // gates = X * W_ih^T + bias, for every timestep at once.
+    const int M = T_ * N;
+    if (bias_multiplier_.size() != M) {
+      bias_multiplier_.Resize(M);
+      math::Set<T, Context>(
+          M,
+          static_cast<T>(1),
+          bias_multiplier_.template mutable_data<T>(),
+          &context_);
+    }
+    math::Gemm<T, Context>(
+        CblasNoTrans,
+        CblasNoTrans,
+        M,
+        G,
+        1,
+        1,
+        bias_multiplier_.template data<T>(),
+        Input(BIAS).template data<T>(),
+        0,
+        gates_data,
+        &context_);
+    math::Gemm<T, Context>(
+        CblasNoTrans,
+        CblasTrans,
+        M,
+        G,
+        I,
+        1,
+        X.template data<T>(),
+        W_ih.template data<T>(),
+        1,
+        gates_data,
+        &context_);
+
+    const T* H_prev = Input(HIDDEN_INIT).template data<T>();
+    const T* C_prev = Input(CELL_INIT).template data<T>();
+    for (int t = 0; t < T_; ++t) {
+      T* gates_t = gates_data + t * N * G;
+      T* H_t = H + t * N * D;
+      T* C_t = C + t * N * D;
+      math::Gemm<T, Context>(
+          CblasNoTrans,
+          CblasTrans,
+          N,
+          G,
+          D,
+          1,
+          H_prev,
+          W_hh.template data<T>(),
+          1,
+          gates_t,
+          &context_);
+      detail::LSTMLayerUnit(
+          N,
+          D,
+          t,
+          H_prev,
+          C_prev,
+          gates_t,
+          seqLengths,
+          C_t,
+          H_t,
+          forget_bias_,
+          &context_);
+      H_prev = H_t;
+      C_prev = C_t;
+    }
+
+    auto* hidden_last = Output(HIDDEN_LAST);
+    hidden_last->Resize(1, N, D);
+    context_.template Copy<T, Context, Context>(
+        N * D, H_prev, hidden_last->template mutable_data<T>());
+    auto* cell_last = Output(CELL_LAST);
+    cell_last->Resize(1, N, D);
+    context_.template Copy<T, Context, Context>(
+        N * D, C_prev, cell_last->template mutable_data<T>());
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(INPUT, SEQ_LENGTHS, HIDDEN_INIT, CELL_INIT, W_IH, W_HH, BIAS);
+  OUTPUT_TAGS(HIDDEN_ALL, HIDDEN_LAST, CELL_ALL, CELL_LAST, GATES);
+
+  T forget_bias_;
+  Tensor<Context> bias_multiplier_;
+};
+
+/**
+ * Backpropagation through time for LSTMLayerOp. Inputs are the forward
+ * inputs, its HIDDEN_ALL, CELL_ALL and GATES outputs, the gradient of
+ * HIDDEN_ALL and, optionally, those of HIDDEN_LAST and CELL_LAST.
+ *
+ * Walking the timesteps backwards, each step runs the LSTMUnit gradient
+ * kernel and one GEMM to carry the hidden state gradient through W_hh. The
+ * gate gradients of all timesteps are kept, so that the gradients of X,
+ * W_ih, W_hh and the bias are each computed by GEMMs over all of them at the
+ * end.
+ */
+template <typename T, class Context>
+class LSTMLayerGradientOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  LSTMLayerGradientOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        forget_bias_(
+            static_cast<T>(OperatorBase::template GetSingleArgument<float>(
+                "forget_bias",
+                0.0))) {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(INPUT);
+    const auto& W_ih = Input(W_IH);
+    const auto& W_hh = Input(W_HH);
+    const int T_ = X.dim32(0);
+    const int N = X.dim32(1);
+    const int I = X.dim32(2);
+    const int G = W_hh.dim32(0);
+    const int D = W_hh.dim32(1);
+    const int M = T_ * N;
+    CAFFE_ENFORCE_EQ(Input(GATES).size(), M * G);
+    CAFFE_ENFORCE_EQ(Input(HIDDEN_ALL).size(), M * D);
+    CAFFE_ENFORCE_EQ(Input(CELL_ALL).size(), M * D);
+    CAFFE_ENFORCE_EQ(Input(HIDDEN_ALL_GRAD).size(), M * D);
+    const auto* seqLengths = Input(SEQ_LENGTHS).template data<int32_t>();
+    const T* gates = Input(GATES).template data<T>();
+    const T* H = Input(HIDDEN_ALL).template data<T>();
+    const T* C = Input(CELL_ALL).template data<T>();
+    const T* H_all_diff = Input(HIDDEN_ALL_GRAD).template data<T>();
+    const T* H0 = Input(HIDDEN_INIT).template data<T>();
+    const T* C0 = Input(CELL_INIT).template data<T>();
+
+    // The carried gradients of H_{t-1} and C_{t-1}, starting from those of
+    // the last states, and ending up as those of the initial ones.
+    auto* H0_diff = Output(HIDDEN_INIT_GRAD);
+    H0_diff->ResizeLike(Input(HIDDEN_INIT));
+    auto* C0_diff = Output(CELL_INIT_GRAD);
+    C0_diff->ResizeLike(Input(CELL_INIT));
+    T* h_carry = H0_diff->template mutable_data<T>();
+    T* c_carry = C0_diff->template mutable_data<T>();
+    InitCarry(HIDDEN_LAST_GRAD, N * D, h_carry);
+    InitCarry(CELL_LAST_GRAD, N * D, c_carry);
+
+    h_diff_.Resize(N, D);
+    T* h_diff = h_diff_.template mutable_data<T>();
+    gates_diff_.Resize(T_, N, G);
+    T* gates_diff = gates_diff_.template mutable_data<T>();
+    for (int t = T_ - 1; t >= 0; --t) {
+      const T* C_prev = t > 0 ? C + (t - 1) * N * D : C0;
+      T* gates_diff_t = gates_diff + t * N * G;
+      // The output gradient at t plus the one carried back from t + 1.
+      math::Add<T, Context>(
+          N * D, H_all_diff + t * N * D, h_carry, h_diff, &context_);
+      detail::LSTMLayerUnitGradient(
+          N,
+          D,
+          t,
+          C_prev,
+          gates + t * N * G,
+          seqLengths,
+          C + t * N * D,
+          H + t * N * D,
+          c_carry,
+          h_diff,
+          h_carry,
+          c_carry,
+          gates_diff_t,
+          forget_bias_,
+          &context_);
+      math::Gemm<T, Context>(
+          CblasNoTrans,
+          CblasNoTrans,
+          N,
+          D,
+          G,
+          1,
+          gates_diff_t,
+          W_hh.template data<T>(),
+          1,
+          h_carry,
+          &context_);
+    }
+
+    auto* X_diff = Output(INPUT_GRAD);
+    X_diff->ResizeLike(X);
+    math::Gemm<T, Context>(
+        CblasNoTrans,
+        CblasNoTrans,
+        M,
+        I,
+        G,
+        1,
+        gates_diff,
+        W_ih.template data<T>(),
+        0,
+        X_diff->template mutable_data<T>(),
+        &context_);
+    auto* W_ih_diff = Output(W_IH_GRAD);
+    W_ih_diff->ResizeLike(W_ih);
+    math::Gemm<T, Context>(
+        CblasTrans,
+        CblasNoTrans,
+        G,
+        I,
+        M,
+        1,
+        gates_diff,
+        X.template data<T>(),
+        0,
+        W_ih_diff->template mutable_data<T>(),
+        &context_);
+    // H_{t-1} is the initial state for t = 0, and H_ALL[t - 1] after that.
+    auto* W_hh_diff = Output(W_HH_GRAD);
+    W_hh_diff->ResizeLike(W_hh);
+    T* dW_hh = W_hh_diff->template mutable_data<T>();
+    math::Gemm<T, Context>(
+        CblasTrans,
+        CblasNoTrans,
+        G,
+        D,
+        N,
+        1,
+        gates_diff,
+        H0,
+        0,
+        dW_hh,
+        &context_);
+    if (T_ > 1) {
+      math::Gemm<T, Context>(
+          CblasTrans,
+          CblasNoTrans,
+          G,
+          D,
+          M - N,
+          1,
+          gates_diff + N * G,
+          H,
+          1,
+          dW_hh,
+          &context_);
+    }
+    auto* bias_diff = Output(BIAS_GRAD);
+    bias_diff->Resize(G);
+    if (bias_multiplier_.size() != M) {
+      bias_multiplier_.Resize(M);
+      math::Set<T, Context>(
+          M,
+          static_cast<T>(1),
+          bias_multiplier_.template mutable_data<T>(),
+          &context_);
+    }
+    math::Gemv<T, Context>(
+        CblasTrans,
+        M,
+        G,
+        1,
+        gates_diff,
+        bias_multiplier_.template data<T>(),
+        0,
+        bias_diff->template mutable_data<T>(),
+        &context_);
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(
+      INPUT,
+      SEQ_LENGTHS,
+      HIDDEN_INIT,
+      CELL_INIT,
+      W_IH,
+      W_HH,
+      BIAS,
+      HIDDEN_ALL,
+      CELL_ALL,
+      GATES,
+      HIDDEN_ALL_GRAD,
+      HIDDEN_LAST_GRAD,
+      CELL_LAST_GRAD);
+  OUTPUT_TAGS(
+      INPUT_GRAD,
+      HIDDEN_INIT_GRAD,
+      CELL_INIT_GRAD,
+      W_IH_GRAD,
+      W_HH_GRAD,
+      BIAS_GRAD);
+
+ private:
+  // Copies the gradient of a last state into carry, or zeroes it when that
+  // optional input is not given.
+  void InitCarry(int input, int size, T* carry) {
+    if (InputSize() > input) {
+      CAFFE_ENFORCE_EQ(Input(input).size(), size);
+      context_.template Copy<T, Context, Context>(
+          size, Input(input).template data<T>(), carry);
+    } else {
+      math::Set<T, Context>(size, static_cast<T>(0), carry, &context_);
+    }
+  }
+
+  T forget_bias_;
+  Tensor<Context> h_diff_;
+  Tensor<Context> gates_diff_;
+  Tensor<Context> bias_multiplier_;
+};
+
+/**
+ * Pairs LSTMLayer with LSTMLayerGradient. The gradient of HIDDEN_ALL is
+ * required; those of HIDDEN_LAST and CELL_LAST are passed on when given,
+ * which for CELL_LAST needs that of HIDDEN_LAST as well, as the optional
+ * inputs of the gradient op are positional. SEQ_LENGTHS gets no gradient.
+ */
+class GetLSTMLayerGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    vector<string> inputs{I(0), I(1), I(2), I(3), I(4), I(5), I(6)};
+    inputs.push_back(O(0));
+    inputs.push_back(O(2));
+    inputs.push_back(O(4));
+    inputs.push_back(GO(0));
+    const bool hidden_last = GradOut(1).IsDense();
+    const bool cell_last = GradOut(3).IsDense();
+    CAFFE_ENFORCE(
+        hidden_last || !cell_last,
+        "LSTMLayer needs the gradient of HIDDEN_LAST to take that of ",
+        "CELL_LAST.");
+    if (hidden_last) {
+      inputs.push_back(GO(1));
+    }
+    if (cell_last) {
+      inputs.push_back(GO(3));
+    }
+    return SingleGradientDef(
+        "LSTMLayerGradient",
+        "",
+        inputs,
+        vector<string>{GI(0), GI(2), GI(3), GI(4), GI(5), GI(6)});
+  }
+};
+
+/**
+ * Registers the float CPU LSTMLayer and LSTMLayerGradient ops, their schemas
+ * and the gradient maker pairing them, once per process however many
+ * translation units include this header. REGISTER_CPU_OPERATOR,
+ * OPERATOR_SCHEMA and REGISTER_GRADIENT cannot be used in a header, as a
+ * second registration of a key exits the process.
+ */
+inline bool RegisterLSTMLayerOps() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("LSTMLayer")) {
+      CPUOperatorRegistry()->Register(
+          "LSTMLayer",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              LSTMLayerOp<float, CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("LSTMLayerGradient")) {
+      CPUOperatorRegistry()->Register(
+          "LSTMLayerGradient",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              LSTMLayerGradientOp<float, CPUContext>>);
+    }
+    // Neither op runs in place: the forward op reads its initial states after
+    // writing its outputs, and the gradient op reads X and the saved states
+    // after writing the input gradients.
+    if (!OpSchemaRegistry::Schema("LSTMLayer")) {
+      OpSchemaRegistry::NewSchema("LSTMLayer", __FILE__, __LINE__)
+          .NumInputs(7)
+          .NumOutputs(5)
+          .AllowInplace([](int, int) { return false; })
+          .SetDoc(R"DOC(
+A whole LSTM layer over a sequence, in one operator: the input projection of
+all timesteps is a single GEMM, and each timestep adds the recurrent
+projection and runs the LSTMUnit gate kernel. Rows at or past their sequence
+length carry their previous state through. Gates are laid out i, f, o, g as in
+LSTMUnit. None of the outputs may be computed in place.
+)DOC")
+          .Arg("forget_bias", "Bias added to the forget gate, default 0.")
+          .Input(0, "input", "Input sequence, [T, N, I].")
+          .Input(1, "seq_lengths", "int32 length of each sequence, [N].")
+          .Input(2, "hidden_init", "Initial hidden state, [1, N, D].")
+          .Input(3, "cell_init", "Initial cell state, [1, N, D].")
+          .Input(4, "W_ih", "Input weights, [4D, I].")
+          .Input(5, "W_hh", "Recurrent weights, [4D, D].")
+          .Input(6, "bias", "Gate bias, [4D].")
+          .Output(0, "hidden_all", "Hidden state of every timestep, [T, N, D].")
+          .Output(1, "hidden_last", "Last hidden state, [1, N, D].")
+          .Output(2, "cell_all", "Cell state of every timestep, [T, N, D].")
+          .Output(3, "cell_last", "Last cell state, [1, N, D].")
+          .Output(4, "gates", "Pre-activation gates, [T, N, 4D].");
+    }
+    if (!OpSchemaRegistry::Schema("LSTMLayerGradient")) {
+      OpSchemaRegistry::NewSchema("LSTMLayerGradient", __FILE__, __LINE__)
+          .NumInputs(11, 13)
+          .NumOutputs(6)
+          .AllowInplace([](int, int) { return false; })
+          .SetDoc(R"DOC(
+Backpropagation through time for LSTMLayer. Takes the seven forward inputs,
+the hidden_all, cell_all and gates outputs, the gradient of hidden_all and,
+optionally, those of hidden_last and then cell_last. Gives the gradients of
+input, hidden_init, cell_init, W_ih, W_hh and bias. None of the outputs may be
+computed in place.
+)DOC")
+          .Arg("forget_bias", "Bias added to the forget gate, default 0.");
+    }
+    if (!GradientRegistry()->Has("LSTMLayer")) {
+      GradientRegistry()->Register(
+          "LSTMLayer",
+          RegistererGradientRegistry::DefaultCreator<GetLSTMLayerGradient>);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_lstm_layer_ops_registered = RegisterLSTMLayerOps();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LSTM_LAYER_OP_H_
@@ -0,0 +1,207 @@
+#ifndef CAFFE2_OPERATORS_PIPELINED_PREFETCH_OP_H_
+#define CAFFE2_OPERATORS_PIPELINED_PREFETCH_OP_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread> // NOLINT
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/stats.h"
+
+namespace caffe2 {
+
+// PipelinedPrefetchOperator is a PrefetchOperator that can have several
+// batches in flight: up to "prefetch_depth" batches (default 1), each in its
+// own buffer slot of a ring, filled by "prefetch_threads" worker threads
+// (default 1). Batches are handed to the net in the order the workers started
+// them, regardless of which one finishes first, so that variance in the time
+// to read or decode a batch does not stall the net.
+//
+// Derived classes implement PrefetchSlot(slot) and CopyPrefetchedSlot(slot)
+// over per-slot buffers sized by prefetch_depth(). PrefetchSlot() must be safe
+// to call concurrently for different slots if more than one thread is used.
+// Like for PrefetchOperator, they should explicitly call the Finalize()
+// function in their destructor, so that the prefetching threads are properly
+// destructed.
+//
+// This is a base class of its own rather than a change of PrefetchOperator,
+// whose layout the operators compiled into the prebuilt libraries depend on.
+
+// Note: We inherit from OperatorBase since we control the
+// synchronization properties of this operator ourselves (we inform
+// the waiting producer after we synchronize). This is a special-case
+// - you should generally inherit from Operator<Context> directly.
+template <class Context>
+class PipelinedPrefetchOperator : public OperatorBase {
+ public:
+  PipelinedPrefetchOperator(const OperatorDef& operator_def, Workspace* ws)
+      : OperatorBase(operator_def, ws),
+        context_(operator_def.device_option()),
+        prefetch_depth_(
+            OperatorBase::GetSingleArgument<int>("prefetch_depth", 1)),
+        num_prefetch_threads_(
+            OperatorBase::GetSingleArgument<int>("prefetch_threads", 1)),
+        slots_(prefetch_depth_),
+        finalize_(false),
+        stats_(
+            operator_def.name().size() || operator_def.output_size() == 0
+                ? operator_def.name()
+                : operator_def.output(0)) {
+    CAFFE_ENFORCE_GE(prefetch_depth_, 1, "prefetch_depth must be positive.");
+    CAFFE_ENFORCE_GE(
+        num_prefetch_threads_, 1, "prefetch_threads must be positive.");
+    CAFFE_ENFORCE_LE(
+        num_prefetch_threads_,
+        prefetch_depth_,
+        "More prefetch threads than prefetch slots would leave threads idle.");
+  }
+
+  virtual ~PipelinedPrefetchOperator() noexcept {
+    CHECK(finalize_ || prefetch_threads_.empty()) <<
+        "YOU MADE A PROGRAMING ERROR: derived class of "
+        "PipelinedPrefetchOperator should call Finalize() in its destructor "
+        "so the prefetching threads are joined. ";
+  }
+
+  void Finalize() {
+    if (!prefetch_threads_.empty()) {
+      {
+        std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
+        finalize_ = true;
+      }
+      // Workers finish the batch they are currently filling, if any, and
+      // then exit instead of claiming another slot.
+      producer_.notify_all();
+      for (auto& thread : prefetch_threads_) {
+        thread.join();
+      }
+      prefetch_threads_.clear();
+    } else {
+      // If we never initialized the prefetch thread, just set
+      // finalize anyway.
+      finalize_ = true;
+    }
+  }
+
+  bool Run(int /* unused */ stream_id) override {
+    // Note(jiayq): We only start the prefetch_thread at the Run() function
+    // instead of in the constructor, because the prefetch_thread needs to start
+    // after all derived classes' constructors finish.
+    if (prefetch_threads_.empty()) {
+      for (int i = 0; i < num_prefetch_threads_; ++i) {
+        prefetch_threads_.emplace_back([this] { this->PrefetchWorker(); });
+      }
+    }
+    context_.SwitchToDevice(0);
+    const int64_t ticket = next_consume_;
+    Slot& slot = slots_[ticket % prefetch_depth_];
+    {
+      std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
+      if (slot.state != SlotState::READY) {
+        CAFFE_EVENT(stats_, prefetch_consumer_waits);
+        CAFFE_DURATION(stats_, prefetch_consumer_wait_ns) {
+          while (slot.state != SlotState::READY) {
+            consumer_.wait(lock);
+          }
+        }
+      }
+    }
+    CAFFE_EVENT(stats_, prefetch_batches);
+    // The slot stays READY while we copy out of it, so workers will not
+    // reuse it; the lock is not needed and other slots keep filling.
+    bool success = slot.success;
+    if (!success) {
+      LOG(ERROR) << "Prefetching failed.";
+    } else if (!CopyPrefetchedSlot(ticket % prefetch_depth_)) {
+      LOG(ERROR) << "Error when copying prefetched data.";
+      success = false;
+    } else {
+      success = context_.FinishDeviceComputation();
+    }
+    {
+      std::lock_guard<std::mutex> lock(prefetch_access_mutex_);
+      slot.state = SlotState::EMPTY;
+      ++next_consume_;
+    }
+    producer_.notify_all();
+    return success;
+  }
+
+  void PrefetchWorker() {
+    context_.SwitchToDevice();
+    std::unique_lock<std::mutex> lock(prefetch_access_mutex_);
+    while (true) {
+      // Claim the next ticket once its slot has been consumed.
+      while (!finalize_ &&
+             slots_[next_fill_ % prefetch_depth_].state != SlotState::EMPTY) {
+        producer_.wait(lock);
+      }
+      if (finalize_) {
+        break;
+      }
+      const int64_t ticket = next_fill_++;
+      Slot& slot = slots_[ticket % prefetch_depth_];
+      slot.state = SlotState::FILLING;
+      lock.unlock();
+      // We will need to run a FinishDeviceComputation() call because the
+      // prefetcher thread and the main thread are potentially using different
+      // streams (like on GPU).
+      bool success = false;
+      try {
+        success = PrefetchSlot(ticket % prefetch_depth_) &&
+            context_.FinishDeviceComputation();
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Exception in prefetching: " << e.what();
+      }
+      lock.lock();
+      slot.success = success;
+      slot.state = SlotState::READY;
+      consumer_.notify_one();
+    }
+  }
+
+  // You will need to implement these instead of the Run function: fill,
+  // respectively copy out of, buffer `slot` in [0, prefetch_depth()).
+  virtual bool PrefetchSlot(int slot) = 0;
+  virtual bool CopyPrefetchedSlot(int slot) = 0;
+
+  int prefetch_depth() const {
+    return prefetch_depth_;
+  }
+
+ protected:
+  enum class SlotState { EMPTY, FILLING, READY };
+  struct Slot {
+    SlotState state{SlotState::EMPTY};
+    bool success{true};
+  };
+
+  Context context_;
+  const int prefetch_depth_;
+  const int num_prefetch_threads_;
+  // Ring of buffer states, indexed by ticket % prefetch_depth_. All fields are
+  // protected by prefetch_access_mutex_.
+  std::vector<Slot> slots_;
+  // Ticket of the next batch a worker will start / the net will consume.
+  int64_t next_fill_{0};
+  int64_t next_consume_{0};
+  std::mutex prefetch_access_mutex_;
+  std::condition_variable producer_, consumer_;
+  // finalize_ is used to tell the prefetcher to quit.
+  std::atomic<bool> finalize_;
+  std::vector<std::thread> prefetch_threads_;
+
+  struct PrefetchStats {
+    CAFFE_STAT_CTOR(PrefetchStats);
+    CAFFE_EXPORTED_STAT(prefetch_batches);
+    // Number of Run() calls that found their batch not ready yet, and the
+    // time spent waiting for it.
+    CAFFE_EXPORTED_STAT(prefetch_consumer_waits);
+    CAFFE_AVG_EXPORTED_STAT(prefetch_consumer_wait_ns);
+  } stats_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_PIPELINED_PREFETCH_OP_H_
@@ -0,0 +1,191 @@
+#ifndef CAFFE2_OPERATORS_PIPELINED_TENSOR_PROTOS_DB_INPUT_H_
+#define CAFFE2_OPERATORS_PIPELINED_TENSOR_PROTOS_DB_INPUT_H_
+
+#include <climits>
+#include <iostream>
+#include <mutex>
+
+#include "caffe2/core/db.h"
+#include "caffe2/db/mmap_db.h"
+#include "caffe2/db/sharded_db_reader.h"
+#include "caffe2/operators/pipelined_prefetch_op.h"
+
+namespace caffe2 {
+
+// TensorProtosDBInput over a PipelinedPrefetchOperator: the same op, with
+// "prefetch_depth" batches in flight filled by "prefetch_threads" threads.
+// It also takes a ShardedDBReader as input, and parses the values of a
+// zero-copy db in place.
+template <class Context>
+class PipelinedTensorProtosDBInput final
+    : public PipelinedPrefetchOperator<Context> {
+ public:
+  using OperatorBase::OutputSize;
+  using PipelinedPrefetchOperator<Context>::prefetch_threads_;
+  explicit PipelinedTensorProtosDBInput(
+      const OperatorDef& operator_def,
+      Workspace* ws);
+  ~PipelinedTensorProtosDBInput() {
+    PipelinedPrefetchOperator<Context>::Finalize();
+  }
+
+  bool PrefetchSlot(int slot) override;
+  bool CopyPrefetchedSlot(int slot) override;
+
+ private:
+  // Reads the next record of the input reader, a DBReader or a
+  // ShardedDBReader, into *protos.
+  void ReadProtos(string* key, string* value, TensorProtos* protos);
+
+  // Prefetch will always just happen on the CPU side. One set of output blobs
+  // per prefetch slot, so that several batches can be in flight.
+  vector<vector<Blob>> prefetched_blobs_;
+  int batch_size_;
+};
+
+template <class Context>
+PipelinedTensorProtosDBInput<Context>::PipelinedTensorProtosDBInput(
+    const OperatorDef& operator_def,
+    Workspace* ws)
+    : PipelinedPrefetchOperator<Context>(operator_def, ws),
+      prefetched_blobs_(this->prefetch_depth()),
+      batch_size_(
+          OperatorBase::template GetSingleArgument<int>("batch_size", 0)) {
+  for (auto& blobs : prefetched_blobs_) {
+    blobs = vector<Blob>(operator_def.output_size());
+  }
+}
+
+template <class Context>
+void PipelinedTensorProtosDBInput<Context>::ReadProtos(
+    string* key,
+    string* value,
+    TensorProtos* protos) {
+  const char* data = nullptr;
+  size_t size = 0;
+  db::ReadDBRecord(OperatorBase::InputBlob(0), key, value, &data, &size);
+  CAFFE_ENFORCE(protos->ParseFromArray(data, size));
+}
+
+template <class Context>
+bool PipelinedTensorProtosDBInput<Context>::PrefetchSlot(int slot) {
+  TensorDeserializer<CPUContext> deserializer;
+  vector<Blob>& prefetched_blobs = prefetched_blobs_[slot];
+  // Key and value are per call, as several prefetch threads may be reading.
+  string key, value;
+  if (batch_size_ == 0) {
+    // We do not need to construct a batch. As a result, we will simply
+    // deserialize everything into the target prefetched blob.
+    TensorProtos protos;
+    ReadProtos(&key, &value, &protos);
+    CAFFE_ENFORCE(protos.protos_size() == OutputSize());
+    for (int i = 0; i < protos.protos_size(); ++i) {
+      if (protos.protos(i).has_device_detail()) {
+        protos.mutable_protos(i)->clear_device_detail();
+      }
+      deserializer.Deserialize(
+          protos.protos(i),
+          prefetched_blobs[i].template GetMutable<TensorCPU>());
+    }
+  } else {
+    vector<TensorCPU> temp_tensors(OutputSize());
+    bool shape_inferred = false;
+    for (int item_id = 0; item_id < batch_size_; ++item_id) {
+      TensorProtos protos;
+      ReadProtos(&key, &value, &protos);
+      CAFFE_ENFORCE(protos.protos_size() == OutputSize());
+      if (!shape_inferred) {
+        // First, set the shape of all the blobs.
+        for (int i = 0; i < protos.protos_size(); ++i) {
+          vector<int> dims(
+              protos.protos(i).dims().begin(), protos.protos(i).dims().end());
+          dims.insert(dims.begin(), batch_size_);
+          prefetched_blobs[i].template GetMutable<TensorCPU>()->Resize(dims);
+        }
+        shape_inferred = true;
+      }
+      for (int i = 0; i < protos.protos_size(); ++i) {
+        TensorCPU* dst = prefetched_blobs[i].template GetMutable<TensorCPU>();
+        TensorCPU& src = temp_tensors[i];
+        if (protos.protos(i).has_device_detail()) {
+          protos.mutable_protos(i)->clear_device_detail();
+        }
+        deserializer.Deserialize(protos.protos(i), &src);
+        DCHECK_EQ(src.size() * batch_size_, dst->size());
+        this->context_.template CopyItems<CPUContext, CPUContext>(
+            src.meta(),
+            src.size(),
+            src.raw_data(),
+            static_cast<char*>(dst->raw_mutable_data(src.meta())) +
+                src.nbytes() * item_id);
+      }
+    }
+  }
+  return true;
+}
+
+template <class Context>
+bool PipelinedTensorProtosDBInput<Context>::CopyPrefetchedSlot(int slot) {
+  for (int i = 0; i < OutputSize(); ++i) {
+    OperatorBase::Output<Tensor<Context>>(i)->CopyFrom(
+        prefetched_blobs_[slot][i].template Get<TensorCPU>(), &this->context_);
+  }
+  return true;
+}
+
+// Registers the op and its schema, once per process however many
+// translation units include this header: the REGISTER_ and OPERATOR_SCHEMA
+// macros cannot be used in a header, as a second registration of a key exits
+// the process.
+inline bool RegisterPipelinedTensorProtosDBInput() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("PipelinedTensorProtosDBInput")) {
+      CPUOperatorRegistry()->Register(
+          "PipelinedTensorProtosDBInput",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              PipelinedTensorProtosDBInput<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("PipelinedTensorProtosDBInput")) {
+      OpSchemaRegistry::NewSchema(
+          "PipelinedTensorProtosDBInput", __FILE__, __LINE__)
+          .NumInputs(1)
+          .NumOutputs(1, INT_MAX)
+          .SetDoc(R"DOC(
+TensorProtosDBInput with several batches in flight, so that variance in the
+time to read a batch does not stall the net. Takes the output of CreateDB or
+CreateShardedDB.
+)DOC")
+          .Arg(
+              "batch_size",
+              "(int, default 0) the number of samples in a batch. The "
+              "default value of 0 means that the operator will attempt to "
+              "insert the entire data in a single output blob.")
+          .Arg(
+              "prefetch_depth",
+              "(int, default 1) the number of batches prefetched ahead.")
+          .Arg(
+              "prefetch_threads",
+              "(int, default 1) the number of threads prefetching batches, "
+              "at most prefetch_depth.")
+          .Input(
+              0,
+              "data",
+              "A pre-initialized DB reader, a DBReader or a ShardedDBReader.")
+          .Output(
+              0,
+              "output",
+              "The output tensors, one for each tensor in a record.");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_pipelined_tensor_protos_db_input_registered =
+    RegisterPipelinedTensorProtosDBInput();
+} // namespace
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_PIPELINED_TENSOR_PROTOS_DB_INPUT_H_
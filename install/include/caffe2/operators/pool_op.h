@@ -1,14 +1,207 @@
 #ifndef CAFFE2_OPERATORS_POOL_OP_H_
 #define CAFFE2_OPERATORS_POOL_OP_H_
 
+#include <algorithm>
+
 #include "caffe2/core/common_omp.h"
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
 #include "caffe2/operators/conv_pool_op_base.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif // __ARM_NEON__
+
 namespace caffe2 {
+namespace detail {
+
+// The pooling kinds SIMDPoolOp has specialized float CPU kernels for.
+enum class FastPool { AVERAGE, MAX };
+
+/**
+ * Global pooling of the N * C planes of H * W floats in X into Y, in NCHW
+ * order: one reduction over each contiguous plane, with planes split over
+ * the thread pool.
+ */
+inline void GlobalPoolNCHW(
+    FastPool kind,
+    int N,
+    int C,
+    int HW,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      N * C,
+      [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          ConstEigenVectorArrayMap<float> x(X + i * HW, HW);
+          Y[i] = kind == FastPool::MAX ? x.maxCoeff() : x.sum() / HW;
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / HW, 1),
+      1);
+}
+
+/**
+ * Global pooling in NHWC order: each output pixel is reduced from the HW
+ * pixels of its image a whole row of channels at a time, with the N * C
+ * outputs split over the thread pool.
+ */
+inline void GlobalPoolNHWC(
+    FastPool kind,
+    int N,
+    int C,
+    int HW,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      N * C,
+      [=](size_t begin, size_t end) {
+        while (begin < end) {
+          const int n = begin / C;
+          const int c = begin % C;
+          const int len = std::min<size_t>(C - c, end - begin);
+          const float* x = X + n * HW * C + c;
+          EigenVectorArrayMap<float> y(Y + begin, len);
+          y = ConstEigenVectorArrayMap<float>(x, len);
+          for (int i = 1; i < HW; ++i) {
+            ConstEigenVectorArrayMap<float> xi(x + i * C, len);
+            if (kind == FastPool::MAX) {
+              y = y.max(xi);
+            } else {
+              y += xi;
+            }
+          }
+          if (kind == FastPool::AVERAGE) {
+            y /= static_cast<float>(HW);
+          }
+          begin += len;
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / HW, 1));
+}
+
+/**
+ * k x k max pooling at stride 2 without padding, k being 2 or 3, of one
+ * H x W plane into its OH x OW output. Each output row takes the vertical
+ * maximum of its k input rows into colmax, of at least W floats, and then
+ * the maximum of each window of k of those columns.
+ */
+inline void MaxPoolPlaneS2(
+    int k,
+    int W,
+    int OH,
+    int OW,
+    const float* X,
+    float* Y,
+    float* colmax) {
+  // Only the columns some window covers.
+  const int cols = 2 * (OW - 1) + k;
+  for (int oh = 0; oh < OH; ++oh, Y += OW) {
+    const float* r0 = X + 2 * oh * W;
+    const float* r1 = r0 + W;
+    const float* r2 = k == 3 ? r1 + W : r1;
+    int w = 0;
+#ifdef __ARM_NEON__
+    for (; w + 4 <= cols; w += 4) {
+      float32x4_t m = vmaxq_f32(vld1q_f32(r0 + w), vld1q_f32(r1 + w));
+      vst1q_f32(colmax + w, vmaxq_f32(m, vld1q_f32(r2 + w)));
+    }
+#endif // __ARM_NEON__
+    for (; w < cols; ++w) {
+      colmax[w] = std::max(std::max(r0[w], r1[w]), r2[w]);
+    }
+
+    int ow = 0;
+#ifdef __ARM_NEON__
+    // Loads 8 columns from 2 * ow, and for k = 3 also from 2 * ow + 2.
+    for (; ow + 4 <= OW && 2 * ow + 8 + 2 * (k - 2) <= cols; ow += 4) {
+      float32x4x2_t c = vld2q_f32(colmax + 2 * ow);
+      float32x4_t m = vmaxq_f32(c.val[0], c.val[1]);
+      if (k == 3) {
+        m = vmaxq_f32(m, vld2q_f32(colmax + 2 * ow + 2).val[0]);
+      }
+      vst1q_f32(Y + ow, m);
+    }
+#endif // __ARM_NEON__
+    for (; ow < OW; ++ow) {
+      const float* c = colmax + 2 * ow;
+      Y[ow] = k == 3 ? std::max(std::max(c[0], c[1]), c[2])
+                     : std::max(c[0], c[1]);
+    }
+  }
+}
+
+// MaxPoolPlaneS2() over the N * C planes of X in NCHW order, split over the
+// thread pool.
+inline void MaxPoolS2NCHW(
+    int k,
+    int N,
+    int C,
+    int H,
+    int W,
+    int OH,
+    int OW,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      N * C,
+      [=](size_t begin, size_t end) {
+        std::vector<float> colmax(W);
+        for (size_t i = begin; i < end; ++i) {
+          MaxPoolPlaneS2(
+              k, W, OH, OW, X + i * H * W, Y + i * OH * OW, colmax.data());
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / (H * W), 1),
+      1);
+}
+
+/**
+ * k x k max pooling at stride 2 without padding in NHWC order, as maxima of
+ * whole rows of channels, with the N * OH output rows split over the thread
+ * pool.
+ */
+inline void MaxPoolS2NHWC(
+    int k,
+    int N,
+    int C,
+    int H,
+    int W,
+    int OH,
+    int OW,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      N * OH,
+      [=](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+          const int n = row / OH;
+          const int oh = row % OH;
+          for (int ow = 0; ow < OW; ++ow) {
+            EigenVectorArrayMap<float> y(Y + (row * OW + ow) * C, C);
+            const float* x = X + ((n * H + 2 * oh) * W + 2 * ow) * C;
+            y = ConstEigenVectorArrayMap<float>(x, C);
+            for (int kh = 0; kh < k; ++kh) {
+              for (int kw = 0; kw < k; ++kw) {
+                if (kh || kw) {
+                  y = y.max(ConstEigenVectorArrayMap<float>(
+                      x + (kh * W + kw) * C, C));
+                }
+              }
+            }
+          }
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / (k * W * C), 1),
+      1);
+}
+
+} // namespace detail
 
 template <typename T, class Context, typename PoolType>
 class PoolOp final : public ConvPoolOpBase<Context> {
@@ -52,6 +245,96 @@ class PoolGradientOp final : public ConvPoolOpBase<Context> {
   // Output: dX
 };
 
+
+/**
+ * MaxPool and AveragePool (and their 2D variants) on float CPU tensors for
+ * the SIMD engine, see simd_engine.h: global pooling, and 2x2 and 3x3 max
+ * pooling at stride 2 without padding, run the kernels above. Every other
+ * shape runs the default PoolOp.
+ */
+class SIMDPoolOp final : public ConvPoolOpBase<CPUContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(CPUContext);
+  SIMDPoolOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<CPUContext>(operator_def, ws),
+        kind_(
+            operator_def.type().compare(0, 7, "MaxPool") == 0
+                ? detail::FastPool::MAX
+                : detail::FastPool::AVERAGE),
+        fallback_(CreateDefaultEngineOperator(operator_def, ws)) {}
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    return RunFastPath() || fallback_->Run();
+  }
+  bool RunOnDeviceWithOrderNHWC() override {
+    return RunFastPath() || fallback_->Run();
+  }
+
+ private:
+  // Runs one of the specialized kernels if the shapes match: global average
+  // or max pooling, or 2x2 and 3x3 max pooling at stride 2 without padding.
+  // Returns false, with Y possibly resized, otherwise.
+  bool RunFastPath() {
+    const auto& X = Input(0);
+    auto* Y = Output(0);
+    if (X.ndim() != 4 || kernel_.size() != 2) {
+      return false;
+    }
+    const bool nchw = order_ == StorageOrder::NCHW;
+    const int N = X.dim32(0);
+    const int C = X.dim32(nchw ? 1 : 3);
+    const int H = X.dim32(nchw ? 2 : 1);
+    const int W = X.dim32(nchw ? 3 : 2);
+    const float* Xdata = X.data<float>();
+    if (global_pooling_) {
+      SetOutputSize(X, Y, C);
+      float* Ydata = Y->mutable_data<float>();
+      if (nchw) {
+        detail::GlobalPoolNCHW(kind_, N, C, H * W, Xdata, Ydata);
+      } else {
+        detail::GlobalPoolNHWC(kind_, N, C, H * W, Xdata, Ydata);
+      }
+      return true;
+    }
+    const int k = kernel_[0];
+    if (kind_ != detail::FastPool::MAX || (k != 2 && k != 3) ||
+        kernel_[1] != k || stride_[0] != 2 || stride_[1] != 2 ||
+        legacy_pad_ != LegacyPadding::NOTSET ||
+        std::any_of(pads_.begin(), pads_.end(), [](int p) { return p; })) {
+      return false;
+    }
+    SetOutputSize(X, Y, C);
+    const int OH = Y->dim32(nchw ? 2 : 1);
+    const int OW = Y->dim32(nchw ? 3 : 2);
+    float* Ydata = Y->mutable_data<float>();
+    if (nchw) {
+      detail::MaxPoolS2NCHW(k, N, C, H, W, OH, OW, Xdata, Ydata);
+    } else {
+      detail::MaxPoolS2NHWC(k, N, C, H, W, OH, OW, Xdata, Ydata);
+    }
+    return true;
+  }
+
+  const detail::FastPool kind_;
+  unique_ptr<OperatorBase> fallback_;
+};
+
+// Registers SIMDPoolOp with the SIMD engine, once per process.
+inline bool RegisterSIMDPoolOps() {
+  static const bool registered = []() {
+    for (const char* type :
+         {"MaxPool", "MaxPool2D", "AveragePool", "AveragePool2D"}) {
+      RegisterSIMDEngineOperator<SIMDPoolOp>(type);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_pool_ops_registered = RegisterSIMDPoolOps();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_POOL_OP_H_
@@ -5,6 +5,9 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 
@@ -31,6 +34,44 @@ class ReluGradientOp final : public Operator<Context> {
   // Input: Y, dY; Output: dX
 };
 
+/**
+ * Relu of float CPU tensors with the SIMD engine, split over the thread pool
+ * by ParallelFor().
+ */
+class SIMDReluOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDReluOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    ParallelFor(X.size(), [=](size_t begin, size_t end) {
+      EigenVectorArrayMap<float>(Ydata + begin, end - begin) =
+          ConstEigenVectorArrayMap<float>(Xdata + begin, end - begin)
+              .cwiseMax(0.f);
+    });
+    return true;
+  }
+};
+
+// Registers SIMDReluOp with the SIMD engine, once per process.
+inline bool RegisterSIMDReluOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDReluOp>("Relu");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_relu_op_registered = RegisterSIMDReluOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_RELU_OP_H_
@@ -3,6 +3,8 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
 namespace caffe2 {
@@ -31,6 +33,52 @@ class ScaleOp final : public Operator<Context> {
   T scale_;
 };
 
+/**
+ * Scale of float CPU tensors with the SIMD engine, split over the thread pool
+ * by ParallelFor(). Other input types run the default engine ScaleOp.
+ */
+class SIMDScaleOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDScaleOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        scale_(OperatorBase::GetSingleArgument<float>("scale", 1.0)),
+        fallback_(CreateDefaultEngineOperator(operator_def, ws)) {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    if (!X.IsType<float>()) {
+      return fallback_->Run();
+    }
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    ParallelFor(X.size(), [&](size_t begin, size_t end) {
+      math::Scale<float, CPUContext>(
+          end - begin, scale_, Xdata + begin, Ydata + begin, &context_);
+    });
+    return true;
+  }
+
+ private:
+  float scale_;
+  unique_ptr<OperatorBase> fallback_;
+};
+
+// Registers SIMDScaleOp with the SIMD engine, once per process.
+inline bool RegisterSIMDScaleOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDScaleOp>("Scale");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_scale_op_registered = RegisterSIMDScaleOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_SCALE_OP_H_
@@ -0,0 +1,83 @@
+#ifndef CAFFE2_OPERATORS_SIMD_ENGINE_H_
+#define CAFFE2_OPERATORS_SIMD_ENGINE_H_
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+/**
+ * The SIMD engine: float CPU operators that run the fused, vectorized kernels
+ * of the operator headers, picked by giving an operator the engine "SIMD".
+ * For inputs or arguments their kernels do not cover, they run the default
+ * engine operator of the same def.
+ *
+ * They are classes of their own, registered from the headers, because the
+ * default operators are compiled into the prebuilt libraries, whose layout
+ * and overrides of those classes the headers must match.
+ */
+#define CAFFE2_SIMD_ENGINE "SIMD"
+
+// Creates the default engine CPU operator for def, for a SIMD engine
+// operator to fall back to.
+inline unique_ptr<OperatorBase> CreateDefaultEngineOperator(
+    const OperatorDef& def,
+    Workspace* ws) {
+  OperatorDef base_def(def);
+  base_def.clear_engine();
+  auto op = CPUOperatorRegistry()->Create(def.type(), base_def, ws);
+  CAFFE_ENFORCE(op, "No default engine CPU operator for ", def.type());
+  return op;
+}
+
+/**
+ * Registers Op as the SIMD engine CPU operator of type, unless one already
+ * is. REGISTER_CPU_OPERATOR_WITH_ENGINE cannot be used in a header, as a
+ * second registration of a key exits the process; call this from a function
+ * that runs once per process instead.
+ */
+template <class Op>
+inline void RegisterSIMDEngineOperator(const string& type) {
+  const string key = type + "_ENGINE_" CAFFE2_SIMD_ENGINE;
+  if (!CPUOperatorRegistry()->Has(key)) {
+    CPUOperatorRegistry()->Register(
+        key, RegistererCPUOperatorRegistry::DefaultCreator<Op>);
+  }
+}
+
+/**
+ * Opts net into the SIMD engine: gives the engine "SIMD" to each of its
+ * operators that has no engine yet and whose type has a SIMD engine operator
+ * registered, i.e. whose operator header the program includes. Operators of
+ * nets nested in arguments, such as step nets, are left as they are. Returns
+ * the number of operators changed.
+ */
+inline int UseSIMDEngine(NetDef* net) {
+  int changed = 0;
+  for (auto& op : *net->mutable_op()) {
+    if (op.engine().empty() &&
+        CPUOperatorRegistry()->Has(op.type() + "_ENGINE_" CAFFE2_SIMD_ENGINE)) {
+      op.set_engine(CAFFE2_SIMD_ENGINE);
+      ++changed;
+    }
+  }
+  return changed;
+}
+
+/**
+ * Opts every net of plan into the SIMD engine, as UseSIMDEngine(NetDef*)
+ * does. Training plans opt in this way before they are run, so that their
+ * optimizer operators run the fused kernels of the sgd headers the program
+ * includes. Returns the number of operators changed.
+ */
+inline int UseSIMDEngine(PlanDef* plan) {
+  int changed = 0;
+  for (auto& net : *plan->mutable_network()) {
+    changed += UseSIMDEngine(&net);
+  }
+  return changed;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_SIMD_ENGINE_H_
@@ -1,8 +1,15 @@
 #ifndef CAFFE2_OPERATORS_SOFTMAX_SHARED_H_
 #define CAFFE2_OPERATORS_SOFTMAX_SHARED_H_
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
 
@@ -16,6 +23,165 @@ void SoftmaxCPU(
     const float* sum_multiplier,
     bool logarithmic,
     float* rowmax);
+
+// Values per chunk of the row kernels, small enough for a chunk of the input
+// and its exponentials to stay in L1 between the passes over it.
+constexpr int kSoftmaxChunk = 64;
+
+// e = exp(x - max) for n <= kSoftmaxChunk values. Without fast_exp this is
+// Eigen's vectorized exp, as math::Exp() uses in SoftmaxCPU; with it, the
+// faster math::VectorExp() on NEON and AVX2 builds.
+inline void SoftmaxChunkExp(
+    const int n,
+    const float* x,
+    const float max,
+    float* e,
+    bool fast_exp) {
+  EigenVectorArrayMap<float> out(e, n);
+#if CAFFE2_MATH_VECTOR_SIMD
+  if (fast_exp) {
+    out = ConstEigenVectorArrayMap<float>(x, n) - max;
+    math::VectorExp(n, e, e);
+    return;
+  }
+#endif // CAFFE2_MATH_VECTOR_SIMD
+  out = (ConstEigenVectorArrayMap<float>(x, n) - max).exp();
+}
+
+// Returns the sum of exp(x - max) over D values, also writing the terms to y.
+inline float SoftmaxExpSum(
+    const int D,
+    const float* x,
+    const float max,
+    float* y,
+    bool fast_exp) {
+  float sum = 0.f;
+  for (int i = 0; i < D; i += kSoftmaxChunk) {
+    const int n = std::min(kSoftmaxChunk, D - i);
+    SoftmaxChunkExp(n, x + i, max, y + i, fast_exp);
+    sum += ConstEigenVectorArrayMap<float>(y + i, n).sum();
+  }
+  return sum;
+}
+
+// Returns log(sum(exp(x))) over D values in a single (online) pass over x:
+// each chunk is summed relative to the largest value seen so far, and the
+// running sum is rescaled when a chunk raises it. That costs one extra exp
+// per chunk rather than a separate pass for the max.
+inline float SoftmaxLogSumExp(const int D, const float* x, bool fast_exp) {
+  float max = -std::numeric_limits<float>::infinity();
+  float sum = 0.f;
+  float buffer[kSoftmaxChunk];
+  for (int i = 0; i < D; i += kSoftmaxChunk) {
+    const int n = std::min(kSoftmaxChunk, D - i);
+    const float chunk_max = ConstEigenVectorArrayMap<float>(x + i, n).maxCoeff();
+    if (chunk_max > max) {
+      sum *= std::exp(max - chunk_max);
+      max = chunk_max;
+    }
+    SoftmaxChunkExp(n, x + i, max, buffer, fast_exp);
+    sum += ConstEigenVectorArrayMap<float>(buffer, n).sum();
+  }
+  return max + std::log(sum);
+}
+
+// Softmax (or log softmax) of one row of D values, without temporaries.
+// Softmax takes one pass for the max, one writing exp(x - max) to y while
+// summing it, and one scaling y, which is still in cache for any realistic
+// row; storing the exponentials once beats an online max and sum, which
+// would have to compute them again. Log softmax needs no stored exponentials,
+// so it takes the online pass of SoftmaxLogSumExp() and one subtracting it.
+inline void SoftmaxRowFused(
+    const int D,
+    const float* x,
+    float* y,
+    bool logarithmic,
+    bool fast_exp) {
+  if (logarithmic) {
+    const float offset = SoftmaxLogSumExp(D, x, fast_exp);
+    EigenVectorArrayMap<float>(y, D) =
+        ConstEigenVectorArrayMap<float>(x, D) - offset;
+    return;
+  }
+  const float max = ConstEigenVectorArrayMap<float>(x, D).maxCoeff();
+  const float inv_sum = 1.f / SoftmaxExpSum(D, x, max, y, fast_exp);
+  EigenVectorArrayMap<float>(y, D) *= inv_sum;
+}
+
+// Softmax (or log softmax) of rows shorter than kSoftmaxChunk, which are too
+// short to vectorize one at a time: the rows are taken kSoftmaxChunk values
+// at a time, shifted by their max, and exponentiated together.
+inline void SoftmaxShortRowsFused(
+    const int N,
+    const int D,
+    const float* x,
+    float* y,
+    bool logarithmic,
+    bool fast_exp) {
+  const int rows_per_block = kSoftmaxChunk / D;
+  float buffer[kSoftmaxChunk];
+  for (int row = 0; row < N; row += rows_per_block) {
+    const int rows = std::min(rows_per_block, N - row);
+    const float* xb = x + row * D;
+    float* yb = y + row * D;
+    for (int r = 0; r < rows; ++r) {
+      const float max =
+          ConstEigenVectorArrayMap<float>(xb + r * D, D).maxCoeff();
+      EigenVectorArrayMap<float>(yb + r * D, D) =
+          ConstEigenVectorArrayMap<float>(xb + r * D, D) - max;
+    }
+    // yb holds x - max, so exponentiate with a max of 0.
+    float* e = logarithmic ? buffer : yb;
+    SoftmaxChunkExp(rows * D, yb, 0.f, e, fast_exp);
+    for (int r = 0; r < rows; ++r) {
+      const float sum = ConstEigenVectorArrayMap<float>(e + r * D, D).sum();
+      EigenVectorArrayMap<float> out(yb + r * D, D);
+      if (logarithmic) {
+        out -= std::log(sum);
+      } else {
+        out *= 1.f / sum;
+      }
+    }
+  }
+}
+
+// Fused replacement for SoftmaxCPU, computing each of the N rows with
+// SoftmaxRowFused(), or SoftmaxShortRowsFused() if D is small. X and Y may
+// alias. fast_exp selects math::VectorExp(),
+// at the tier of math::GetMathAccuracy(), on NEON and AVX2 builds; without
+// it the exp is Eigen's, as in SoftmaxCPU.
+// SoftmaxOp and SoftmaxWithLossOp are compiled into the prebuilt library and
+// still call SoftmaxCPU; this is for code built against these headers.
+// Large inputs are spread over the thread pool in whole rows, see
+// ParallelFor().
+inline void SoftmaxCPUFused(
+    const int N,
+    const int D,
+    const float* X,
+    float* Y,
+    bool logarithmic,
+    bool fast_exp) {
+  if (D == 0) {
+    return;
+  }
+  // In whole rows, once there are about 2 * CAFFE2_PARALLEL_GRAIN values.
+  ParallelFor(
+      N,
+      [&](size_t begin, size_t end) {
+        if (D < kSoftmaxChunk) {
+          SoftmaxShortRowsFused(
+              end - begin, D, X + begin * D, Y + begin * D, logarithmic,
+              fast_exp);
+          return;
+        }
+        for (size_t row = begin; row < end; ++row) {
+          SoftmaxRowFused(D, X + row * D, Y + row * D, logarithmic, fast_exp);
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / D, 1),
+      1);
+}
+
 } // namespace caffe2
 
 #endif // #define CAFFE2_OPERATORS_SOFTMAX_SHARED_H_
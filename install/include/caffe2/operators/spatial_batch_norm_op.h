@@ -3,9 +3,83 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
 
 namespace caffe2 {
+namespace detail {
+
+/**
+ * Folds inference mode batch normalization into one multiply-add per value,
+ * Y = X * alpha + beta, with per channel
+ *   alpha = scale / sqrt(var + epsilon), beta = bias - mean * alpha.
+ */
+inline void SpatialBNFold(
+    int C,
+    const float* scale,
+    const float* bias,
+    const float* mean,
+    const float* var,
+    float epsilon,
+    float* alpha,
+    float* beta) {
+  EigenVectorArrayMap<float> a(alpha, C);
+  a = ConstEigenVectorArrayMap<float>(scale, C) *
+      (ConstEigenVectorArrayMap<float>(var, C) + epsilon).rsqrt();
+  EigenVectorArrayMap<float>(beta, C) =
+      ConstEigenVectorArrayMap<float>(bias, C) -
+      ConstEigenVectorArrayMap<float>(mean, C) * a;
+}
+
+// Y = X * alpha + beta over the N * C planes of HW values of X in NCHW
+// order, split over the thread pool.
+inline void SpatialBNApplyNCHW(
+    int N,
+    int C,
+    int HW,
+    const float* alpha,
+    const float* beta,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      static_cast<size_t>(N) * C,
+      [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const int c = i % C;
+          EigenVectorArrayMap<float>(Y + i * HW, HW) =
+              ConstEigenVectorArrayMap<float>(X + i * HW, HW) * alpha[c] +
+              beta[c];
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / HW, 1),
+      1);
+}
+
+// Y = X * alpha + beta over rows of C channels in NHWC order, split over
+// the thread pool.
+inline void SpatialBNApplyNHWC(
+    int rows,
+    int C,
+    const float* alpha,
+    const float* beta,
+    const float* X,
+    float* Y) {
+  ParallelFor(
+      rows,
+      [=](size_t begin, size_t end) {
+        ConstEigenVectorArrayMap<float> a(alpha, C);
+        ConstEigenVectorArrayMap<float> b(beta, C);
+        for (size_t row = begin; row < end; ++row) {
+          EigenVectorArrayMap<float>(Y + row * C, C) =
+              ConstEigenVectorArrayMap<float>(X + row * C, C) * a + b;
+        }
+      },
+      std::max(CAFFE2_PARALLEL_GRAIN / C, 1),
+      1);
+}
+
+} // namespace detail
 
 template <class Context>
 class SpatialBNOp : public Operator<Context> {
@@ -68,6 +142,95 @@ class SpatialBNGradientOp : public Operator<Context> {
   OUTPUT_TAGS(INPUT_GRAD, SCALE_GRAD, BIAS_GRAD);
 };
 
+
+/**
+ * SpatialBN on float CPU tensors for the SIMD engine, see simd_engine.h. In
+ * inference mode (is_test) the statistics are folded into a per channel
+ * multiply-add, applied in one pass over X; training runs the default
+ * engine SpatialBNOp.
+ */
+class SIMDSpatialBNOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDSpatialBNOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        is_test_(OperatorBase::GetSingleArgument<int>("is_test", 0)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)),
+        order_(StringToStorageOrder(
+            OperatorBase::GetSingleArgument<string>("order", "NCHW"))) {
+    if (!is_test_) {
+      fallback_ = CreateDefaultEngineOperator(operator_def, ws);
+    }
+  }
+
+  bool RunOnDevice() override {
+    if (!is_test_) {
+      return fallback_->Run();
+    }
+    const auto& X = Input(INPUT);
+    CAFFE_ENFORCE_GE(X.ndim(), 2);
+    const int N = X.dim32(0);
+    const int C = order_ == StorageOrder::NCHW ? X.dim32(1)
+                                               : X.dim32(X.ndim() - 1);
+    CAFFE_ENFORCE_EQ(Input(SCALE).size(), C);
+    CAFFE_ENFORCE_EQ(Input(BIAS).size(), C);
+    CAFFE_ENFORCE_EQ(Input(EST_MEAN).size(), C);
+    CAFFE_ENFORCE_EQ(Input(EST_VAR).size(), C);
+    auto* Y = Output(OUTPUT);
+    Y->ResizeLike(X);
+    if (X.size() == 0) {
+      return true;
+    }
+    alpha_.Resize(C);
+    beta_.Resize(C);
+    float* alpha = alpha_.mutable_data<float>();
+    float* beta = beta_.mutable_data<float>();
+    detail::SpatialBNFold(
+        C,
+        Input(SCALE).data<float>(),
+        Input(BIAS).data<float>(),
+        Input(EST_MEAN).data<float>(),
+        Input(EST_VAR).data<float>(),
+        epsilon_,
+        alpha,
+        beta);
+    const float* Xdata = X.data<float>();
+    float* Ydata = Y->mutable_data<float>();
+    if (order_ == StorageOrder::NCHW) {
+      detail::SpatialBNApplyNCHW(
+          N, C, X.size() / (N * C), alpha, beta, Xdata, Ydata);
+    } else {
+      detail::SpatialBNApplyNHWC(X.size() / C, C, alpha, beta, Xdata, Ydata);
+    }
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(INPUT, SCALE, BIAS, EST_MEAN, EST_VAR);
+  OUTPUT_TAGS(OUTPUT);
+
+ private:
+  bool is_test_;
+  float epsilon_;
+  StorageOrder order_;
+  TensorCPU alpha_;
+  TensorCPU beta_;
+  unique_ptr<OperatorBase> fallback_;
+};
+
+// Registers SIMDSpatialBNOp with the SIMD engine, once per process.
+inline bool RegisterSIMDSpatialBNOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDSpatialBNOp>("SpatialBN");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_spatial_bn_op_registered = RegisterSIMDSpatialBNOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_SPATIAL_BATCH_NORM_OP_H_
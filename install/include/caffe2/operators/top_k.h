@@ -1,9 +1,15 @@
 #ifndef CAFFE2_OPERATORS_TOP_K_H_
 #define CAFFE2_OPERATORS_TOP_K_H_
 
+#include <algorithm>
+#include <utility>
+
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/top_k.h"
 
 namespace caffe2 {
 
@@ -92,6 +98,85 @@ class TopKOp : public Operator<Context> {
   int k_;
 };
 
+/**
+ * TopK for float CPU inputs with the SIMD engine: each row is selected with
+ * the bounded heap of TopKRow() instead of a partial sort of all its indices,
+ * and rows are spread over the thread pool. Other input types run the
+ * default engine TopKOp.
+ */
+class SIMDTopKOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDTopKOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(int, "k", k_, -1),
+        fallback_(CreateDefaultEngineOperator(operator_def, ws)) {
+    CAFFE_ENFORCE(k_ >= 1, "k argument must be >= 1");
+  }
+
+  bool RunOnDevice() override {
+    auto& input = Input(0);
+    if (!input.IsType<float>()) {
+      return fallback_->Run();
+    }
+    auto* values = Output(0);
+    auto* indices = Output(1);
+
+    vector<TIndex> in_dims = input.dims();
+    const TIndex rows = size_to_dim_(in_dims.size() - 1, in_dims);
+    const TIndex cols = in_dims[in_dims.size() - 1];
+    CAFFE_ENFORCE_LE(k_, cols, "k argument must be <= the last dimension");
+    values->Resize(rows, k_);
+    indices->Resize(rows, k_);
+
+    const float* input_data = input.data<float>();
+    float* values_data = values->mutable_data<float>();
+    TIndex* indices_data = indices->mutable_data<TIndex>();
+    // Rows are spread over the thread pool once the input has at least
+    // 2 * CAFFE2_PARALLEL_GRAIN elements, each chunk with its own scratch.
+    ParallelFor(
+        rows,
+        [&](size_t begin, size_t end) {
+          vector<std::pair<float, TIndex>> scratch;
+          for (size_t row = begin; row < end; ++row) {
+            TopKRow(
+                input_data + row * cols,
+                cols,
+                static_cast<TIndex>(k_),
+                values_data + row * k_,
+                indices_data + row * k_,
+                &scratch);
+          }
+        },
+        std::max<size_t>(CAFFE2_PARALLEL_GRAIN / std::max<TIndex>(cols, 1), 1),
+        1);
+
+    // Reshape output tensors to [a_1, a_2, ..., a_n, k]
+    auto out_dims = in_dims;
+    out_dims[out_dims.size() - 1] = k_;
+    values->Reshape(out_dims);
+    indices->Reshape(out_dims);
+    return true;
+  }
+
+ private:
+  int k_;
+  unique_ptr<OperatorBase> fallback_;
+};
+
+// Registers SIMDTopKOp with the SIMD engine, once per process.
+inline bool RegisterSIMDTopKOp() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDTopKOp>("TopK");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_top_k_op_registered = RegisterSIMDTopKOp();
+} // namespace
+
 } // namespace caffe2
 
 #endif // CAFFE2_OPERATORS_TOP_K_H_
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "caffe2/core/blob_stats.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/stats.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/core/workspace.h"
+
+namespace caffe2 {
+
+// A thread-safe, bounded, blocking queue with the interface and QueueStats of
+// BlobsQueue, plus batched readMany()/writeMany().
+// Modelled as a lock-free bounded MPMC ring.
+
+// Containing blobs are owned by the workspace.
+// On read, we swap out the underlying data for the blob passed in for blobs
+
+// Producers and consumers claim slots with a CAS on their own cursor and hand
+// them over through a per-slot sequence number, so the fast path never takes
+// a lock. mutex_/cv_ are only used to park threads that found the queue full
+// (writers) or empty (readers) after a short spin.
+//
+// BlobsQueue itself is compiled into the prebuilt libraries, whose queue ops
+// depend on its layout, so the ring is a queue type of its own, created by
+// the CreateRingBlobsQueue op of ring_blobs_queue_ops.h.
+class RingBlobsQueue : public std::enable_shared_from_this<RingBlobsQueue> {
+ public:
+  RingBlobsQueue(
+      Workspace* ws,
+      const std::string& queueName,
+      size_t capacity,
+      size_t numBlobs,
+      bool enforceUniqueName,
+      const std::vector<std::string>& fieldNames = {})
+      : numBlobs_(numBlobs),
+        capacity_(capacity),
+        slots_(new Slot[capacity]),
+        stats_(queueName) {
+    CAFFE_ENFORCE_GT(capacity, 0, "Queue capacity must be positive.");
+    if (!fieldNames.empty()) {
+      CAFFE_ENFORCE_EQ(
+          fieldNames.size(), numBlobs, "Wrong number of fieldNames provided.");
+      stats_.queue_dequeued_bytes.setDetails(fieldNames);
+    }
+    for (auto i = 0; i < capacity; ++i) {
+      auto& blobs = slots_[i].blobs;
+      blobs.reserve(numBlobs);
+      for (auto j = 0; j < numBlobs; ++j) {
+        const auto blobName =
+            queueName + "_" + to_string(i) + "_" + to_string(j);
+        if (enforceUniqueName) {
+          CAFFE_ENFORCE(
+              !ws->GetBlob(blobName),
+              "Queue internal blob already exists: ",
+              blobName);
+        }
+        blobs.push_back(ws->CreateBlob(blobName));
+      }
+      slots_[i].seq.store(2 * int64_t(i), std::memory_order_relaxed);
+    }
+  }
+
+  ~RingBlobsQueue() {
+    close();
+  }
+
+  bool blockingRead(const std::vector<Blob*>& inputs) {
+    auto keeper = this->shared_from_this();
+    checkSize(inputs);
+    CAFFE_EVENT(stats_, queue_balance, -1);
+    int64_t pos;
+    if (!waitFor([this, &pos]() { return claimRead(1, &pos); })) {
+      return false;
+    }
+    doRead(pos, inputs);
+    wakeWaiters();
+    return true;
+  }
+
+  // Dequeues up to outputs.size() records with a single claim on the ring.
+  // Blocks until at least one record is available; returns the number of
+  // records read, which is 0 only once the queue is closed and drained.
+  size_t readMany(const std::vector<std::vector<Blob*>>& outputs) {
+    if (outputs.empty()) {
+      return 0;
+    }
+    auto keeper = this->shared_from_this();
+    for (const auto& output : outputs) {
+      checkSize(output);
+    }
+    int64_t pos;
+    size_t n = 0;
+    if (!waitFor([this, &outputs, &pos, &n]() {
+          n = claimReadMany(outputs.size(), &pos);
+          return n > 0;
+        })) {
+      return 0;
+    }
+    CAFFE_EVENT(stats_, queue_balance, -int64_t(n));
+    for (size_t i = 0; i < n; ++i) {
+      doRead(pos + i, outputs[i]);
+    }
+    wakeWaiters();
+    return n;
+  }
+
+  bool tryWrite(const std::vector<Blob*>& inputs) {
+    auto keeper = this->shared_from_this();
+    checkSize(inputs);
+    int64_t pos;
+    if (!claimWrite(1, &pos)) {
+      return false;
+    }
+    CAFFE_EVENT(stats_, queue_balance, 1);
+    doWrite(pos, inputs);
+    wakeWaiters();
+    return true;
+  }
+
+  bool blockingWrite(const std::vector<Blob*>& inputs) {
+    auto keeper = this->shared_from_this();
+    checkSize(inputs);
+    CAFFE_EVENT(stats_, queue_balance, 1);
+    int64_t pos;
+    if (!waitFor([this, &pos]() { return claimWrite(1, &pos); })) {
+      return false;
+    }
+    doWrite(pos, inputs);
+    wakeWaiters();
+    return true;
+  }
+
+  // Enqueues all of inputs, claiming as many consecutive free slots as are
+  // available at a time. Returns the number of records written, which is
+  // less than inputs.size() only if the queue was closed while full.
+  size_t writeMany(const std::vector<std::vector<Blob*>>& inputs) {
+    auto keeper = this->shared_from_this();
+    for (const auto& input : inputs) {
+      checkSize(input);
+    }
+    CAFFE_EVENT(stats_, queue_balance, int64_t(inputs.size()));
+    size_t written = 0;
+    while (written < inputs.size()) {
+      int64_t pos;
+      size_t n = 0;
+      const size_t want = std::min(inputs.size() - written, capacity_);
+      if (!waitFor([this, want, &pos, &n]() {
+            n = claimWriteMany(want, &pos);
+            return n > 0;
+          })) {
+        break;
+      }
+      for (size_t i = 0; i < n; ++i) {
+        doWrite(pos + i, inputs[written + i]);
+      }
+      written += n;
+      wakeWaiters();
+    }
+    return written;
+  }
+
+  void close() {
+    closing_ = true;
+
+    std::lock_guard<std::mutex> g(mutex_);
+    cv_.notify_all();
+  }
+
+  size_t getNumBlobs() const {
+    return numBlobs_;
+  }
+
+ private:
+  struct Slot {
+    // 2 * pos while the slot is free for the writer of ring position pos and
+    // 2 * pos + 1 once it holds that record for the reader. The factor of two
+    // keeps the two states distinct even when capacity is 1.
+    std::atomic<int64_t> seq{0};
+    std::vector<Blob*> blobs;
+  };
+
+  // Number of failed claims to spin through before parking on cv_.
+  static constexpr int kSpinCount = 64;
+
+  Slot& slotAt(int64_t pos) {
+    return slots_[pos % capacity_];
+  }
+
+  bool claimRead(size_t n, int64_t* pos) {
+    return claimReadMany(n, pos) == n;
+  }
+
+  bool claimWrite(size_t n, int64_t* pos) {
+    return claimWriteMany(n, pos) == n;
+  }
+
+  // Claims up to n consecutive readable slots. Returns the number claimed.
+  size_t claimReadMany(size_t n, int64_t* pos) {
+    int64_t cur = reader_.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t ready = 0;
+      while (ready < n &&
+             slotAt(cur + ready).seq.load(std::memory_order_acquire) ==
+                 2 * (cur + int64_t(ready)) + 1) {
+        ++ready;
+      }
+      if (ready == 0) {
+        // Either empty or another reader moved past cur; re-check the
+        // cursor before reporting empty.
+        const int64_t now = reader_.load(std::memory_order_relaxed);
+        if (now == cur) {
+          return 0;
+        }
+        cur = now;
+        continue;
+      }
+      if (reader_.compare_exchange_weak(
+              cur, cur + ready, std::memory_order_relaxed)) {
+        *pos = cur;
+        return ready;
+      }
+    }
+  }
+
+  // Claims up to n consecutive writable slots. Returns the number claimed.
+  size_t claimWriteMany(size_t n, int64_t* pos) {
+    int64_t cur = writer_.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t ready = 0;
+      while (ready < n &&
+             slotAt(cur + ready).seq.load(std::memory_order_acquire) ==
+                 2 * (cur + int64_t(ready))) {
+        ++ready;
+      }
+      if (ready == 0) {
+        const int64_t now = writer_.load(std::memory_order_relaxed);
+        if (now == cur) {
+          return 0;
+        }
+        cur = now;
+        continue;
+      }
+      if (writer_.compare_exchange_weak(
+              cur, cur + ready, std::memory_order_relaxed)) {
+        *pos = cur;
+        return ready;
+      }
+    }
+  }
+
+  // Must be called before a slot is claimed: once claimed, doRead() and
+  // doWrite() have to hand it on, or the readers and writers that come
+  // around to it later block forever.
+  void checkSize(const std::vector<Blob*>& blobs) const {
+    CAFFE_ENFORCE(blobs.size() >= numBlobs_);
+  }
+
+  // The slot at pos must have been claimed, and inputs checked by
+  // checkSize().
+  void doRead(int64_t pos, const std::vector<Blob*>& inputs) {
+    auto& slot = slotAt(pos);
+    auto& result = slot.blobs;
+    for (auto i = 0; i < result.size(); ++i) {
+      auto bytes = BlobStat::sizeBytes(*result[i]);
+      CAFFE_EVENT(stats_, queue_dequeued_bytes, bytes, i);
+      using std::swap;
+      swap(*(inputs[i]), *(result[i]));
+    }
+    CAFFE_EVENT(stats_, queue_dequeued_records);
+    slot.seq.store(2 * (pos + int64_t(capacity_)), std::memory_order_release);
+  }
+
+  void doWrite(int64_t pos, const std::vector<Blob*>& inputs) {
+    auto& slot = slotAt(pos);
+    auto& result = slot.blobs;
+    for (auto i = 0; i < result.size(); ++i) {
+      using std::swap;
+      swap(*(inputs[i]), *(result[i]));
+    }
+    slot.seq.store(2 * pos + 1, std::memory_order_release);
+  }
+
+  // Retries tryClaim, spinning briefly and then parking on cv_, until it
+  // succeeds or the queue is closed. As in BlobsQueue, a closed queue still
+  // lets pending claims go through if they can be satisfied immediately.
+  template <typename F>
+  bool waitFor(F tryClaim) {
+    for (int spin = 0; spin < kSpinCount; ++spin) {
+      if (tryClaim()) {
+        return true;
+      }
+      if (closing_) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> g(mutex_);
+    ++waiters_;
+    // Pairs with the fence in wakeWaiters(): either the claimant sees the
+    // slot update, or the notifier sees waiters_ > 0.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool claimed = false;
+    cv_.wait(g, [this, &tryClaim, &claimed]() {
+      claimed = tryClaim();
+      return claimed || closing_;
+    });
+    --waiters_;
+    return claimed;
+  }
+
+  void wakeWaiters() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> g(mutex_);
+      cv_.notify_all();
+    }
+  }
+
+  std::atomic<bool> closing_{false};
+
+  size_t numBlobs_;
+  size_t capacity_;
+  std::mutex mutex_; // only used to park readers/writers, see waitFor().
+  std::condition_variable cv_;
+  std::atomic<int> waiters_{0};
+  // Keep the two cursors on separate cache lines so that producers and
+  // consumers do not false-share.
+  alignas(64) std::atomic<int64_t> reader_{0};
+  alignas(64) std::atomic<int64_t> writer_{0};
+  std::unique_ptr<Slot[]> slots_;
+
+  struct QueueStats {
+    CAFFE_STAT_CTOR(QueueStats);
+    CAFFE_EXPORTED_STAT(queue_balance);
+    CAFFE_EXPORTED_STAT(queue_dequeued_records);
+    CAFFE_DETAILED_EXPORTED_STAT(queue_dequeued_bytes);
+  } stats_;
+};
+
+// CAFFE_KNOWN_TYPE defines TypeMeta::Id<T>() out of line, so it cannot be
+// used in a header.
+template <>
+inline CaffeTypeId TypeMeta::Id<std::shared_ptr<RingBlobsQueue>>() {
+  static bool type_id_bit[1];
+  static TypeNameRegisterer<std::shared_ptr<RingBlobsQueue>> registerer(
+      reinterpret_cast<CaffeTypeId>(type_id_bit));
+  return reinterpret_cast<CaffeTypeId>(type_id_bit);
+}
+}
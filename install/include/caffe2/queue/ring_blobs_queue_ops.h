@@ -0,0 +1,176 @@
+#pragma once
+
+#include <memory>
+#include "ring_blobs_queue.h"
+#include "caffe2/core/operator.h"
+
+namespace caffe2 {
+
+// The RingBlobsQueue counterparts of CreateBlobsQueue, EnqueueBlobs,
+// DequeueBlobs and CloseBlobsQueue, with the same arguments and semantics.
+
+template <typename Context>
+class CreateRingBlobsQueueOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+
+  CreateRingBlobsQueueOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws), ws_(ws) {}
+
+  bool RunOnDevice() override {
+    const auto capacity =
+        OperatorBase::template GetSingleArgument<int>("capacity", 1);
+    const auto numBlobs =
+        OperatorBase::template GetSingleArgument<int>("num_blobs", 1);
+    const auto enforceUniqueName =
+        OperatorBase::template GetSingleArgument<int>(
+            "enforce_unique_name", false);
+    const auto fieldNames =
+        OperatorBase::template GetRepeatedArgument<std::string>("field_names");
+    CAFFE_ENFORCE_EQ(def().output().size(), 1);
+    const auto name = def().output().Get(0);
+    auto queuePtr =
+        Operator<Context>::Outputs()[0]
+            ->template GetMutable<std::shared_ptr<RingBlobsQueue>>();
+    CAFFE_ENFORCE(queuePtr);
+    *queuePtr = std::make_shared<RingBlobsQueue>(
+        ws_, name, capacity, numBlobs, enforceUniqueName, fieldNames);
+    return true;
+  }
+
+ private:
+  Workspace* ws_{nullptr};
+};
+
+template <typename Context>
+class EnqueueRingBlobsOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(InputSize() > 1);
+    auto queue = Operator<Context>::Inputs()[0]
+                     ->template Get<std::shared_ptr<RingBlobsQueue>>();
+    CAFFE_ENFORCE(queue && OutputSize() == queue->getNumBlobs());
+    return queue->blockingWrite(this->Outputs());
+  }
+};
+
+template <typename Context>
+class DequeueRingBlobsOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(InputSize() == 1);
+    auto queue = OperatorBase::Inputs()[0]
+                     ->template Get<std::shared_ptr<RingBlobsQueue>>();
+    CAFFE_ENFORCE(queue && OutputSize() == queue->getNumBlobs());
+    return queue->blockingRead(this->Outputs());
+  }
+};
+
+template <typename Context>
+class CloseRingBlobsQueueOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  using Operator<Context>::Operator;
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE_EQ(InputSize(), 1);
+    auto queue = OperatorBase::Inputs()[0]
+                     ->template Get<std::shared_ptr<RingBlobsQueue>>();
+    CAFFE_ENFORCE(queue);
+    queue->close();
+    return true;
+  }
+};
+
+// Registers the ops above and their schemas, once per process however many
+// translation units include this header: the REGISTER_ and OPERATOR_SCHEMA
+// macros cannot be used in a header, as a second registration of a key exits
+// the process.
+inline bool RegisterRingBlobsQueueOps() {
+  static const bool registered = []() {
+    if (!CPUOperatorRegistry()->Has("CreateRingBlobsQueue")) {
+      CPUOperatorRegistry()->Register(
+          "CreateRingBlobsQueue",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CreateRingBlobsQueueOp<CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("EnqueueRingBlobs")) {
+      CPUOperatorRegistry()->Register(
+          "EnqueueRingBlobs",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              EnqueueRingBlobsOp<CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("DequeueRingBlobs")) {
+      CPUOperatorRegistry()->Register(
+          "DequeueRingBlobs",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              DequeueRingBlobsOp<CPUContext>>);
+    }
+    if (!CPUOperatorRegistry()->Has("CloseRingBlobsQueue")) {
+      CPUOperatorRegistry()->Register(
+          "CloseRingBlobsQueue",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              CloseRingBlobsQueueOp<CPUContext>>);
+    }
+    if (!OpSchemaRegistry::Schema("CreateRingBlobsQueue")) {
+      OpSchemaRegistry::NewSchema("CreateRingBlobsQueue", __FILE__, __LINE__)
+          .NumInputs(0)
+          .NumOutputs(1)
+          .SetDoc(R"DOC(
+Creates a RingBlobsQueue, a lock-free bounded queue of records of num_blobs
+blobs each, for producers and consumers that would contend on the lock of a
+CreateBlobsQueue queue.
+)DOC")
+          .Arg("capacity", "Number of records the queue holds.")
+          .Arg("num_blobs", "Number of blobs in a record.")
+          .Arg(
+              "enforce_unique_name",
+              "If set, fail if the internal blobs of the queue already "
+              "exist in the workspace.")
+          .Arg("field_names", "Names of the blobs of a record, for stats.")
+          .Output(0, "queue", "The queue.");
+    }
+    if (!OpSchemaRegistry::Schema("EnqueueRingBlobs")) {
+      OpSchemaRegistry::NewSchema("EnqueueRingBlobs", __FILE__, __LINE__)
+          .NumInputsOutputs([](int inputs, int outputs) {
+            return inputs >= 2 && outputs >= 1 && inputs == outputs + 1;
+          })
+          .EnforceInplace([](int input, int output) {
+            return input == output + 1;
+          })
+          .SetDoc(R"DOC(
+Enqueues a record into a RingBlobsQueue, blocking while it is full. The blobs
+are moved into the queue, not copied. Fails once the queue is closed.
+)DOC");
+    }
+    if (!OpSchemaRegistry::Schema("DequeueRingBlobs")) {
+      OpSchemaRegistry::NewSchema("DequeueRingBlobs", __FILE__, __LINE__)
+          .NumInputsOutputs([](int inputs, int outputs) {
+            return inputs == 1 && outputs >= 1;
+          })
+          .SetDoc(R"DOC(
+Dequeues a record from a RingBlobsQueue, blocking while it is empty. Fails
+once the queue is closed and drained.
+)DOC");
+    }
+    if (!OpSchemaRegistry::Schema("CloseRingBlobsQueue")) {
+      OpSchemaRegistry::NewSchema("CloseRingBlobsQueue", __FILE__, __LINE__)
+          .NumInputs(1)
+          .NumOutputs(0)
+          .SetDoc(R"DOC(
+Closes a RingBlobsQueue, waking up the producers and consumers waiting on it.
+)DOC");
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_ring_blobs_queue_ops_registered = RegisterRingBlobsQueueOps();
+} // namespace
+
+} // namespace caffe2
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/sgd/sparse_update.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
 
@@ -22,6 +27,63 @@ void adagrad_update(
   }
 }
 
+namespace detail {
+
+// Float CPU adagrad_update on the gradient g + weight_decay * w, in a single
+// pass over memory split over the thread pool. nw and nh may alias w
+// and h.
+inline void AdagradUpdateCPU(
+    int N,
+    const float* w,
+    const float* g,
+    const float* h,
+    float* nw,
+    float* nh,
+    float epsilon,
+    float weight_decay,
+    float lr) {
+  ParallelFor(N, [=](size_t begin, size_t end) {
+    size_t i = begin;
+#if CAFFE2_MATH_VECTOR_SIMD
+    using S = math::detail::SimdFloat;
+    const S::V vlr = S::Set(lr);
+    const S::V veps = S::Set(epsilon);
+    const S::V vdecay = S::Set(weight_decay);
+    for (; i + S::kWidth <= end; i += S::kWidth) {
+      const S::V wi = S::Load(w + i);
+      const S::V gi = S::MulAdd(vdecay, wi, S::Load(g + i));
+      const S::V hi = S::MulAdd(gi, gi, S::Load(h + i));
+      S::Store(nh + i, hi);
+      S::Store(
+          nw + i,
+          S::Add(wi, S::Div(S::Mul(vlr, gi), S::Add(S::Sqrt(hi), veps))));
+    }
+#endif // CAFFE2_MATH_VECTOR_SIMD
+    for (; i < end; ++i) {
+      const float gi = g[i] + weight_decay * w[i];
+      const float hi = nh[i] = h[i] + gi * gi;
+      nw[i] = w[i] + lr * gi / (std::sqrt(hi) + epsilon);
+    }
+  });
+}
+
+// One row of RowWiseSparseAdagrad: the single moment h of the row gathers
+// the mean square of the row's gradient, and the whole row takes the step
+// lr / (sqrt(h) + epsilon).
+inline void RowWiseAdagradUpdateRow(
+    int N,
+    float* w,
+    const float* g,
+    float* h,
+    float epsilon,
+    float lr) {
+  ConstEigenVectorArrayMap<float> gi(g, N);
+  *h += gi.square().sum() / N;
+  EigenVectorArrayMap<float>(w, N) += lr / (std::sqrt(*h) + epsilon) * gi;
+}
+
+} // namespace detail
+
 template <typename T, class Context>
 class AdagradOp final : public Operator<Context> {
  public:
@@ -118,4 +180,211 @@ class SparseAdagradOp final : public Operator<Context> {
   INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
   OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
 };
+
+/**
+ * Sparse Adagrad with a single moment per row of PARAM instead of one per
+ * value: MOMENT_1 has PARAM.dim(0) entries, and each row updated steps by
+ * the learning rate over the root of its accumulated mean square gradient.
+ * Float CPU only.
+ */
+template <typename T, class Context>
+class RowWiseSparseAdagradOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  RowWiseSparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)) {}
+
+  bool RunOnDevice() override {
+    // Enforce shapes
+    CAFFE_ENFORCE_GE(Input(PARAM).ndim(), 1);
+    CAFFE_ENFORCE_EQ(Input(PARAM).dim(0), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(Input(LR).size(), 1);
+    CAFFE_ENFORCE_EQ(Input(PARAM).size_from_dim(1),
+        Input(GRAD).size_from_dim(Input(INDICES).ndim()));
+
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto n = Input(INDICES).size();
+    if (n == 0) {
+      return true;
+    }
+    const auto block_size = Input(PARAM).size_from_dim(1);
+    const T lr = Input(LR).template data<T>()[0];
+    const T epsilon = epsilon_;
+    const auto* indices = Input(INDICES).template data<SIndex>();
+    const auto* gradIn = Input(GRAD).template data<T>();
+    auto* param = Output(OUTPUT_PARAM)->template mutable_data<T>();
+    auto* moment = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
+    CAFFE_ENFORCE_EQ(
+        Input(PARAM).template data<T>(), param, "In place update required");
+    CAFFE_ENFORCE_EQ(
+        Input(MOMENT_1).template data<T>(),
+        moment,
+        "In place update required");
+    detail::ForEachSparseRow(
+        n,
+        indices,
+        detail::SparseRowGrain(block_size),
+        &order_,
+        [=](TIndex i) {
+          detail::RowWiseAdagradUpdateRow(
+              block_size,
+              param + indices[i] * block_size,
+              gradIn + i * block_size,
+              moment + indices[i],
+              epsilon,
+              lr);
+        },
+        [=](SIndex idx) {
+          detail::PrefetchRow(param + idx * block_size, block_size);
+          detail::PrefetchRow(moment + idx, 1);
+        });
+    return true;
+  }
+
+ protected:
+  T epsilon_;
+  std::vector<TIndex> order_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+/**
+ * Adagrad on float CPU tensors for the SIMD engine, see simd_engine.h: one
+ * pass of AdagradUpdateCPU(). The optional weight_decay argument adds
+ * weight_decay * PARAM to the gradient within the same pass.
+ */
+class SIMDAdagradOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)),
+        weight_decay_(
+            OperatorBase::GetSingleArgument<float>("weight_decay", 0.f)) {}
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENT_1).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(PARAM).size());
+    CAFFE_ENFORCE_EQ(Input(LR).size(), 1);
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+    detail::AdagradUpdateCPU(
+        Input(GRAD).size(),
+        Input(PARAM).data<float>(),
+        Input(GRAD).data<float>(),
+        Input(MOMENT_1).data<float>(),
+        Output(OUTPUT_PARAM)->mutable_data<float>(),
+        Output(OUTPUT_MOMENT_1)->mutable_data<float>(),
+        epsilon_,
+        weight_decay_,
+        Input(LR).data<float>()[0]);
+    return true;
+  }
+
+ protected:
+  float epsilon_;
+  float weight_decay_;
+  INPUT_TAGS(PARAM, MOMENT_1, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+/**
+ * SparseAdagrad on float CPU tensors for the SIMD engine: one
+ * AdagradUpdateCPU() per row, with the rows ahead prefetched and the rows
+ * split over the thread pool by ForEachSparseRow().
+ */
+class SIMDSparseAdagradOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDSparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)) {}
+
+  bool RunOnDevice() override {
+    // Enforce shapes
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(Input(LR).size(), 1);
+    CAFFE_ENFORCE_EQ(Input(PARAM).size_from_dim(1),
+        Input(GRAD).size_from_dim(Input(INDICES).ndim()));
+
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto n = Input(GRAD).dim(0);
+    if (n == 0) {
+      return true;
+    }
+    const auto block_size = Input(GRAD).size() / n;
+    const float lr = Input(LR).data<float>()[0];
+    const float epsilon = epsilon_;
+    const auto* indices = Input(INDICES).data<SIndex>();
+    const auto* gradIn = Input(GRAD).data<float>();
+    const auto* paramIn = Input(PARAM).data<float>();
+    const auto* momentIn = Input(MOMENT_1).data<float>();
+    auto* paramOut = Output(OUTPUT_PARAM)->mutable_data<float>();
+    auto* momentOut = Output(OUTPUT_MOMENT_1)->mutable_data<float>();
+    detail::ForEachSparseRow(
+        n,
+        indices,
+        detail::SparseRowGrain(block_size),
+        &order_,
+        [=](TIndex i) {
+          const auto offsetIdx = indices[i] * block_size;
+          detail::AdagradUpdateCPU(
+              block_size,
+              paramIn + offsetIdx,
+              gradIn + i * block_size,
+              momentIn + offsetIdx,
+              paramOut + offsetIdx,
+              momentOut + offsetIdx,
+              epsilon,
+              0.f,
+              lr);
+        },
+        [=](SIndex idx) {
+          detail::PrefetchRow(paramOut + idx * block_size, block_size);
+          detail::PrefetchRow(momentOut + idx * block_size, block_size);
+        });
+    return true;
+  }
+
+ protected:
+  float epsilon_;
+  std::vector<TIndex> order_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+/**
+ * Registers the SIMD engine adagrad ops and RowWiseSparseAdagrad, once per
+ * process. RowWiseSparseAdagrad is a default engine operator of its own, so
+ * it is registered directly unless the library already has it.
+ */
+inline bool RegisterSIMDAdagradOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDAdagradOp>("Adagrad");
+    RegisterSIMDEngineOperator<SIMDSparseAdagradOp>("SparseAdagrad");
+    if (!CPUOperatorRegistry()->Has("RowWiseSparseAdagrad")) {
+      CPUOperatorRegistry()->Register(
+          "RowWiseSparseAdagrad",
+          RegistererCPUOperatorRegistry::DefaultCreator<
+              RowWiseSparseAdagradOp<float, CPUContext>>);
+    }
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_adagrad_ops_registered = RegisterSIMDAdagradOps();
+} // namespace
+
 }
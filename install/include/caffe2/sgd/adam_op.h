@@ -1,6 +1,10 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/sgd/sparse_update.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
 
@@ -52,6 +56,61 @@ void adam_compute(
   }
 }
 
+namespace detail {
+
+// Float CPU adam_compute on the gradient g + weight_decay * w, in a single
+// pass over memory split over the thread pool. The outputs may alias
+// the corresponding inputs.
+inline void AdamComputeCPU(
+    int N,
+    const float* w,
+    const float* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    float beta1,
+    float beta2,
+    float eps_hat,
+    float weight_decay,
+    float step) {
+  ParallelFor(N, [=](size_t begin, size_t end) {
+    size_t i = begin;
+#if CAFFE2_MATH_VECTOR_SIMD
+    using S = math::detail::SimdFloat;
+    const S::V vbeta1 = S::Set(beta1);
+    const S::V vbeta2 = S::Set(beta2);
+    const S::V vrest1 = S::Set(1 - beta1);
+    const S::V vrest2 = S::Set(1 - beta2);
+    const S::V veps = S::Set(eps_hat);
+    const S::V vdecay = S::Set(weight_decay);
+    const S::V vstep = S::Set(step);
+    for (; i + S::kWidth <= end; i += S::kWidth) {
+      const S::V wi = S::Load(w + i);
+      const S::V gi = S::MulAdd(vdecay, wi, S::Load(g + i));
+      const S::V mi =
+          S::MulAdd(S::Load(m + i), vbeta1, S::Mul(gi, vrest1));
+      const S::V vi = S::MulAdd(
+          S::Load(v + i), vbeta2, S::Mul(S::Mul(gi, gi), vrest2));
+      S::Store(nm + i, mi);
+      S::Store(nv + i, vi);
+      S::Store(
+          nw + i,
+          S::Add(wi, S::Div(S::Mul(vstep, mi), S::Add(S::Sqrt(vi), veps))));
+    }
+#endif // CAFFE2_MATH_VECTOR_SIMD
+    for (; i < end; ++i) {
+      const float gi = g[i] + weight_decay * w[i];
+      const float mi = nm[i] = m[i] * beta1 + gi * (1 - beta1);
+      const float vi = nv[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      nw[i] = w[i] + step * mi / (std::sqrt(vi) + eps_hat);
+    }
+  });
+}
+
+} // namespace detail
+
 template <typename T, class Context>
 class AdamOp final : public Operator<Context> {
  public:
@@ -189,4 +248,162 @@ class SparseAdamOp final : public Operator<Context> {
   INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, INDICES, GRAD, LR, ITER);
   OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1, OUTPUT_MOMENT_2);
 };
+
+/**
+ * Adam on float CPU tensors for the SIMD engine, see simd_engine.h: one pass
+ * of AdamComputeCPU(), with the learning rate and bias correction folded
+ * into a single step size. The optional weight_decay argument adds
+ * weight_decay * PARAM to the gradient within the same pass.
+ */
+class SIMDAdamOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9f)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999f)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)),
+        weight_decay_(
+            OperatorBase::GetSingleArgument<float>("weight_decay", 0.f)) {}
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(OperatorBase::InputIsType<TensorCPU>(ITER));
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(PARAM).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENT_1).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENT_2).size());
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+    Output(OUTPUT_MOMENT_2)->ResizeLike(Input(MOMENT_2));
+
+    const auto t = Input(ITER).data<int64_t>()[0] + 1;
+    const float correction = std::sqrt(1.f - std::pow(beta2_, t)) /
+        (1.f - std::pow(beta1_, t));
+    detail::AdamComputeCPU(
+        Input(GRAD).size(),
+        Input(PARAM).data<float>(),
+        Input(GRAD).data<float>(),
+        Input(MOMENT_1).data<float>(),
+        Input(MOMENT_2).data<float>(),
+        Output(OUTPUT_PARAM)->mutable_data<float>(),
+        Output(OUTPUT_MOMENT_1)->mutable_data<float>(),
+        Output(OUTPUT_MOMENT_2)->mutable_data<float>(),
+        beta1_,
+        beta2_,
+        epsilon_,
+        weight_decay_,
+        Input(LR).data<float>()[0] * correction);
+    return true;
+  }
+
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  float weight_decay_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, GRAD, LR, ITER);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1, OUTPUT_MOMENT_2);
+};
+
+/**
+ * SparseAdam on float CPU tensors for the SIMD engine: one AdamComputeCPU()
+ * per row, with the rows ahead prefetched and the rows split over the thread
+ * pool by ForEachSparseRow(). An empty GRAD is a no-op.
+ */
+class SIMDSparseAdamOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDSparseAdamOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        beta1_(OperatorBase::GetSingleArgument<float>("beta1", 0.9f)),
+        beta2_(OperatorBase::GetSingleArgument<float>("beta2", 0.999f)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)) {}
+
+  bool RunOnDevice() override {
+    // Enforce shapes
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_2).size());
+    CAFFE_ENFORCE_EQ(Input(PARAM).size_from_dim(1),
+        Input(GRAD).size_from_dim(Input(INDICES).ndim()));
+    CAFFE_ENFORCE_EQ(Input(LR).size(), 1);
+
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    const auto n = Input(GRAD).dim(0);
+    if (n == 0) {
+      return true;
+    }
+    const auto block_size = Input(GRAD).size() / n;
+    const auto t =
+        OperatorBase::Input<TensorCPU>(ITER).data<int64_t>()[0] + 1;
+    const float correction = std::sqrt(1.f - std::pow(beta2_, t)) /
+        (1.f - std::pow(beta1_, t));
+    const float step = Input(LR).data<float>()[0] * correction;
+    const float beta1 = beta1_;
+    const float beta2 = beta2_;
+    const float epsilon = epsilon_;
+    const auto* indices = Input(INDICES).data<SIndex>();
+    const auto* gradIn = Input(GRAD).data<float>();
+    const auto* paramIn = Input(PARAM).data<float>();
+    const auto* moment1In = Input(MOMENT_1).data<float>();
+    const auto* moment2In = Input(MOMENT_2).data<float>();
+    auto* paramOut = Output(OUTPUT_PARAM)->mutable_data<float>();
+    auto* moment1Out = Output(OUTPUT_MOMENT_1)->mutable_data<float>();
+    auto* moment2Out = Output(OUTPUT_MOMENT_2)->mutable_data<float>();
+    detail::ForEachSparseRow(
+        n,
+        indices,
+        detail::SparseRowGrain(block_size),
+        &order_,
+        [=](TIndex i) {
+          const auto offsetIdx = indices[i] * block_size;
+          detail::AdamComputeCPU(
+              block_size,
+              paramIn + offsetIdx,
+              gradIn + i * block_size,
+              moment1In + offsetIdx,
+              moment2In + offsetIdx,
+              paramOut + offsetIdx,
+              moment1Out + offsetIdx,
+              moment2Out + offsetIdx,
+              beta1,
+              beta2,
+              epsilon,
+              0.f,
+              step);
+        },
+        [=](SIndex idx) {
+          detail::PrefetchRow(paramOut + idx * block_size, block_size);
+          detail::PrefetchRow(moment1Out + idx * block_size, block_size);
+          detail::PrefetchRow(moment2Out + idx * block_size, block_size);
+        });
+    return true;
+  }
+
+ protected:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  std::vector<TIndex> order_;
+  INPUT_TAGS(PARAM, MOMENT_1, MOMENT_2, INDICES, GRAD, LR, ITER);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1, OUTPUT_MOMENT_2);
+};
+
+// Registers the SIMD engine adam ops, once per process.
+inline bool RegisterSIMDAdamOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDAdamOp>("Adam");
+    RegisterSIMDEngineOperator<SIMDSparseAdamOp>("SparseAdam");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_adam_ops_registered = RegisterSIMDAdamOps();
+} // namespace
+
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/sgd/sparse_update.h"
 
 namespace caffe2 {
 
@@ -17,6 +20,37 @@ struct FtrlParams {
   T lambda2;
 };
 
+namespace detail {
+
+// FTRL-proximal on one row of weights w and their interleaved (n, z)
+// accumulators nz, in place.
+template <typename T>
+inline void FtrlUpdateRow(
+    TIndex N,
+    T* w,
+    T* nz,
+    const T* g,
+    const FtrlParams<T>& params) {
+  for (TIndex i = 0; i < N; ++i) {
+    const T gi = g[i];
+    const T n = nz[i * 2];
+    const T new_n = n + gi * gi;
+    const T sqrt_new_n = std::sqrt(new_n);
+    const T sigma = (sqrt_new_n - std::sqrt(n)) * params.alphaInv;
+    const T z = nz[i * 2 + 1] + gi - sigma * w[i];
+    nz[i * 2] = new_n;
+    nz[i * 2 + 1] = z;
+    if (std::abs(z) > params.lambda1) {
+      w[i] = ((z < 0 ? -params.lambda1 : params.lambda1) - z) /
+          ((params.beta + sqrt_new_n) * params.alphaInv + params.lambda2);
+    } else {
+      w[i] = 0;
+    }
+  }
+}
+
+} // namespace detail
+
 // TODO(dzhulgakov): implement GPU version if necessary
 template <typename T, class Context>
 class FtrlOp final : public Operator<Context> {
@@ -62,4 +96,78 @@ class SparseFtrlOp final : public Operator<CPUContext> {
   void DoRun();
 };
 
+/**
+ * SparseFtrl on float CPU tensors for the SIMD engine, see simd_engine.h:
+ * SparseFtrlOp with the rows ahead prefetched and the rows split over the
+ * thread pool by ForEachSparseRow(). The update of a row stays scalar, as
+ * its (n, z) state is interleaved.
+ */
+class SIMDSparseFtrlOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDSparseFtrlOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws), params_(this) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    auto* var = Output(OUTPUT_VAR);
+    auto* n_z = Output(OUTPUT_N_Z);
+    auto& indices = Input(INDICES);
+    auto& grad = Input(GRAD);
+    CAFFE_ENFORCE_EQ(&Input(VAR), var, "In place operation is required");
+    CAFFE_ENFORCE_EQ(&Input(N_Z), n_z, "In place operation is required");
+    const TIndex K = indices.size();
+    if (K == 0) {
+      return true;
+    }
+    const TIndex block_size = var->size() / var->dim(0);
+    CAFFE_ENFORCE_EQ(var->size() * 2, n_z->size());
+    CAFFE_ENFORCE_EQ(grad.size(), K * block_size);
+    float* w = var->mutable_data<float>();
+    float* nz = n_z->mutable_data<float>();
+    const SIndex* idxs = indices.data<SIndex>();
+    const float* g = grad.data<float>();
+    const FtrlParams<float>& params = params_;
+    detail::ForEachSparseRow(
+        K,
+        idxs,
+        detail::SparseRowGrain(block_size),
+        &order_,
+        [=, &params](TIndex i) {
+          const TIndex x = idxs[i] * block_size;
+          detail::FtrlUpdateRow(
+              block_size, w + x, nz + x * 2, g + i * block_size, params);
+        },
+        [=](SIndex idx) {
+          detail::PrefetchRow(w + idx * block_size, block_size);
+          detail::PrefetchRow(nz + idx * block_size * 2, block_size * 2);
+        });
+    return true;
+  }
+
+ protected:
+  FtrlParams<float> params_;
+  std::vector<TIndex> order_;
+  INPUT_TAGS(VAR, N_Z, INDICES, GRAD);
+  OUTPUT_TAGS(OUTPUT_VAR, OUTPUT_N_Z);
+};
+
+// Registers SIMDSparseFtrlOp with the SIMD engine, once per process.
+inline bool RegisterSIMDFtrlOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDSparseFtrlOp>("SparseFtrl");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_ftrl_ops_registered = RegisterSIMDFtrlOps();
+} // namespace
+
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
 
@@ -35,6 +38,64 @@ void momentum_sgd_update(
   }
 }
 
+namespace detail {
+
+// Float CPU momentum_sgd_update in a single pass over memory split over the
+// thread pool, with the nesterov branch and lr hoisted out of the
+// loop. With param, the gradient is g + weight_decay * param. The outputs
+// may alias the corresponding inputs.
+inline void MomentumSGDUpdateCPU(
+    int N,
+    const float* g,
+    const float* m,
+    float* ng,
+    float* nm,
+    float lr,
+    float momentum,
+    bool nesterov,
+    float weight_decay,
+    float* param) {
+  ParallelFor(N, [=](size_t begin, size_t end) {
+    size_t i = begin;
+#if CAFFE2_MATH_VECTOR_SIMD
+    using S = math::detail::SimdFloat;
+    const S::V vlr = S::Set(lr);
+    const S::V vmomentum = S::Set(momentum);
+    const S::V vnesterov = S::Set(1 + momentum);
+    const S::V vdecay = S::Set(weight_decay);
+    for (; i + S::kWidth <= end; i += S::kWidth) {
+      S::V gi = S::Load(g + i);
+      S::V wi = vdecay;
+      if (param) {
+        wi = S::Load(param + i);
+        gi = S::MulAdd(vdecay, wi, gi);
+      }
+      const S::V mi = S::Load(m + i);
+      const S::V mi_new = S::MulAdd(vmomentum, mi, S::Mul(vlr, gi));
+      S::Store(nm + i, mi_new);
+      const S::V ngi = nesterov
+          ? S::Sub(S::Mul(vnesterov, mi_new), S::Mul(vmomentum, mi))
+          : mi_new;
+      S::Store(ng + i, ngi);
+      if (param) {
+        S::Store(param + i, S::Sub(wi, ngi));
+      }
+    }
+#endif // CAFFE2_MATH_VECTOR_SIMD
+    for (; i < end; ++i) {
+      const float gi = param ? g[i] + weight_decay * param[i] : g[i];
+      const float mi = m[i];
+      const float mi_new = nm[i] = momentum * mi + lr * gi;
+      ng[i] = nesterov ? (1 + momentum) * mi_new - momentum * mi : mi_new;
+      if (param) {
+        param[i] -= ng[i];
+      }
+    }
+  });
+}
+
+} // namespace detail
+
 template <typename T, class Context>
 class MomentumSGDOp final : public Operator<Context> {
  public:
@@ -180,4 +241,101 @@ class SparseMomentumSGDUpdateOp final : public Operator<Context> {
   INPUT_TAGS(GRAD, MOMENTUM, LR, PARAM, INDICES);
   OUTPUT_TAGS(OUTPUT_GRAD, OUTPUT_MOMENTUM, OUTPUT_PARAM);
 };
+
+/**
+ * MomentumSGD on float CPU tensors for the SIMD engine, see simd_engine.h:
+ * one pass of MomentumSGDUpdateCPU().
+ */
+class SIMDMomentumSGDOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDMomentumSGDOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0)),
+        nesterov_(OperatorBase::GetSingleArgument<int>("nesterov", 0)) {}
+
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENTUM).size());
+    Output(OUTPUT_GRAD)->ResizeLike(Input(GRAD));
+    Output(OUTPUT_MOMENTUM)->ResizeLike(Input(MOMENTUM));
+    detail::MomentumSGDUpdateCPU(
+        Input(GRAD).size(),
+        Input(GRAD).data<float>(),
+        Input(MOMENTUM).data<float>(),
+        Output(OUTPUT_GRAD)->mutable_data<float>(),
+        Output(OUTPUT_MOMENTUM)->mutable_data<float>(),
+        Input(LR).data<float>()[0],
+        momentum_,
+        nesterov_,
+        0.f,
+        nullptr);
+    return true;
+  }
+
+ protected:
+  float momentum_;
+  bool nesterov_;
+  INPUT_TAGS(GRAD, MOMENTUM, LR);
+  OUTPUT_TAGS(OUTPUT_GRAD, OUTPUT_MOMENTUM);
+};
+
+/**
+ * MomentumSGDUpdate on float CPU tensors for the SIMD engine: one pass of
+ * MomentumSGDUpdateCPU(), updating PARAM in it as well. The optional
+ * weight_decay argument adds weight_decay * PARAM to the gradient within the
+ * same pass.
+ */
+class SIMDMomentumSGDUpdateOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDMomentumSGDUpdateOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0)),
+        nesterov_(OperatorBase::GetSingleArgument<int>("nesterov", 0)),
+        weight_decay_(
+            OperatorBase::GetSingleArgument<float>("weight_decay", 0.f)) {}
+
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENTUM).size());
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(GRAD).size());
+    Output(OUTPUT_GRAD)->ResizeLike(Input(GRAD));
+    Output(OUTPUT_MOMENTUM)->ResizeLike(Input(MOMENTUM));
+    detail::MomentumSGDUpdateCPU(
+        Input(GRAD).size(),
+        Input(GRAD).data<float>(),
+        Input(MOMENTUM).data<float>(),
+        Output(OUTPUT_GRAD)->mutable_data<float>(),
+        Output(OUTPUT_MOMENTUM)->mutable_data<float>(),
+        Input(LR).data<float>()[0],
+        momentum_,
+        nesterov_,
+        weight_decay_,
+        Output(OUTPUT_PARAM)->mutable_data<float>());
+    return true;
+  }
+
+ protected:
+  float momentum_;
+  bool nesterov_;
+  float weight_decay_;
+  INPUT_TAGS(GRAD, MOMENTUM, LR, PARAM);
+  OUTPUT_TAGS(OUTPUT_GRAD, OUTPUT_MOMENTUM, OUTPUT_PARAM);
+};
+
+// Registers the SIMD engine momentum ops, once per process.
+inline bool RegisterSIMDMomentumSGDOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDMomentumSGDOp>("MomentumSGD");
+    RegisterSIMDEngineOperator<SIMDMomentumSGDUpdateOp>("MomentumSGDUpdate");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_momentum_sgd_ops_registered = RegisterSIMDMomentumSGDOps();
+} // namespace
+
 }
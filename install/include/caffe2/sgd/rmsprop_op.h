@@ -2,6 +2,9 @@
 
 #include "caffe2/core/common_omp.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/core/parallel.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/utils/math_vector.h"
 
 namespace caffe2 {
 
@@ -20,6 +23,56 @@ void rmsprop_update(
     const float* lr,
     Context* context);
 
+namespace detail {
+
+// Float CPU rmsprop_update in a single pass over memory split over the
+// thread pool, in place of the separate mean square, momentum and
+// gradient passes. The outputs may alias the corresponding inputs.
+inline void RmsPropUpdateCPU(
+    int N,
+    const float* g,
+    const float* ms,
+    const float* mom,
+    float* ng,
+    float* nms,
+    float* nmom,
+    float decay,
+    float momentum,
+    float epsilon,
+    float lr) {
+  ParallelFor(N, [=](size_t begin, size_t end) {
+    size_t i = begin;
+#if CAFFE2_MATH_VECTOR_SIMD
+    using S = math::detail::SimdFloat;
+    const S::V vrest = S::Set(1.0f - decay);
+    const S::V vmomentum = S::Set(momentum);
+    const S::V veps = S::Set(epsilon);
+    const S::V vlr = S::Set(lr);
+    for (; i + S::kWidth <= end; i += S::kWidth) {
+      const S::V gi = S::Load(g + i);
+      const S::V msi = S::Load(ms + i);
+      const S::V nmsi =
+          S::MulAdd(vrest, S::Sub(S::Mul(gi, gi), msi), msi);
+      const S::V nmomi = S::MulAdd(
+          S::Load(mom + i),
+          vmomentum,
+          S::Div(S::Mul(vlr, gi), S::Sqrt(S::Add(veps, nmsi))));
+      S::Store(nms + i, nmsi);
+      S::Store(nmom + i, nmomi);
+      S::Store(ng + i, nmomi);
+    }
+#endif // CAFFE2_MATH_VECTOR_SIMD
+    for (; i < end; ++i) {
+      const float gi = g[i];
+      const float nmsi = nms[i] = ms[i] + (1.0f - decay) * (gi * gi - ms[i]);
+      ng[i] = nmom[i] =
+          mom[i] * momentum + lr * gi / std::sqrt(epsilon + nmsi);
+    }
+  });
+}
+
+} // namespace detail
+
 template <typename T, class Context>
 class RmsPropOp final : public Operator<Context> {
  public:
@@ -60,4 +113,60 @@ class RmsPropOp final : public Operator<Context> {
   INPUT_TAGS(GRAD, MEAN_SQUARES, MOMENTUM, LR);
   OUTPUT_TAGS(OUTPUT_GRAD, OUTPUT_MEAN_SQUARES, OUTPUT_MOMENTUM);
 };
+
+/**
+ * RmsProp on float CPU tensors for the SIMD engine, see simd_engine.h: one
+ * pass of RmsPropUpdateCPU().
+ */
+class SIMDRmsPropOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SIMDRmsPropOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        decay_(OperatorBase::GetSingleArgument<float>("decay", 0.9f)),
+        momentum_(OperatorBase::GetSingleArgument<float>("momentum", 0.0f)),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5f)) {}
+  bool RunOnDevice() override {
+    CAFFE_ENFORCE(Input(LR).size() == 1);
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MEAN_SQUARES).size());
+    CAFFE_ENFORCE(Input(GRAD).size() == Input(MOMENTUM).size());
+    Output(OUTPUT_GRAD)->ResizeLike(Input(GRAD));
+    Output(OUTPUT_MEAN_SQUARES)->ResizeLike(Input(MEAN_SQUARES));
+    Output(OUTPUT_MOMENTUM)->ResizeLike(Input(MOMENTUM));
+    detail::RmsPropUpdateCPU(
+        Input(GRAD).size(),
+        Input(GRAD).data<float>(),
+        Input(MEAN_SQUARES).data<float>(),
+        Input(MOMENTUM).data<float>(),
+        Output(OUTPUT_GRAD)->mutable_data<float>(),
+        Output(OUTPUT_MEAN_SQUARES)->mutable_data<float>(),
+        Output(OUTPUT_MOMENTUM)->mutable_data<float>(),
+        decay_,
+        momentum_,
+        epsilon_,
+        Input(LR).data<float>()[0]);
+    return true;
+  }
+
+ protected:
+  float decay_;
+  float momentum_;
+  float epsilon_;
+  INPUT_TAGS(GRAD, MEAN_SQUARES, MOMENTUM, LR);
+  OUTPUT_TAGS(OUTPUT_GRAD, OUTPUT_MEAN_SQUARES, OUTPUT_MOMENTUM);
+};
+
+// Registers SIMDRmsPropOp with the SIMD engine, once per process.
+inline bool RegisterSIMDRmsPropOps() {
+  static const bool registered = []() {
+    RegisterSIMDEngineOperator<SIMDRmsPropOp>("RmsProp");
+    return true;
+  }();
+  return registered;
+}
+
+namespace {
+const bool g_simd_rmsprop_ops_registered = RegisterSIMDRmsPropOps();
+} // namespace
+
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "caffe2/core/parallel.h"
+
+namespace caffe2 {
+namespace detail {
+
+// Number of entries of a sparse update ahead of the one being applied whose
+// rows are prefetched.
+#ifndef CAFFE2_SPARSE_PREFETCH_DISTANCE
+#define CAFFE2_SPARSE_PREFETCH_DISTANCE 8
+#endif
+
+// Prefetches, for writing, the first cache lines of a row of size values.
+// The hardware prefetcher takes over for the rest of longer rows.
+template <typename T>
+inline void PrefetchRow(const T* row, TIndex size) {
+#ifdef __GNUC__
+  const char* bytes = reinterpret_cast<const char*>(row);
+  const TIndex end = std::min<TIndex>(size * sizeof(T), 512);
+  for (TIndex i = 0; i < end; i += 64) {
+    __builtin_prefetch(bytes + i, 1, 1);
+  }
+#endif // __GNUC__
+}
+
+/**
+ * Calls update(i) for each entry i of a sparse update with n indices, where
+ * update(i) writes the rows of indices[i] only, calling prefetch(idx) for
+ * the rows of the entries CAFFE2_SPARSE_PREFETCH_DISTANCE ahead.
+ *
+ * Updates of at least 2 * grain entries, when the thread pool has threads
+ * to spread them over, are applied in index order and split over the threads
+ * on index boundaries. All the entries of an index then run on one thread
+ * in their original order, so duplicate indices give the same result as
+ * the serial loop. That ordering covers this one update only: other ops or
+ * threads writing the same rows at the same time, such as Hogwild
+ * replicas, are not synchronised with it. order is scratch space for the
+ * sorted entries.
+ *
+ * The SIMD engine SparseAdagrad, SparseAdam and SparseFtrl operators apply
+ * their updates through it. Nets and plans opt into those with
+ * UseSIMDEngine() (see simd_engine.h); the default engine operators of the
+ * prebuilt libraries keep their serial loops.
+ */
+template <typename SIndex, typename Update, typename Prefetch>
+void ForEachSparseRow(
+    TIndex n,
+    const SIndex* indices,
+    TIndex grain,
+    std::vector<TIndex>* order,
+    Update update,
+    Prefetch prefetch) {
+  const TIndex distance = CAFFE2_SPARSE_PREFETCH_DISTANCE;
+  if (n < 2 * grain || ParallelThreads() < 2) {
+    for (TIndex i = 0; i < n; ++i) {
+      if (i + distance < n) {
+        prefetch(indices[i + distance]);
+      }
+      update(i);
+    }
+    return;
+  }
+  order->resize(n);
+  std::iota(order->begin(), order->end(), 0);
+  std::stable_sort(
+      order->begin(), order->end(), [indices](TIndex a, TIndex b) {
+        return indices[a] < indices[b];
+      });
+  const TIndex* sorted = order->data();
+  // Moves a chunk boundary forward to the first entry of an index.
+  auto boundary = [=](TIndex j) {
+    while (j > 0 && j < n && indices[sorted[j]] == indices[sorted[j - 1]]) {
+      ++j;
+    }
+    return j;
+  };
+  ParallelFor(
+      n,
+      [&](size_t begin, size_t end) {
+        const TIndex last = boundary(end);
+        for (TIndex j = boundary(begin); j < last; ++j) {
+          if (j + distance < last) {
+            prefetch(indices[sorted[j + distance]]);
+          }
+          update(sorted[j]);
+        }
+      },
+      grain,
+      1);
+}
+
+// Rows per chunk of ForEachSparseRow() for rows of block_size floats.
+inline TIndex SparseRowGrain(TIndex block_size) {
+  return std::max<TIndex>(
+      CAFFE2_PARALLEL_GRAIN / std::max<TIndex>(block_size, 1), 1);
+}
+
+} // namespace detail
+} // namespace caffe2
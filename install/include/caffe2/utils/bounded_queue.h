@@ -0,0 +1,86 @@
+#ifndef CAFFE2_UTILS_BOUNDED_QUEUE_H_
+#define CAFFE2_UTILS_BOUNDED_QUEUE_H_
+
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <queue>
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+// A SimpleQueue that holds at most capacity values: Push() waits while the
+// queue is full, which gives back-pressure when chaining several
+// producer/consumer stages. Values are moved in and out, so the queue can
+// hold move-only types such as unique_ptr.
+//
+// It has the same Push()/Pop()/NoMoreJobs() protocol as SimpleQueue, which
+// it does not extend because SimpleQueue is a member of classes compiled into
+// the prebuilt libraries.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+      : no_more_jobs_(false), capacity_(capacity) {
+    CAFFE_ENFORCE_GT(capacity, 0, "Queue capacity must be positive.");
+  }
+
+  // Pops a value and writes it to the value pointer. If there is nothing in
+  // the queue, this will wait till a value is inserted to the queue. If there
+  // are no more jobs to pop, the function returns false. Otherwise, it
+  // returns true.
+  bool Pop(T* value) {
+    {
+      std::unique_lock<std::mutex> mutex_lock(mutex_);
+      while (queue_.size() == 0 && !no_more_jobs_) cv_.wait(mutex_lock);
+      if (queue_.size() == 0 && no_more_jobs_) return false;
+      *value = std::move(queue_.front());
+      queue_.pop();
+    }
+    not_full_cv_.notify_one();
+    return true;
+  }
+
+  int size() {
+    std::unique_lock<std::mutex> mutex_lock(mutex_);
+    return queue_.size();
+  }
+
+  // Push pushes a value to the queue, waiting for room while it is full.
+  void Push(T&& value) {
+    {
+      std::unique_lock<std::mutex> mutex_lock(mutex_);
+      while (queue_.size() >= capacity_ && !no_more_jobs_) {
+        not_full_cv_.wait(mutex_lock);
+      }
+      CAFFE_ENFORCE(!no_more_jobs_, "Cannot push to a closed queue.");
+      queue_.push(std::move(value));
+    }
+    cv_.notify_one();
+  }
+
+  // NoMoreJobs() marks the close of this queue, as for SimpleQueue. It also
+  // wakes up the Push() calls waiting for room, which then fail.
+  void NoMoreJobs() {
+    {
+      std::lock_guard<std::mutex> mutex_lock(mutex_);
+      no_more_jobs_ = true;
+    }
+    cv_.notify_all();
+    not_full_cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable not_full_cv_;
+  std::queue<T> queue_;
+  bool no_more_jobs_;
+  const size_t capacity_;
+
+  DISABLE_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_UTILS_BOUNDED_QUEUE_H_
@@ -0,0 +1,97 @@
+#ifndef CAFFE2_UTILS_BOUNDED_TASK_RUNNER_H_
+#define CAFFE2_UTILS_BOUNDED_TASK_RUNNER_H_
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+/**
+ * Runs a batch of tasks on a shared TaskThreadPool, with at most
+ * max_in_flight of them queued or running at any time: Run() blocks the
+ * caller until one of the earlier tasks finishes. This keeps the memory held
+ * by pending tasks flat however many tasks are submitted, and slows the
+ * producer down to the pace of whatever the tasks feed into.
+ *
+ * Unlike TaskThreadPool, exceptions are not swallowed: the first one thrown
+ * by a task is rethrown by Wait(). Tasks submitted from a thread of the pool
+ * itself run inline, so nested use cannot deadlock the pool.
+ */
+class BoundedTaskRunner {
+ public:
+  BoundedTaskRunner(TaskThreadPool* pool, size_t max_in_flight)
+      : pool_(pool), max_in_flight_(max_in_flight) {
+    CAFFE_ENFORCE(pool_);
+    CAFFE_ENFORCE_GT(max_in_flight_, 0);
+  }
+
+  ~BoundedTaskRunner() {
+    // Tasks reference state owned by the caller, so they have to finish
+    // before it goes away, even when unwinding from an error.
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return in_flight_ == 0; });
+  }
+
+  template <typename Task>
+  void Run(Task task) {
+    if (pool_->inThreadPool()) {
+      RunGuarded(task);
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return in_flight_ < max_in_flight_; });
+      ++in_flight_;
+    }
+    pool_->runTask([this, task]() {
+      RunGuarded(task);
+      std::lock_guard<std::mutex> lock(mutex_);
+      --in_flight_;
+      done_.notify_all();
+    });
+  }
+
+  /**
+   * Blocks until all submitted tasks have finished, and rethrows the first
+   * exception any of them threw.
+   */
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return in_flight_ == 0; });
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  template <typename Task>
+  void RunGuarded(const Task& task) {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+
+  TaskThreadPool* pool_;
+  const size_t max_in_flight_;
+  size_t in_flight_{0};
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+
+  DISABLE_COPY_AND_ASSIGN(BoundedTaskRunner);
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_BOUNDED_TASK_RUNNER_H_
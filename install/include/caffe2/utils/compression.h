@@ -0,0 +1,574 @@
+#ifndef CAFFE2_UTILS_COMPRESSION_H_
+#define CAFFE2_UTILS_COMPRESSION_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe2/core/logging.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+namespace caffe2 {
+
+// Lightweight compression for serialized values such as checkpoint chunks.
+//
+// A value is first byte-shuffled: with a stride of s, byte j of every s-byte
+// element is grouped with byte j of all other elements, so that e.g. the
+// slowly varying exponent bytes of a float tensor end up next to each other.
+// The result is then compressed into a standard LZ4 frame (see
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md) of
+// independent blocks, with the content size and content checksum set, that
+// the lz4 tool and library can read. The blocks are compressed by a greedy
+// encoder of the LZ4 block format.
+//
+// A shuffled value is prefixed with a skippable frame holding "C2S" and the
+// shuffle stride, which LZ4 readers skip: they return the shuffled bytes.
+// Neither frame can start a serialized BlobProto, whose first field is its
+// name, so compressed values can be told apart from plain ones and read back
+// without knowing how they were written. DecompressValue() reads any LZ4
+// frame, including those of linked blocks and with block checksums.
+
+enum class CompressionCodec : uint8_t {
+  NONE = 0,
+  LZ4 = 1,
+};
+
+inline CompressionCodec StringToCompressionCodec(const string& str) {
+  if (str == "" || str == "none") {
+    return CompressionCodec::NONE;
+  } else if (str == "lz4") {
+    return CompressionCodec::LZ4;
+  }
+  CAFFE_THROW("Unknown compression codec: ", str);
+}
+
+constexpr uint32_t kLZ4FrameMagic = 0x184D2204;
+// Skippable frames have magic numbers 0x184D2A50 to 0x184D2A5F.
+constexpr uint32_t kShuffleFrameMagic = 0x184D2A5C;
+constexpr size_t kShuffleFrameSize = 12;
+
+/**
+ * Transposes size / stride elements of stride bytes each, so that dst holds
+ * byte 0 of all elements, then byte 1, and so on. Trailing bytes that do not
+ * fill an element are copied as they are.
+ */
+inline void ByteShuffle(
+    const uint8_t* src,
+    size_t size,
+    size_t stride,
+    uint8_t* dst) {
+  const size_t n = size / stride;
+  size_t i = 0;
+#ifdef __ARM_NEON__
+  if (stride == 4) {
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x4_t v = vld4q_u8(src + 4 * i);
+      vst1q_u8(dst + i, v.val[0]);
+      vst1q_u8(dst + n + i, v.val[1]);
+      vst1q_u8(dst + 2 * n + i, v.val[2]);
+      vst1q_u8(dst + 3 * n + i, v.val[3]);
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    for (size_t j = 0; j < stride; ++j) {
+      dst[j * n + i] = src[i * stride + j];
+    }
+  }
+  memcpy(dst + n * stride, src + n * stride, size - n * stride);
+}
+
+/**
+ * Inverse of ByteShuffle().
+ */
+inline void ByteUnshuffle(
+    const uint8_t* src,
+    size_t size,
+    size_t stride,
+    uint8_t* dst) {
+  const size_t n = size / stride;
+  size_t i = 0;
+#ifdef __ARM_NEON__
+  if (stride == 4) {
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x4_t v;
+      v.val[0] = vld1q_u8(src + i);
+      v.val[1] = vld1q_u8(src + n + i);
+      v.val[2] = vld1q_u8(src + 2 * n + i);
+      v.val[3] = vld1q_u8(src + 3 * n + i);
+      vst4q_u8(dst + 4 * i, v);
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    for (size_t j = 0; j < stride; ++j) {
+      dst[i * stride + j] = src[j * n + i];
+    }
+  }
+  memcpy(dst + n * stride, src + n * stride, size - n * stride);
+}
+
+namespace detail {
+
+constexpr size_t kLZ4MinMatch = 4;
+// The last match has to start this many bytes before the end of the input,
+// and the last kLZ4LastLiterals bytes are always literals.
+constexpr size_t kLZ4MFLimit = 12;
+constexpr size_t kLZ4LastLiterals = 5;
+constexpr size_t kLZ4MaxOffset = 65535;
+constexpr int kLZ4HashLog = 12;
+// Blocks of the frames CompressValue() writes, the largest size the format
+// allows.
+constexpr size_t kLZ4FrameBlockSize = 4 << 20;
+constexpr uint32_t kLZ4UncompressedBlock = 0x80000000u;
+
+inline uint32_t LZ4Read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t LZ4Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kLZ4HashLog);
+}
+
+// Frame fields are little endian whatever the host.
+inline uint32_t ReadLE32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t ReadLE64(const uint8_t* p) {
+  return static_cast<uint64_t>(ReadLE32(p)) |
+      (static_cast<uint64_t>(ReadLE32(p + 4)) << 32);
+}
+
+inline void WriteLE32(uint32_t v, string* dst) {
+  for (int i = 0; i < 4; ++i) {
+    dst->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  }
+}
+
+inline void WriteLE64(uint64_t v, string* dst) {
+  WriteLE32(static_cast<uint32_t>(v), dst);
+  WriteLE32(static_cast<uint32_t>(v >> 32), dst);
+}
+
+inline uint32_t XXH32Round(uint32_t acc, uint32_t input) {
+  acc += input * 2246822519u;
+  acc = (acc << 13) | (acc >> 19);
+  return acc * 2654435761u;
+}
+
+// The xxHash32 digest LZ4 frames use for their checksums.
+inline uint32_t XXH32(const uint8_t* p, size_t size, uint32_t seed) {
+  constexpr uint32_t kPrime1 = 2654435761u;
+  constexpr uint32_t kPrime2 = 2246822519u;
+  constexpr uint32_t kPrime3 = 3266489917u;
+  constexpr uint32_t kPrime4 = 668265263u;
+  constexpr uint32_t kPrime5 = 374761393u;
+  const uint8_t* const end = p + size;
+  uint32_t h;
+  if (size >= 16) {
+    uint32_t v1 = seed + kPrime1 + kPrime2;
+    uint32_t v2 = seed + kPrime2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - kPrime1;
+    for (; end - p >= 16; p += 16) {
+      v1 = XXH32Round(v1, ReadLE32(p));
+      v2 = XXH32Round(v2, ReadLE32(p + 4));
+      v3 = XXH32Round(v3, ReadLE32(p + 8));
+      v4 = XXH32Round(v4, ReadLE32(p + 12));
+    }
+    h = ((v1 << 1) | (v1 >> 31)) + ((v2 << 7) | (v2 >> 25)) +
+        ((v3 << 12) | (v3 >> 20)) + ((v4 << 18) | (v4 >> 14));
+  } else {
+    h = seed + kPrime5;
+  }
+  h += static_cast<uint32_t>(size);
+  for (; end - p >= 4; p += 4) {
+    h += ReadLE32(p) * kPrime3;
+    h = ((h << 17) | (h >> 15)) * kPrime4;
+  }
+  for (; p < end; ++p) {
+    h += *p * kPrime5;
+    h = ((h << 11) | (h >> 21)) * kPrime1;
+  }
+  h ^= h >> 15;
+  h *= kPrime2;
+  h ^= h >> 13;
+  h *= kPrime3;
+  h ^= h >> 16;
+  return h;
+}
+
+inline void LZ4WriteLength(size_t length, string* dst) {
+  for (; length >= 255; length -= 255) {
+    dst->push_back(static_cast<char>(255));
+  }
+  dst->push_back(static_cast<char>(length));
+}
+
+inline void LZ4WriteSequence(
+    const uint8_t* literals,
+    size_t literal_length,
+    size_t offset,
+    size_t match_length,
+    string* dst) {
+  const size_t ml = match_length - kLZ4MinMatch;
+  const uint8_t token = (std::min<size_t>(literal_length, 15) << 4) |
+      (match_length ? std::min<size_t>(ml, 15) : 0);
+  dst->push_back(static_cast<char>(token));
+  if (literal_length >= 15) {
+    LZ4WriteLength(literal_length - 15, dst);
+  }
+  dst->append(reinterpret_cast<const char*>(literals), literal_length);
+  if (match_length) {
+    dst->push_back(static_cast<char>(offset & 0xff));
+    dst->push_back(static_cast<char>(offset >> 8));
+    if (ml >= 15) {
+      LZ4WriteLength(ml - 15, dst);
+    }
+  }
+}
+
+inline size_t LZ4ReadLength(const uint8_t** ip, const uint8_t* end) {
+  size_t length = 0;
+  uint8_t b;
+  do {
+    CAFFE_ENFORCE(*ip < end, "Corrupted LZ4 data.");
+    b = *(*ip)++;
+    length += b;
+  } while (b == 255);
+  return length;
+}
+
+} // namespace detail
+
+/**
+ * Appends the LZ4 block compression of src to dst.
+ */
+inline void LZ4Compress(const uint8_t* src, size_t size, string* dst) {
+  using namespace detail;
+  dst->reserve(dst->size() + size + size / 255 + 16);
+  size_t anchor = 0;
+  if (size > kLZ4MFLimit) {
+    std::vector<int64_t> table(1 << kLZ4HashLog, -1);
+    const size_t match_start_limit = size - kLZ4MFLimit;
+    const size_t match_end_limit = size - kLZ4LastLiterals;
+    size_t ip = 0;
+    while (ip <= match_start_limit) {
+      const uint32_t sequence = LZ4Read32(src + ip);
+      const uint32_t h = LZ4Hash(sequence);
+      const int64_t ref = table[h];
+      table[h] = ip;
+      if (ref < 0 || ip - static_cast<size_t>(ref) > kLZ4MaxOffset ||
+          LZ4Read32(src + ref) != sequence) {
+        // Skip faster through incompressible data.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      size_t length = kLZ4MinMatch;
+      while (ip + length < match_end_limit &&
+             src[ref + length] == src[ip + length]) {
+        ++length;
+      }
+      LZ4WriteSequence(src + anchor, ip - anchor, ip - ref, length, dst);
+      ip += length;
+      anchor = ip;
+      if (ip - 2 <= match_start_limit) {
+        table[LZ4Hash(LZ4Read32(src + ip - 2))] = ip - 2;
+      }
+    }
+  }
+  LZ4WriteSequence(src + anchor, size - anchor, 0, 0, dst);
+}
+
+/**
+ * Decompresses an LZ4 block into at most capacity bytes at dst, and returns
+ * the number of bytes written. Matches may reach back to window, which is
+ * dst for an independent block and the start of the frame's output for a
+ * linked one. Throws on malformed input instead of reading or writing out of
+ * bounds.
+ */
+inline size_t LZ4Decompress(
+    const uint8_t* src,
+    size_t size,
+    const uint8_t* window,
+    uint8_t* dst,
+    size_t capacity) {
+  using namespace detail;
+  const uint8_t* ip = src;
+  const uint8_t* const end = src + size;
+  uint8_t* op = dst;
+  uint8_t* const oend = dst + capacity;
+  while (true) {
+    CAFFE_ENFORCE(ip < end, "Corrupted LZ4 data.");
+    const uint8_t token = *ip++;
+    size_t literal_length = token >> 4;
+    if (literal_length == 15) {
+      literal_length += LZ4ReadLength(&ip, end);
+    }
+    CAFFE_ENFORCE(
+        literal_length <= static_cast<size_t>(end - ip) &&
+            literal_length <= static_cast<size_t>(oend - op),
+        "Corrupted LZ4 data.");
+    memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+    if (ip == end) {
+      break;
+    }
+    CAFFE_ENFORCE(end - ip >= 2, "Corrupted LZ4 data.");
+    const size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    CAFFE_ENFORCE(
+        offset > 0 && offset <= static_cast<size_t>(op - window),
+        "Corrupted LZ4 data.");
+    size_t match_length = token & 15;
+    if (match_length == 15) {
+      match_length += LZ4ReadLength(&ip, end);
+    }
+    match_length += kLZ4MinMatch;
+    CAFFE_ENFORCE(
+        match_length <= static_cast<size_t>(oend - op),
+        "Corrupted LZ4 data.");
+    const uint8_t* match = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+      op += match_length;
+    } else {
+      // Overlapping copy, repeating the last offset bytes.
+      for (size_t i = 0; i < match_length; ++i) {
+        *op++ = *match++;
+      }
+    }
+  }
+  return op - dst;
+}
+
+/**
+ * Appends an LZ4 frame holding src to dst: independent blocks of up to 4 MB,
+ * stored uncompressed where compression does not shrink them, the content
+ * size and a content checksum.
+ */
+inline void LZ4CompressFrame(const uint8_t* src, size_t size, string* dst) {
+  using namespace detail;
+  WriteLE32(kLZ4FrameMagic, dst);
+  const size_t descriptor = dst->size();
+  // Version 01, independent blocks, content size, content checksum.
+  dst->push_back(0x6C);
+  // 4 MB blocks.
+  dst->push_back(0x70);
+  WriteLE64(size, dst);
+  const uint32_t header_checksum = XXH32(
+      reinterpret_cast<const uint8_t*>(dst->data()) + descriptor,
+      dst->size() - descriptor,
+      0);
+  dst->push_back(static_cast<char>((header_checksum >> 8) & 0xff));
+  for (size_t begin = 0; begin < size; begin += kLZ4FrameBlockSize) {
+    const size_t block_size = std::min(kLZ4FrameBlockSize, size - begin);
+    const size_t block_header = dst->size();
+    WriteLE32(0, dst);
+    LZ4Compress(src + begin, block_size, dst);
+    uint32_t stored = dst->size() - block_header - 4;
+    if (stored >= block_size) {
+      dst->resize(block_header + 4);
+      dst->append(reinterpret_cast<const char*>(src + begin), block_size);
+      stored = block_size | kLZ4UncompressedBlock;
+    }
+    for (int i = 0; i < 4; ++i) {
+      (*dst)[block_header + i] = static_cast<char>((stored >> (8 * i)) & 0xff);
+    }
+  }
+  // End mark.
+  WriteLE32(0, dst);
+  WriteLE32(XXH32(src, size, 0), dst);
+}
+
+/**
+ * Appends the content of the LZ4 frame at the start of src to dst, and
+ * returns the size of the frame. Reads the frames of any LZ4 writer but
+ * those depending on a dictionary, and verifies all their checksums.
+ */
+inline size_t LZ4DecompressFrame(const uint8_t* src, size_t size, string* dst) {
+  using namespace detail;
+  CAFFE_ENFORCE(
+      size >= 7 && ReadLE32(src) == kLZ4FrameMagic, "Not an LZ4 frame.");
+  const uint8_t flags = src[4];
+  const uint8_t block_descriptor = src[5];
+  CAFFE_ENFORCE_EQ(flags >> 6, 1, "Unsupported LZ4 frame version.");
+  CAFFE_ENFORCE(
+      (flags & 0x02) == 0 && (block_descriptor & 0x8F) == 0,
+      "Corrupted LZ4 frame header.");
+  CAFFE_ENFORCE(
+      (flags & 0x01) == 0, "LZ4 frames with a dictionary are not supported.");
+  const bool independent_blocks = flags & 0x20;
+  const bool block_checksums = flags & 0x10;
+  const bool has_content_size = flags & 0x08;
+  const bool content_checksum = flags & 0x04;
+  const int block_code = block_descriptor >> 4;
+  CAFFE_ENFORCE(
+      block_code >= 4 && block_code <= 7, "Corrupted LZ4 frame header.");
+  const size_t block_max_size = size_t(1) << (8 + 2 * block_code);
+  const size_t header_size = has_content_size ? 15 : 7;
+  CAFFE_ENFORCE_GE(size, header_size, "Truncated LZ4 frame.");
+  CAFFE_ENFORCE_EQ(
+      src[header_size - 1],
+      (XXH32(src + 4, header_size - 5, 0) >> 8) & 0xff,
+      "LZ4 frame header checksum mismatch.");
+  const size_t out_begin = dst->size();
+  uint64_t content_size = 0;
+  if (has_content_size) {
+    content_size = ReadLE64(src + 6);
+    // LZ4 cannot expand data by more than 255x; checking this first keeps a
+    // corrupted size from triggering a huge allocation.
+    CAFFE_ENFORCE_LE(content_size, 255 * size, "Corrupted LZ4 frame header.");
+    dst->reserve(out_begin + content_size);
+  }
+
+  size_t ip = header_size;
+  while (true) {
+    CAFFE_ENFORCE_GE(size - ip, 4, "Truncated LZ4 frame.");
+    const uint32_t block = ReadLE32(src + ip);
+    ip += 4;
+    if (block == 0) {
+      break;
+    }
+    const size_t block_size = block & ~kLZ4UncompressedBlock;
+    CAFFE_ENFORCE(
+        block_size <= block_max_size &&
+            block_size + (block_checksums ? 4 : 0) <= size - ip,
+        "Corrupted LZ4 frame.");
+    if (block & kLZ4UncompressedBlock) {
+      dst->append(reinterpret_cast<const char*>(src + ip), block_size);
+    } else {
+      const size_t op = dst->size();
+      dst->resize(op + block_max_size);
+      uint8_t* out = reinterpret_cast<uint8_t*>(&(*dst)[0]);
+      const size_t written = LZ4Decompress(
+          src + ip,
+          block_size,
+          out + (independent_blocks ? op : out_begin),
+          out + op,
+          block_max_size);
+      dst->resize(op + written);
+    }
+    ip += block_size;
+    if (block_checksums) {
+      CAFFE_ENFORCE_EQ(
+          ReadLE32(src + ip),
+          XXH32(src + ip - block_size, block_size, 0),
+          "LZ4 block checksum mismatch.");
+      ip += 4;
+    }
+  }
+  const size_t out_size = dst->size() - out_begin;
+  if (has_content_size) {
+    CAFFE_ENFORCE_EQ(
+        out_size, content_size, "LZ4 frame does not match its content size.");
+  }
+  if (content_checksum) {
+    CAFFE_ENFORCE_GE(size - ip, 4, "Truncated LZ4 frame.");
+    CAFFE_ENFORCE_EQ(
+        ReadLE32(src + ip),
+        XXH32(reinterpret_cast<const uint8_t*>(dst->data()) + out_begin,
+              out_size,
+              0),
+        "LZ4 content checksum mismatch.");
+    ip += 4;
+  }
+  return ip;
+}
+
+inline bool IsCompressedValue(const string& value) {
+  using detail::ReadLE32;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(value.data());
+  if (value.size() < 4) {
+    return false;
+  }
+  return ReadLE32(p) == kLZ4FrameMagic ||
+      (ReadLE32(p) == kShuffleFrameMagic &&
+       value.size() >= kShuffleFrameSize && ReadLE32(p + 4) == 4 &&
+       memcmp(p + 8, "C2S", 3) == 0);
+}
+
+/**
+ * Returns value compressed with codec after shuffling it with the given byte
+ * stride, or value itself if that would not make it smaller.
+ */
+inline string CompressValue(
+    const string& value,
+    CompressionCodec codec,
+    int shuffle_stride) {
+  CAFFE_ENFORCE(
+      shuffle_stride >= 1 && shuffle_stride <= 255,
+      "Invalid shuffle stride ",
+      shuffle_stride);
+  if (codec == CompressionCodec::NONE || value.empty()) {
+    return value;
+  }
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(value.data());
+  std::vector<uint8_t> shuffled;
+  string out;
+  if (shuffle_stride > 1) {
+    shuffled.resize(value.size());
+    ByteShuffle(src, value.size(), shuffle_stride, shuffled.data());
+    src = shuffled.data();
+    detail::WriteLE32(kShuffleFrameMagic, &out);
+    detail::WriteLE32(4, &out);
+    out.append("C2S", 3);
+    out.push_back(static_cast<char>(shuffle_stride));
+  }
+  switch (codec) {
+    case CompressionCodec::LZ4:
+      LZ4CompressFrame(src, value.size(), &out);
+      break;
+    case CompressionCodec::NONE:
+      break;
+  }
+  return out.size() < value.size() ? out : value;
+}
+
+/**
+ * Inverse of CompressValue(). Values that are not compressed are returned as
+ * they are.
+ */
+inline string DecompressValue(const string& value) {
+  if (!IsCompressedValue(value)) {
+    return value;
+  }
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(value.data());
+  size_t size = value.size();
+  size_t shuffle_stride = 1;
+  if (detail::ReadLE32(src) == kShuffleFrameMagic) {
+    shuffle_stride = src[kShuffleFrameSize - 1];
+    CAFFE_ENFORCE_GE(shuffle_stride, 1, "Corrupted compressed value.");
+    src += kShuffleFrameSize;
+    size -= kShuffleFrameSize;
+  }
+  string decoded;
+  CAFFE_ENFORCE_EQ(
+      LZ4DecompressFrame(src, size, &decoded),
+      size,
+      "Trailing data after the LZ4 frame.");
+  if (shuffle_stride == 1) {
+    return decoded;
+  }
+  string out(decoded.size(), '\0');
+  ByteUnshuffle(
+      reinterpret_cast<const uint8_t*>(decoded.data()),
+      decoded.size(),
+      shuffle_stride,
+      reinterpret_cast<uint8_t*>(&out[0]));
+  return out;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_COMPRESSION_H_
@@ -60,6 +60,21 @@ class TaskThreadPool{
         condition_.notify_one();
     }
 
+    /// @brief Whether the calling thread is one of the pool's workers.
+    bool inThreadPool() const {
+        for (const auto& t : threads_) {
+            if (t.get_id() == std::this_thread::get_id()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief Number of worker threads.
+    std::size_t size() const {
+        return total_;
+    }
+
     /// @brief Wait for queue to be empty
     void waitWorkComplete() {
         std::unique_lock<std::mutex> lock(mutex_);
@@ -0,0 +1,140 @@
+#ifndef CAFFE2_UTILS_TOP_K_H_
+#define CAFFE2_UTILS_TOP_K_H_
+
+// Selection of the k largest values of a row, shared by TopKOp and the
+// predictor's top-k output.
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif // __ARM_NEON__
+
+namespace caffe2 {
+
+// Whether (a, i) ranks before (b, j) in TopK order: larger values first, and
+// smaller indices first among equal values.
+template <typename T>
+inline bool TopKBefore(T a, TIndex i, T b, TIndex j) {
+  return a > b || (a == b && i < j);
+}
+
+// Returns the first index in [begin, end) whose value is greater than
+// threshold, or end.
+template <typename T>
+inline TIndex TopKFindAbove(const T* x, TIndex begin, TIndex end, T threshold) {
+  // Count branch free over blocks of 16, which compilers vectorize.
+  TIndex i = begin;
+  for (; i + 16 <= end; i += 16) {
+    int above = 0;
+    for (int j = 0; j < 16; ++j) {
+      above += x[i + j] > threshold;
+    }
+    if (above) {
+      break;
+    }
+  }
+  for (; i < end; ++i) {
+    if (x[i] > threshold) {
+      return i;
+    }
+  }
+  return end;
+}
+
+#ifdef __ARM_NEON__
+template <>
+inline TIndex TopKFindAbove<float>(
+    const float* x,
+    TIndex begin,
+    TIndex end,
+    float threshold) {
+  // Once the heap is full, almost every element is below the k-th value, so
+  // test 16 at a time and only look closer at blocks with a candidate.
+  const float32x4_t t = vdupq_n_f32(threshold);
+  TIndex i = begin;
+  for (; i + 16 <= end; i += 16) {
+    const uint32x4_t above = vorrq_u32(
+        vorrq_u32(
+            vcgtq_f32(vld1q_f32(x + i), t), vcgtq_f32(vld1q_f32(x + i + 4), t)),
+        vorrq_u32(
+            vcgtq_f32(vld1q_f32(x + i + 8), t),
+            vcgtq_f32(vld1q_f32(x + i + 12), t)));
+    const uint32x2_t folded =
+        vorr_u32(vget_low_u32(above), vget_high_u32(above));
+    if (vget_lane_u32(vpmax_u32(folded, folded), 0)) {
+      break;
+    }
+  }
+  for (; i < end; ++i) {
+    if (x[i] > threshold) {
+      return i;
+    }
+  }
+  return end;
+}
+#endif // __ARM_NEON__
+
+// Writes the k largest values of the n values of x, and their indices, to
+// values and indices, in TopK order. scratch is reused across calls.
+template <typename T>
+inline void TopKRow(
+    const T* x,
+    TIndex n,
+    TIndex k,
+    T* values,
+    TIndex* indices,
+    vector<std::pair<T, TIndex>>* scratch) {
+  using Item = std::pair<T, TIndex>;
+  auto before = [](const Item& a, const Item& b) {
+    return TopKBefore(a.first, a.second, b.first, b.second);
+  };
+  if (k == 1) {
+    TIndex best = 0;
+    for (TIndex i = TopKFindAbove(x, 1, n, x[0]); i < n;
+         i = TopKFindAbove(x, i + 1, n, x[best])) {
+      best = i;
+    }
+    values[0] = x[best];
+    indices[0] = best;
+    return;
+  }
+  auto& items = *scratch;
+  items.clear();
+  if (k * 4 > n) {
+    // Most of the row is kept anyway: select in place.
+    items.reserve(n);
+    for (TIndex i = 0; i < n; ++i) {
+      items.emplace_back(x[i], i);
+    }
+    std::nth_element(items.begin(), items.begin() + k - 1, items.end(), before);
+    items.resize(k);
+  } else {
+    // Bounded heap whose top is the worst of the k best seen so far. Only
+    // values above it can enter, since equal values come later and lose.
+    items.reserve(k);
+    for (TIndex i = 0; i < k; ++i) {
+      items.emplace_back(x[i], i);
+    }
+    std::make_heap(items.begin(), items.end(), before);
+    for (TIndex i = TopKFindAbove(x, k, n, items.front().first); i < n;
+         i = TopKFindAbove(x, i + 1, n, items.front().first)) {
+      std::pop_heap(items.begin(), items.end(), before);
+      items.back() = Item(x[i], i);
+      std::push_heap(items.begin(), items.end(), before);
+    }
+  }
+  std::sort(items.begin(), items.end(), before);
+  for (TIndex j = 0; j < k; ++j) {
+    values[j] = items[j].first;
+    indices[j] = items[j].second;
+  }
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_TOP_K_H_
@@ -8,6 +8,12 @@
 
 #import <UIKit/UIKit.h>
 
+// One entry of a top-k prediction: the class index and its score.
+typedef struct {
+  NSInteger index;
+  float score;
+} Caffe2Prediction;
+
 @interface Caffe2: NSObject
 
 // set the networks enforced image input size. If not set, the images dimensions will be used.
@@ -20,4 +26,10 @@ NS_SWIFT_NAME(init(initNetNamed:predictNetNamed:));
 
 - (nullable NSArray<NSNumber*>*) predict:(nonnull UIImage*) image
 NS_SWIFT_NAME(prediction(regarding:));
+
+// Writes the k best scoring classes, best first, to results, which must have room for k entries.
+// Unlike predict:, this neither boxes nor sorts all class scores.
+// Returns the number of entries written: min(k, number of classes), or 0 if the prediction failed.
+- (NSInteger) predict:(nonnull UIImage*) image top:(NSInteger)k into:(nonnull Caffe2Prediction*)results
+NS_SWIFT_NAME(prediction(regarding:top:into:));
 @end
@@ -11,6 +11,18 @@
 #import "Caffe2.h"
 
 #include "caffe2/core/predictor.h"
+// The SIMD engine operators the predict net opts into in init:predict:error:.
+#include "caffe2/operators/clip_op.h"
+#include "caffe2/operators/elementwise_op.h"
+#include "caffe2/operators/instance_norm_op.h"
+#include "caffe2/operators/local_response_normalization_op.h"
+#include "caffe2/operators/pool_op.h"
+#include "caffe2/operators/relu_op.h"
+#include "caffe2/operators/scale_op.h"
+#include "caffe2/operators/simd_engine.h"
+#include "caffe2/operators/spatial_batch_norm_op.h"
+#include "caffe2/operators/top_k.h"
+#include "caffe2/operators/utility_ops.h"
 #include "caffe2/utils/proto_utils.h"
 
 
@@ -83,6 +95,9 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
   caffe2::NetDef _initNet;
   caffe2::NetDef _predictNet;
   caffe2::Predictor *_predictor;
+  // Reused across top-k predictions.
+  std::vector<caffe2::TIndex> _topKIndices;
+  std::vector<float> _topKScores;
 }
 
 @property (atomic, assign) BOOL busyWithInference;
@@ -116,6 +131,9 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
     ReadProtoIntoNet(predictNetPath.UTF8String, &_predictNet);
 
     _predictNet.set_name("PredictNet");
+    // Run the fused float kernels of the headers above wherever the net
+    // leaves the engine to us.
+    caffe2::UseSIMDEngine(&_predictNet);
     _predictor = new caffe2::Predictor(_initNet, _predictNet);
   }
   return self;
@@ -125,12 +143,11 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
   google::protobuf::ShutdownProtobufLibrary();
 }
 
-- (nullable NSArray<NSNumber*>*) predict:(nonnull UIImage*) image{
-  NSMutableArray* result = nil;
-  caffe2::Predictor::TensorVector output_vec;
-
+// Converts the image into the predictor's input and runs it; run is called with the input once it is ready.
+// Returns whether the prediction ran.
+- (BOOL) runOnImage:(nonnull UIImage*) image with:(void (^)(const caffe2::Predictor::TensorVector& input_vec))run {
   if (self.busyWithInference) {
-    return nil;
+    return NO;
   } else {
     self.busyWithInference = true;
   }
@@ -140,7 +157,8 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
   // We do this to ensure correct color space layout
   CGContextRef cgctx = CreateRGBABitmapContext(inImage);
   if (cgctx == NULL){
-    return nil;
+    self.busyWithInference = false;
+    return NO;
   }
 
   // Get image width, height. We'll use the entire image.
@@ -153,6 +171,7 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
   // raw image data in the specified color space.
   CGContextDrawImage(cgctx, rect, inImage);
   void *data = CGBitmapContextGetData (cgctx);
+  BOOL ran = NO;
   if (_predictor && data) {
     UInt8* pixels = (UInt8*) data;
     caffe2::TensorCPU input;
@@ -187,7 +206,28 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
     input.ShareExternalPointer(inputPlanar.data());
 
     caffe2::Predictor::TensorVector input_vec{&input};
-    _predictor->run(input_vec, &output_vec);
+    run(input_vec);
+    ran = YES;
+  }
+
+  // When finished, release the context/ data
+  CGContextRelease(cgctx);
+  if (data) {
+    free(data);
+  }
+
+  self.busyWithInference = false;
+  return ran;
+}
+
+- (nullable NSArray<NSNumber*>*) predict:(nonnull UIImage*) image{
+  __block NSMutableArray* result = nil;
+  caffe2::Predictor* predictor = _predictor;
+  [self runOnImage:image with:^(const caffe2::Predictor::TensorVector& input_vec) {
+    caffe2::Predictor::TensorVector output_vec;
+    // Parameters loaded by a LazyLoad op are stubs until the net reads them.
+    caffe2::MaterializeLazyBlobs(predictor->ws(), predictor->def());
+    predictor->run(input_vec, &output_vec);
 
     if (output_vec.capacity() > 0) {
       for (auto output : output_vec) {
@@ -198,19 +238,31 @@ CGContextRef CreateRGBABitmapContext (CGImageRef inImage)
         }
       }
     }
+  }];
+  return result;
+}
 
-
-    self.busyWithInference = false;
+- (NSInteger) predict:(nonnull UIImage*) image top:(NSInteger)k into:(nonnull Caffe2Prediction*)results {
+  if (k < 1) {
+    return 0;
   }
-
-  // When finished, release the context/ data
-  CGContextRelease(cgctx);
-  if (data) {
-    free(data);
+  std::vector<caffe2::TIndex>* indices = &_topKIndices;
+  std::vector<float>* scores = &_topKScores;
+  caffe2::Predictor* predictor = _predictor;
+  __block caffe2::TIndex kept = 0;
+  BOOL ran = [self runOnImage:image with:^(const caffe2::Predictor::TensorVector& input_vec) {
+    // currently only the first row of the first output is returned
+    kept = predictor->runTopK(input_vec, (int)k, indices, scores);
+  }];
+  if (!ran) {
+    return 0;
   }
-
-  self.busyWithInference = false;
-  return result;
+  const NSInteger count = (NSInteger)kept;
+  for (NSInteger i = 0; i < count; ++i) {
+    results[i].index = (NSInteger)(*indices)[i];
+    results[i].score = (*scores)[i];
+  }
+  return count;
 }
 
 @end